@@ -0,0 +1,695 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+/*
+ * Micro-benchmarks for the library's hot paths, run with "make bench".
+ *
+ * The corpora are generated from a fixed seed so runs are comparable across
+ * builds and machines.  Each benchmark is timed as the median of several
+ * samples and reported in bytes/s and items/s, on stdout as a table and,
+ * with --json, as a machine-readable file.
+ */
+#include <libusenet/crc32.h>
+#include <libusenet/yenc.h>
+#include <libusenet/nzbparse.h>
+#include <libusenet/binParts.h>
+#include <libusenet/base64.h>
+#include <libusenet/uudecode.h>
+#include <libusenet/nntpclient.h>
+#include "yencKernels.h"
+#include "crc32Kernels.h"
+#include "base64Kernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/*
+ * Options
+ */
+struct Options
+{
+	double min_time = 0.1;
+	int samples = 5;
+	unsigned long max_segments = 1000000;
+	const char *filter = nullptr;
+	const char *json_path = nullptr;
+	bool list = false;
+};
+
+static Options g_options;
+
+/*
+ * Results
+ */
+struct Result
+{
+	std::string name;
+	unsigned long iterations;
+	double seconds;				// median time of one iteration
+	unsigned long bytes;		// per iteration
+	unsigned long items;		// per iteration
+};
+
+static std::vector<Result> g_results;
+
+/*
+ * xorshift64*, a fixed seed makes every corpus the same on every run
+ */
+class Random
+{
+public:
+
+	explicit Random(uint64_t seed = 0x9e3779b97f4a7c15ULL) : m_state(seed) {}
+
+	uint64_t next()
+	{
+		m_state ^= m_state >> 12;
+		m_state ^= m_state << 25;
+		m_state ^= m_state >> 27;
+		return m_state * 0x2545f4914f6cdd1dULL;
+	}
+
+	unsigned int below(unsigned int n) { return (unsigned int)(next() % n); }
+
+private:
+
+	uint64_t m_state;
+};
+
+/*
+ * An ostream which discards its output, so encoding is timed without a copy
+ */
+class NullBuf
+:	public std::streambuf
+{
+protected:
+
+	std::streamsize xsputn(const char*, std::streamsize n) { return n; }
+	int_type overflow(int_type c) { return traits_type::not_eof(c); }
+};
+
+// defeat dead code elimination of a benchmark's result
+static volatile unsigned long g_sink;
+
+typedef std::chrono::steady_clock Clock;
+
+static void run(const std::string& name, unsigned long bytes, unsigned long items, const std::function<void()>& fn)
+{
+	if(g_options.list)
+	{
+		std::cout << name << std::endl;
+		return;
+	}
+	if((nullptr != g_options.filter) && (std::string::npos == name.find(g_options.filter)))
+		return;
+
+	// warm up the caches and find the batch size for a sample of min_time
+	unsigned long batch = 1;
+	for(;;)
+	{
+		auto start = Clock::now();
+		for(unsigned long i = 0; i < batch; ++i)
+			fn();
+		double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		if((elapsed >= g_options.min_time) || (batch >= (1UL << 30)))
+			break;
+		batch = (elapsed > 0) ? std::max(batch * 2, (unsigned long)(batch * g_options.min_time * 1.2 / elapsed)) : batch * 16;
+	}
+
+	std::vector<double> times;
+	for(int s = 0; s < g_options.samples; ++s)
+	{
+		auto start = Clock::now();
+		for(unsigned long i = 0; i < batch; ++i)
+			fn();
+		times.push_back(std::chrono::duration<double>(Clock::now() - start).count() / batch);
+	}
+	std::sort(times.begin(), times.end());
+
+	Result result = { name, batch * g_options.samples, times[times.size() / 2], bytes, items };
+	g_results.push_back(result);
+
+	char line[256];
+	snprintf(line, sizeof(line), "%-44s %12.1f MB/s %14.0f items/s %12.3f us",
+		name.c_str(), (bytes / result.seconds) / 1e6, items / result.seconds, result.seconds * 1e6);
+	std::cout << line << std::endl;
+}
+
+static std::string json_escape(const std::string& str)
+{
+	std::string result;
+	for(auto c : str)
+	{
+		if(('"' == c) || ('\\' == c))
+			result += '\\';
+		result += c;
+	}
+	return result;
+}
+
+static void write_json(const char *path)
+{
+	std::ofstream out(path);
+	if(!out)
+		throw std::runtime_error(std::string("Cannot open file: ") + path);
+
+	out << "{\n";
+	out << "\t\"yenc_decode_kernel\": \"" << yEnc::Kernel::get_decode_kernel_name() << "\",\n";
+	out << "\t\"crc32_kernel\": \"" << Crc32Kernel::get_update_kernel_name() << "\",\n";
+	out << "\t\"min_time\": " << g_options.min_time << ",\n";
+	out << "\t\"samples\": " << g_options.samples << ",\n";
+	out << "\t\"benchmarks\": [";
+	for(size_t i = 0; i < g_results.size(); ++i)
+	{
+		const Result& r = g_results[i];
+		char values[256];
+		snprintf(values, sizeof(values),
+			"\"iterations\": %lu, \"seconds\": %.9g, \"bytes\": %lu, \"items\": %lu, "
+			"\"bytes_per_second\": %.6g, \"items_per_second\": %.6g",
+			r.iterations, r.seconds, r.bytes, r.items, r.bytes / r.seconds, r.items / r.seconds);
+		out << ((0 == i) ? "\n" : ",\n") << "\t\t{ \"name\": \"" << json_escape(r.name) << "\", " << values << " }";
+	}
+	out << "\n\t]\n}\n";
+}
+
+/*
+ * yEnc corpora
+ */
+
+// random bytes give the natural escape density of about 1.6%, the high
+// density corpus has half of its bytes encode to a critical char
+static std::vector<uint8_t> make_bytes(unsigned long len, bool high_escapes)
+{
+	static const uint8_t critical[] = { 256 - 42, 256 + 10 - 42, 256 + 13 - 42, '=' - 42 };
+
+	Random rng(high_escapes ? 2 : 1);
+	std::vector<uint8_t> result(len);
+	for(auto& b : result)
+	{
+		b = (uint8_t)rng.next();
+		if(high_escapes && (rng.next() & 1))
+			b = critical[rng.below(4)];
+	}
+	return result;
+}
+
+// the lines of a yEnc article, without line endings, as the NNTP client passes
+// them to decode; the first and last are the =ybegin and =yend lines
+struct EncodedLines
+{
+	std::string text;
+	std::vector<std::pair<unsigned long, unsigned long>> lines;
+};
+
+static EncodedLines make_lines(const std::vector<uint8_t>& bytes)
+{
+	std::ostringstream out;
+	yEnc::Encoder encoder("bench.bin", 128);
+	encoder.encode_init(out, bytes.size());
+	encoder.encode_chunk(out, &bytes[0], bytes.size());
+	encoder.encode_close(out);
+
+	EncodedLines result;
+	result.text = out.str();
+	for(unsigned long pos = 0; pos < result.text.size();)
+	{
+		unsigned long eol = result.text.find('\n', pos);
+		if(std::string::npos == eol)
+			eol = result.text.size();
+		result.lines.emplace_back(pos, eol - pos);
+		pos = eol + 1;
+	}
+	return result;
+}
+
+// a whole article body as read from the server, CRLF and dot-stuffed
+static std::string make_body(const std::vector<uint8_t>& bytes)
+{
+	std::ostringstream out;
+	yEnc::Encoder encoder("bench.bin", [](std::ostream& o) -> std::ostream& { o << "\r\n"; return o; }, 128);
+	encoder.encode_init(out, bytes.size(), 1, 1, bytes.size(), 1);
+	encoder.encode_usenet_chunk(out, &bytes[0], bytes.size());
+	encoder.encode_close(out);
+	out << ".\r\n";
+	return out.str();
+}
+
+static void bench_yenc(const char *corpus, bool high_escapes)
+{
+	const unsigned long len = 1024 * 1024;
+	const std::vector<uint8_t> bytes = make_bytes(len, high_escapes);
+	const EncodedLines encoded = make_lines(bytes);
+	const std::string body = make_body(bytes);
+	const std::string suffix = std::string("/") + corpus;
+
+	std::vector<unsigned char> out(encoded.text.size() + body.size());
+
+	run("yenc/decoder_decode" + suffix, encoded.text.size(), encoded.lines.size(), [&]()
+	{
+		yEnc::Decoder decoder;
+		unsigned long total = 0;
+		for(auto& line : encoded.lines)
+		{
+			int outlen = 0;
+			decoder.decode(&out[0], &outlen, &encoded.text[line.first], (int)line.second);
+			total += outlen;
+		}
+		g_sink = total;
+	});
+
+	for(auto p_kernel = yEnc::Kernel::get_decode_kernels(); nullptr != p_kernel->name; ++p_kernel)
+	{
+		if(!p_kernel->is_supported)
+			continue;
+		auto decode = p_kernel->decode;
+		run(std::string("yenc/decode_kernel/") + p_kernel->name + suffix, encoded.text.size(), encoded.lines.size(), [&]()
+		{
+			unsigned long total = 0;
+			for(auto p_line = encoded.lines.begin() + 1; p_line < encoded.lines.end() - 1; ++p_line)
+			{
+				int escape = 0;
+				total += decode(&out[0], &encoded.text[p_line->first], (long)p_line->second, &escape);
+			}
+			g_sink = total;
+		});
+	}
+
+	run("yenc/decoder_decode_body" + suffix, body.size(), encoded.lines.size(), [&]()
+	{
+		yEnc::Decoder decoder;
+		unsigned long outlen = 0, used = 0;
+		decoder.decode_body(&out[0], &outlen, body.data(), body.size(), &used);
+		g_sink = outlen;
+	});
+
+	std::ostream null_out(new NullBuf);
+	run("yenc/encoder_encode_chunk" + suffix, len, encoded.lines.size(), [&]()
+	{
+		yEnc::Encoder encoder("bench.bin", 128);
+		encoder.encode_chunk(null_out, &bytes[0], len);
+		g_sink = encoder.get_crc32();
+	});
+	delete null_out.rdbuf();
+
+	std::vector<char> encbuf(yEnc::Encoder::get_max_encoded_size(len, 128, yEnc::LineEndCRLF::size));
+	run("yenc/encoder_encode_buffer" + suffix, len, encoded.lines.size(), [&]()
+	{
+		yEnc::Encoder encoder("bench.bin", 128);
+		g_sink = encoder.encode_buffer<yEnc::LineEndCRLF, yEnc::DotStuffing>(&encbuf[0], encbuf.size(), &bytes[0], len);
+	});
+
+	for(auto p_kernel = yEnc::Kernel::get_encode_kernels<2, true>(); nullptr != p_kernel->name; ++p_kernel)
+	{
+		if(!p_kernel->is_supported)
+			continue;
+		auto encode = p_kernel->encode;
+		run(std::string("yenc/encode_kernel/") + p_kernel->name + suffix, len, encoded.lines.size(), [&]()
+		{
+			int col = 0;
+			g_sink = encode(&encbuf[0], &bytes[0], len, &col, 128);
+		});
+	}
+}
+
+/*
+ * CRC32
+ */
+static void bench_crc32()
+{
+	const std::vector<uint8_t> bytes = make_bytes(1024 * 1024, false);
+
+	run("crc32/update_crc/1MiB", bytes.size(), 1, [&]()
+	{
+		Crc32 crc;
+		crc.update_crc(&bytes[0], bytes.size());
+		g_sink = crc.get_value();
+	});
+
+	// one update per yEnc line, as the decoder used to do
+	const unsigned long line_len = 128, lines = bytes.size() / line_len;
+	run("crc32/update_crc/128B", bytes.size(), lines, [&]()
+	{
+		Crc32 crc;
+		for(unsigned long i = 0; i < lines; ++i)
+			crc.update_crc(&bytes[i * line_len], line_len);
+		g_sink = crc.get_value();
+	});
+
+	for(auto p_kernel = Crc32Kernel::get_update_kernels(); nullptr != p_kernel->name; ++p_kernel)
+	{
+		if(!p_kernel->is_supported)
+			continue;
+		auto update = p_kernel->update;
+		run(std::string("crc32/kernel/") + p_kernel->name, bytes.size(), 1, [&]()
+		{
+			g_sink = update(~0U, &bytes[0], bytes.size());
+		});
+	}
+
+	run("crc32/combine", 0, 1, [&]()
+	{
+		g_sink = Crc32::combine(0x12345678, 0x9abcdef0, 768000);
+	});
+}
+
+/*
+ * Base64 and uuencode
+ */
+static std::vector<std::string> make_base64_lines(const std::vector<uint8_t>& bytes)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	// 57 bytes to a 76 char line, as MIME encoders write them
+	std::vector<std::string> result;
+	for(unsigned long pos = 0; pos + 57 <= bytes.size(); pos += 57)
+	{
+		std::string line;
+		for(unsigned long i = pos; i < pos + 57; i += 3)
+		{
+			const uint32_t bits = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+			line += alphabet[bits >> 18];
+			line += alphabet[(bits >> 12) & 0x3f];
+			line += alphabet[(bits >> 6) & 0x3f];
+			line += alphabet[bits & 0x3f];
+		}
+		result.push_back(line);
+	}
+	return result;
+}
+
+static std::vector<std::string> make_uu_lines(const std::vector<uint8_t>& bytes)
+{
+	std::vector<std::string> result;
+	for(unsigned long pos = 0; pos + 45 <= bytes.size(); pos += 45)
+	{
+		std::string line(1, (char)(' ' + 45));
+		for(unsigned long i = pos; i < pos + 45; i += 3)
+		{
+			const uint32_t bits = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+			for(int shift = 18; shift >= 0; shift -= 6)
+			{
+				const uint32_t value = (bits >> shift) & 0x3f;
+				line += (0 == value) ? '`' : (char)(' ' + value);
+			}
+		}
+		result.push_back(line);
+	}
+	return result;
+}
+
+static void bench_mime()
+{
+	const std::vector<uint8_t> bytes = make_bytes(1024 * 1024, false);
+	const std::vector<std::string> b64_lines = make_base64_lines(bytes);
+	const std::vector<std::string> uu_lines = make_uu_lines(bytes);
+
+	unsigned long b64_bytes = 0, uu_bytes = 0;
+	for(auto& line : b64_lines)
+		b64_bytes += line.size();
+	for(auto& line : uu_lines)
+		uu_bytes += line.size();
+
+	std::vector<unsigned char> out(bytes.size());
+
+	run("base64/decoder_decode", b64_bytes, b64_lines.size(), [&]()
+	{
+		Base64Decoder decoder;
+		int outlen = 0;
+		for(auto& line : b64_lines)
+			decoder.decode(&out[0], &outlen, line.data(), (int)line.size());
+		g_sink = outlen;
+	});
+
+	for(auto p_kernel = Base64Kernel::get_decode_kernels(); nullptr != p_kernel->name; ++p_kernel)
+	{
+		if(!p_kernel->is_supported)
+			continue;
+		auto decode = p_kernel->decode;
+		run(std::string("base64/decode_kernel/") + p_kernel->name, b64_bytes, b64_lines.size(), [&]()
+		{
+			unsigned long total = 0;
+			long used;
+			for(auto& line : b64_lines)
+				total += decode(&out[0], line.data(), (long)line.size(), &used);
+			g_sink = total;
+		});
+	}
+
+	run("uu/decoder_decode", uu_bytes, uu_lines.size(), [&]()
+	{
+		UUDecoder decoder;
+		int outlen = 0;
+		decoder.decode(&out[0], &outlen, "begin 644 bench.bin", 19);
+		for(auto& line : uu_lines)
+			decoder.decode(&out[0], &outlen, line.data(), (int)line.size());
+		g_sink = outlen;
+	});
+}
+
+/*
+ * NZB
+ */
+static std::string make_nzb(unsigned long segments)
+{
+	static const unsigned long segments_per_file = 100;
+
+	Random rng(3);
+	std::string result =
+		"<?xml version=\"1.0\" encoding=\"iso-8859-1\" ?>\n"
+		"<!DOCTYPE nzb PUBLIC \"-//newzBin//DTD NZB 1.1//EN\" \"http://www.newzbin.com/DTD/nzb/nzb-1.1.dtd\">\n"
+		"<nzb xmlns=\"http://www.newzbin.com/DTD/2003/nzb\">\n";
+
+	char buf[512];
+	const unsigned long files = (segments + segments_per_file - 1) / segments_per_file;
+	for(unsigned long f = 0; f < files; ++f)
+	{
+		const unsigned long count = std::min(segments_per_file, segments - f * segments_per_file);
+		snprintf(buf, sizeof(buf),
+			"<file poster=\"poster@example.com (Poster)\" date=\"%lu\" "
+			"subject=\"[%lu/%lu] - &quot;Some.Release.Name.2016.1080p.BluRay.x264.part%03lu.rar&quot; yEnc (1/%lu)\">\n"
+			"<groups>\n<group>alt.binaries.example</group>\n<group>alt.binaries.test</group>\n</groups>\n<segments>\n",
+			1450000000UL + f, f + 1, files, f + 1, count);
+		result += buf;
+
+		for(unsigned long s = 0; s < count; ++s)
+		{
+			snprintf(buf, sizeof(buf), "<segment bytes=\"%u\" number=\"%lu\">%016llx%08x@news.example.com</segment>\n",
+				739000 + rng.below(2000), s + 1, (unsigned long long)rng.next(), (unsigned int)rng.next());
+			result += buf;
+		}
+		result += "</segments>\n</file>\n";
+	}
+	result += "</nzb>\n";
+	return result;
+}
+
+static void bench_nzb()
+{
+	for(unsigned long segments = 1000; segments <= g_options.max_segments; segments *= 10)
+	{
+		const std::string nzb = g_options.list ? std::string() : make_nzb(segments);
+		run("nzb/parse/" + std::to_string(segments) + "_segments", nzb.size(), segments, [&]()
+		{
+			g_sink = NZB::Parse::parse(nzb).getFileCount();
+		});
+	}
+}
+
+/*
+ * NntpClient line reading
+ */
+
+// a connection that reads the same article body over and over, in the reads
+// of up to the block buffer size that a socket gives a busy connection
+class BodyConnection : public NntpClient::Connection
+{
+public:
+
+	explicit BodyConnection(const std::string& body) : m_body(body), m_pos(0) {}
+
+protected:
+
+	int read(void *buf, size_t nbyte) throw(std::system_error) override
+	{
+		if(m_pos == m_body.size())
+			m_pos = 0;
+		const size_t len = std::min(nbyte, m_body.size() - m_pos);
+		memcpy(buf, &m_body[m_pos], len);
+		m_pos += len;
+		return len;
+	}
+
+	const std::string& m_body;
+	size_t m_pos;
+};
+
+static void bench_nntp()
+{
+	const std::string body = g_options.list ? std::string() : make_body(make_bytes(1024 * 1024, false));
+	const unsigned long lines = std::count(body.begin(), body.end(), '\n');
+
+	BodyConnection connection(body);
+	run("nntp/read_line/copy", body.size(), lines, [&]()
+	{
+		char line[1024];
+		unsigned long total = 0;
+		for(int len; 0 != (len = connection.read_line(line, sizeof(line))); )
+			total += len;
+		g_sink = total;
+	});
+	run("nntp/read_line/view", body.size(), lines, [&]()
+	{
+		NntpClient::LineView line;
+		unsigned long total = 0;
+		while(0 != connection.read_line(line))
+			total += line.len;
+		g_sink = total;
+	});
+	run("nntp/read_lines/batch", body.size(), lines, [&]()
+	{
+		NntpClient::LineView batch[64];
+		unsigned long total = 0;
+		for(bool is_end = false; !is_end; )
+		{
+			const size_t count = connection.read_lines(batch, 64, &is_end);
+			for(size_t i = 0; i < count; ++i)
+				total += batch[i].len;
+		}
+		g_sink = total;
+	});
+}
+
+/*
+ * BinPartsOracle
+ */
+static std::vector<std::string> make_subjects(unsigned long count)
+{
+	static const char *names[] = { "Some.Release.Name.2016.1080p.BluRay.x264", "another_show.s02e05.720p.hdtv", "Album Artist - Album Title (2015)", "ubuntu-16.04-desktop-amd64" };
+	static const char *exts[] = { ".part07.rar", ".r12", ".s03", ".rar", ".par2", ".vol015+16.par2", ".vol03+04.PAR2", ".nfo", ".sfv", ".nzb", ".zip", ".mkv", ".mp3", ".001", ".jpg", "" };
+
+	Random rng(4);
+	std::vector<std::string> result;
+	char buf[512];
+	for(unsigned long i = 0; i < count; ++i)
+	{
+		const unsigned int total = 1 + rng.below(150);
+		snprintf(buf, sizeof(buf), "[%u/%u] - \"%s%s\" yEnc (%u/%u)",
+			1 + rng.below(total), total, names[rng.below(4)], exts[rng.below(16)], 1 + rng.below(200), 200);
+		result.push_back(buf);
+	}
+	return result;
+}
+
+static void bench_binparts()
+{
+	const std::vector<std::string> subjects = make_subjects(1000);
+	unsigned long bytes = 0;
+	for(auto& subject : subjects)
+		bytes += subject.size();
+
+	NZB::BinPartsOracle oracle;
+	run("binparts/get_file_type", bytes, subjects.size(), [&]()
+	{
+		unsigned long total = 0;
+		for(auto& subject : subjects)
+			total += oracle.get_file_type(subject.c_str());
+		g_sink = total;
+	});
+	run("binparts/get_repair_block_count", bytes, subjects.size(), [&]()
+	{
+		unsigned long total = 0;
+		for(auto& subject : subjects)
+			total += oracle.get_repair_block_count(subject.c_str());
+		g_sink = total;
+	});
+}
+
+static void usage(const char *argv0)
+{
+	std::cerr << "usage: " << argv0 << " [options]\n"
+		"  --filter STR        run only the benchmarks with STR in their name\n"
+		"  --json FILE         also write the results to FILE as JSON\n"
+		"  --min-time SECS     minimum time of each sample (default 0.1)\n"
+		"  --samples N         samples per benchmark, the median is reported (default 5)\n"
+		"  --max-segments N    largest NZB to parse (default 1000000)\n"
+		"  --list              list the benchmarks and exit\n";
+}
+
+}	/* namespace */
+
+int main(int argc, char *argv[])
+{
+	for(int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = (i + 1) < argc;
+		if(("--filter" == arg) && has_value)
+			g_options.filter = argv[++i];
+		else if(("--json" == arg) && has_value)
+			g_options.json_path = argv[++i];
+		else if(("--min-time" == arg) && has_value)
+			g_options.min_time = atof(argv[++i]);
+		else if(("--samples" == arg) && has_value)
+			g_options.samples = std::max(1, atoi(argv[++i]));
+		else if(("--max-segments" == arg) && has_value)
+			g_options.max_segments = strtoul(argv[++i], nullptr, 10);
+		else if("--list" == arg)
+			g_options.list = true;
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	try
+	{
+		if(!g_options.list)
+			std::cout << "yEnc decode kernel: " << yEnc::Kernel::get_decode_kernel_name()
+				<< ", CRC32 kernel: " << Crc32Kernel::get_update_kernel_name() << std::endl;
+
+		bench_crc32();
+		bench_yenc("low_escapes", false);
+		bench_yenc("high_escapes", true);
+		bench_mime();
+		bench_nntp();
+		bench_nzb();
+		bench_binparts();
+
+		if(nullptr != g_options.json_path)
+			write_json(g_options.json_path);
+	}
+	catch(std::exception& e)
+	{
+		std::cerr << argv[0] << ": " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
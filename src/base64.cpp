@@ -0,0 +1,542 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include <libusenet/base64.h>
+#include "base64Kernels.h"
+#include <cctype>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#	define BASE64_KERNELS_X86
+#	include <immintrin.h>
+#endif
+
+using yEnc::DecodeResult;
+
+// the 6 bit value of each base64 char, 0xff for chars outside of the alphabet
+static const uint8_t scBase64Values[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+namespace Base64Kernel {
+
+static long decode_scalar(uint8_t *dst, const char *src, long len, long *p_used)
+{
+	const uint8_t *p_in = (const uint8_t*)src;
+	uint8_t *p_out = dst;
+
+	register long i = 0;
+	for(; (i + 4) <= len; i += 4)
+	{
+		register uint32_t a = scBase64Values[p_in[i]], b = scBase64Values[p_in[i + 1]];
+		register uint32_t c = scBase64Values[p_in[i + 2]], d = scBase64Values[p_in[i + 3]];
+		if(0 != ((a | b | c | d) & 0x80))
+			break;
+
+		register uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+		p_out[0] = (uint8_t)(bits >> 16);
+		p_out[1] = (uint8_t)(bits >> 8);
+		p_out[2] = (uint8_t)bits;
+		p_out += 3;
+	}
+
+	*p_used = i;
+	return p_out - dst;
+}
+
+#ifdef BASE64_KERNELS_X86
+
+/*
+ * The SIMD kernels translate the chars to their 6 bit values and check them
+ * with nibble lookup tables, then pack each four values into three bytes with
+ * multiply-adds and a shuffle.  A block holding any char outside of the
+ * alphabet is left to the scalar kernel.
+ */
+
+__attribute__((target("ssse3")))
+static inline bool translate_ssse3(__m128i *p_chars)
+{
+	const __m128i lut_lo = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+	__m128i chars = *p_chars;
+	__m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask_2f);
+	__m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(chars, mask_2f));
+	__m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+	if(0 != _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+		return false;
+
+	__m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(chars, mask_2f), hi_nibbles));
+	*p_chars = _mm_add_epi8(chars, roll);
+	return true;
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i pack_ssse3(__m128i values)
+{
+	__m128i merged = _mm_madd_epi16(_mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+static long decode_ssse3(uint8_t *dst, const char *src, long len, long *p_used)
+{
+	uint8_t *p_out = dst;
+
+	register long i = 0;
+	for(; (i + 16) <= len; i += 16)
+	{
+		__m128i chars = _mm_loadu_si128((const __m128i*)(src + i));
+		if(!translate_ssse3(&chars))
+			break;
+
+		__m128i packed = pack_ssse3(chars);
+		_mm_storel_epi64((__m128i*)p_out, packed);
+		uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+		memcpy(p_out + 8, &tail, 4);
+		p_out += 12;
+	}
+
+	long used;
+	p_out += decode_scalar(p_out, src + i, len - i, &used);
+	*p_used = i + used;
+	return p_out - dst;
+}
+
+__attribute__((target("avx2")))
+static long decode_avx2(uint8_t *dst, const char *src, long len, long *p_used)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i pack_shuffle = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+
+	uint8_t *p_out = dst;
+
+	register long i = 0;
+	for(; (i + 32) <= len; i += 32)
+	{
+		__m256i chars = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask_2f);
+		__m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(chars, mask_2f));
+		__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+		if(!_mm256_testz_si256(lo, hi))
+			break;
+
+		__m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(chars, mask_2f), hi_nibbles));
+		__m256i values = _mm256_add_epi8(chars, roll);
+
+		__m256i merged = _mm256_madd_epi16(
+			_mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+		__m256i packed = _mm256_shuffle_epi8(merged, pack_shuffle);
+
+		// 12 bytes in each 128 bit lane
+		__m128i hi_lane = _mm256_extracti128_si256(packed, 1);
+		_mm_storeu_si128((__m128i*)p_out, _mm256_castsi256_si128(packed));
+		_mm_storel_epi64((__m128i*)(p_out + 12), hi_lane);
+		uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(hi_lane, 8));
+		memcpy(p_out + 20, &tail, 4);
+		p_out += 24;
+	}
+
+	long used;
+	p_out += decode_scalar(p_out, src + i, len - i, &used);
+	*p_used = i + used;
+	return p_out - dst;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static long decode_avx512vbmi(uint8_t *dst, const char *src, long len, long *p_used)
+{
+	// the first 128 entries of the value table, the high bit of a char
+	// selects nothing in the two register permute and is checked apart
+	const __m512i lut_0 = _mm512_loadu_si512((const void*)&scBase64Values[0]);
+	const __m512i lut_1 = _mm512_loadu_si512((const void*)&scBase64Values[64]);
+
+	// the packed bytes of each 32 bit lane are in the low three, high first
+	alignas(64) static const uint8_t scPack[64] = {
+		 2,  1,  0,  6,  5,  4, 10,  9,  8, 14, 13, 12, 18, 17, 16, 22,
+		21, 20, 26, 25, 24, 30, 29, 28, 34, 33, 32, 38, 37, 36, 42, 41,
+		40, 46, 45, 44, 50, 49, 48, 54, 53, 52, 58, 57, 56, 62, 61, 60,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	};
+	const __m512i pack = _mm512_load_si512((const void*)scPack);
+
+	uint8_t *p_out = dst;
+
+	register long i = 0;
+	for(; (i + 64) <= len; i += 64)
+	{
+		__m512i chars = _mm512_loadu_si512((const void*)(src + i));
+		__m512i values = _mm512_permutex2var_epi8(lut_0, chars, lut_1);
+		if(0 != _mm512_movepi8_mask(_mm512_or_si512(values, chars)))
+			break;
+
+		__m512i merged = _mm512_madd_epi16(
+			_mm512_maddubs_epi16(values, _mm512_set1_epi32(0x01400140)), _mm512_set1_epi32(0x00011000));
+		_mm512_mask_storeu_epi8(p_out, 0xffffffffffffULL, _mm512_maskz_permutexvar_epi8(~0ULL, pack, merged));
+		p_out += 48;
+	}
+
+	long used;
+	p_out += decode_scalar(p_out, src + i, len - i, &used);
+	*p_used = i + used;
+	return p_out - dst;
+}
+
+#endif	/* BASE64_KERNELS_X86 */
+
+const DecodeKernel *get_decode_kernels()
+{
+	static const DecodeKernel *sKernels = []() -> const DecodeKernel*
+	{
+		static DecodeKernel kernels[] = {
+			{ "scalar", decode_scalar, true },
+#ifdef BASE64_KERNELS_X86
+			{ "ssse3", decode_ssse3, false },
+			{ "avx2", decode_avx2, false },
+			{ "avx512vbmi", decode_avx512vbmi, false },
+#endif
+			{ nullptr, nullptr, false },
+		};
+
+#ifdef BASE64_KERNELS_X86
+		__builtin_cpu_init();
+		kernels[1].is_supported = __builtin_cpu_supports("ssse3");
+		kernels[2].is_supported = __builtin_cpu_supports("avx2");
+		kernels[3].is_supported = __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi");
+#endif
+
+		return kernels;
+	}();
+
+	return sKernels;
+}
+
+static const DecodeKernel& get_selected_kernel()
+{
+	// the last supported kernel in the list is the fastest
+	static const DecodeKernel& sKernel = []() -> const DecodeKernel&
+	{
+		const DecodeKernel *p_best = get_decode_kernels();
+		for(const DecodeKernel *p = p_best; nullptr != p->name; ++p)
+		{
+			if(p->is_supported)
+				p_best = p;
+		}
+		return *p_best;
+	}();
+
+	return sKernel;
+}
+
+long decode(uint8_t *dst, const char *src, long len, long *p_used)
+{
+	return get_selected_kernel().decode(dst, src, len, p_used);
+}
+
+const char *get_decode_kernel_name()
+{
+	return get_selected_kernel().name;
+}
+
+}	/* namespace Base64Kernel */
+
+Base64Decoder::Base64Decoder()
+:	m_state(B64_START), m_line(0), m_name(""), m_content_type(""), m_transfer_encoding(""), m_decoded_size(0),
+	m_header(false), m_begin_base64(false), m_truncated(false),
+	m_quad(0), m_quad_len(0), m_padded(false), m_calc_crc32()
+{
+}
+
+Base64Decoder::~Base64Decoder()
+{
+}
+
+void Base64Decoder::reset()
+{
+	*this = Base64Decoder();
+}
+
+// get the value of a header parameter such as filename="a.bin", which is
+// quoted or ends at the next ';' or space
+static bool get_header_param(const std::string& line, const char *name, std::string *p_value)
+{
+	std::string lower(line);
+	for(auto& c : lower)
+		c = tolower((unsigned char)c);
+
+	const std::string key = std::string(name) + "=";
+	for(std::string::size_type pos = lower.find(key); std::string::npos != pos; pos = lower.find(key, pos + 1))
+	{
+		// the key has to start a parameter, so "name=" doesn't match "filename="
+		if((pos > 0) && (';' != lower[pos - 1]) && (' ' != lower[pos - 1]) && ('\t' != lower[pos - 1]))
+			continue;
+
+		std::string::size_type begin = pos + key.size(), end;
+		if((begin < line.size()) && ('"' == line[begin]))
+		{
+			end = line.find('"', ++begin);
+			if(std::string::npos == end)
+				end = line.size();
+		}
+		else
+			end = line.find_first_of("; \t", begin);
+
+		p_value->assign(line, begin, (std::string::npos == end) ? std::string::npos : (end - begin));
+		return true;
+	}
+
+	return false;
+}
+
+void Base64Decoder::decode_header_line(const char *encoded_line, int len)
+{
+	const std::string line(encoded_line, len);
+	if(0 == strncasecmp(encoded_line, "Content-Type:", 13))
+	{
+		std::string::size_type begin = line.find_first_not_of(" \t", 13);
+		std::string::size_type end = line.find_first_of("; \t", begin);
+		if(std::string::npos != begin)
+			m_content_type.assign(line, begin, (std::string::npos == end) ? std::string::npos : (end - begin));
+
+		// the filename of Content-Disposition takes precedence
+		if(m_name.empty())
+			get_header_param(line, "name", &m_name);
+	}
+	else if(0 == strncasecmp(encoded_line, "Content-Disposition:", 20))
+		get_header_param(line, "filename", &m_name);
+	else if(0 == strncasecmp(encoded_line, "Content-Transfer-Encoding:", 26))
+	{
+		std::string::size_type begin = line.find_first_not_of(" \t", 26);
+		if(std::string::npos != begin)
+			m_transfer_encoding.assign(line, begin, line.find_first_of(" \t;", begin) - begin);
+	}
+}
+
+bool Base64Decoder::decode_begin_line(const char *encoded_line, int len)
+{
+	// begin-base64 <mode> <name>
+	if((len < 16) || (0 != strncmp(encoded_line, "begin-base64 ", 13)))
+		return false;
+
+	const char *p_name = (const char*)memchr(encoded_line + 13, ' ', len - 13);
+	if((nullptr == p_name) || (++p_name >= (encoded_line + len)))
+		return false;
+
+	m_name.assign(p_name, (encoded_line + len) - p_name);
+	return true;
+}
+
+long Base64Decoder::decode_line(unsigned char *pBuf, const char *encoded_line, int len)
+{
+	const char *p_in = encoded_line, *p_end = encoded_line + len;
+	unsigned char *p_out = pBuf;
+
+	// whole groups of four chars go to the kernel, a group split between
+	// lines, the '=' padding and whitespace are handled a char at a time
+	while(p_in < p_end)
+	{
+		if((0 == m_quad_len) && !m_padded)
+		{
+			long used;
+			p_out += Base64Kernel::decode(p_out, p_in, p_end - p_in, &used);
+			p_in += used;
+			if(p_in == p_end)
+				break;
+		}
+
+		register uint8_t c = (uint8_t)*p_in++;
+		if(isspace(c))
+			continue;
+
+		if('=' == c)
+		{
+			if(!m_padded)
+			{
+				// "xx==" is one byte and "xxx=" is two
+				if(m_quad_len < 2)
+					return -1;
+				if(2 == m_quad_len)
+					p_out[0] = (uint8_t)(m_quad >> 4);
+				else
+				{
+					p_out[0] = (uint8_t)(m_quad >> 10);
+					p_out[1] = (uint8_t)(m_quad >> 2);
+				}
+				p_out += m_quad_len - 1;
+				m_quad_len = 0;
+				m_padded = true;
+			}
+			continue;
+		}
+
+		register uint8_t value = scBase64Values[c];
+		if((0x80 & value) || m_padded)
+			return -1;
+
+		m_quad = (m_quad << 6) | value;
+		if(4 == ++m_quad_len)
+		{
+			p_out[0] = (uint8_t)(m_quad >> 16);
+			p_out[1] = (uint8_t)(m_quad >> 8);
+			p_out[2] = (uint8_t)m_quad;
+			p_out += 3;
+			m_quad = 0;
+			m_quad_len = 0;
+		}
+	}
+
+	return p_out - pBuf;
+}
+
+DecodeResult Base64Decoder::decode(unsigned char **ppMem, const char *encoded_line, int len)
+{
+	if((0 == ppMem) || (0 == encoded_line))
+		return DecodeResult::YENC_NONE;
+
+	int declen = 0;
+	DecodeResult result = decode(*ppMem, &declen, encoded_line, len);
+	*ppMem += declen;
+	return result;
+}
+
+DecodeResult Base64Decoder::decode(unsigned char *pBuf, int *pLen, const char *encoded_line, int len)
+{
+	if((0 == pBuf) || (0 == encoded_line))
+		return DecodeResult::YENC_NONE;
+
+	// blank lines are significant here, so ignore a trailing CR or spaces
+	while((len > 0) && isspace((unsigned char)encoded_line[len - 1]))
+		--len;
+
+	const bool is_boundary = (len >= 2) && ('-' == encoded_line[0]) && ('-' == encoded_line[1]);
+
+	switch(m_state)
+	{
+	case B64_START:
+		if(decode_begin_line(encoded_line, len))
+		{
+			m_header = true;
+			m_begin_base64 = true;
+			m_state = B64_DATA;
+			return DecodeResult::YENC_NONE;
+		}
+		if((len > 0) && isalpha((unsigned char)encoded_line[0]) && (nullptr != memchr(encoded_line, ':', len)))
+		{
+			// the first header of a MIME part, headers can't be valid base64
+			// as ':' isn't in the alphabet
+			m_header = true;
+			m_state = B64_HEADERS;
+			m_name.clear();
+			m_content_type.clear();
+			m_transfer_encoding.clear();
+			decode_header_line(encoded_line, len);
+			return DecodeResult::YENC_NONE;
+		}
+		if((0 == len) || is_boundary)
+			return DecodeResult::YENC_NONE;
+
+		// data without any part headers
+		m_state = B64_DATA;
+		break;
+
+	case B64_HEADERS:
+		if(0 != len)
+			decode_header_line(encoded_line, len);
+		else if(0 == strncasecmp(m_content_type.c_str(), "multipart/", 10))
+		{
+			// the body is the preamble and the parts, each with its headers
+			m_state = B64_START;
+			m_content_type.clear();
+		}
+		else if(!m_transfer_encoding.empty() && (0 != strcasecmp(m_transfer_encoding.c_str(), "base64")))
+			m_state = B64_SKIP;
+		else
+			m_state = B64_DATA;
+		return DecodeResult::YENC_NONE;
+
+	case B64_SKIP:
+		// a part which isn't base64, such as the text of the message
+		if(is_boundary)
+			m_state = B64_START;
+		return DecodeResult::YENC_NONE;
+
+	case B64_DATA:
+		break;
+
+	case B64_END:
+		return DecodeResult::YENC_NONE;
+	}
+
+	// the end of the data
+	if(m_begin_base64 ? ((4 == len) && (0 == strncmp(encoded_line, "====", 4))) : ((0 == len) || is_boundary))
+	{
+		// blank lines can come before the data
+		if(!m_begin_base64 && (0 == len) && (0 == m_line))
+			return DecodeResult::YENC_NONE;
+
+		m_state = B64_END;
+		return DecodeResult::YENC_COMPLETE;
+	}
+
+	register long declen = decode_line(pBuf, encoded_line, len);
+	if(declen < 0)
+	{
+		m_truncated = true;
+		return DecodeResult::YENC_TRUNCATED;
+	}
+
+	*pLen += declen;
+	++m_line;
+	m_decoded_size += declen;
+
+	// update the working CRC
+	m_calc_crc32.update_crc(pBuf, declen);
+
+	return DecodeResult::YENC_DATA;
+}
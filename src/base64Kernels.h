@@ -0,0 +1,55 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __BASE64_KERNELS_HEADER__
+#define __BASE64_KERNELS_HEADER__
+
+#include <cstdint>
+
+namespace Base64Kernel {
+
+/*
+ * Decodes the leading groups of four base64 chars in 'src' to 'dst' and
+ * returns the number of bytes written, three for each group.  Decoding stops
+ * at the first group with a '=', whitespace or any other char outside of the
+ * alphabet, and '*p_used' is set to the number of chars decoded.
+ */
+typedef long (*decode_fn)(uint8_t *dst, const char *src, long len, long *p_used);
+
+struct DecodeKernel
+{
+	const char *name;
+	decode_fn decode;
+	bool is_supported;
+};
+
+// decode using the fastest kernel supported by this CPU, the kernel is
+// selected once, on first use, by checking the CPU features (cpuid)
+long decode(uint8_t *dst, const char *src, long len, long *p_used);
+
+// get the name of the kernel selected for 'decode'
+const char *get_decode_kernel_name();
+
+// get the list of all decode kernels built into the library, the scalar
+// reference kernel is always first and the list ends with a null name
+const DecodeKernel *get_decode_kernels();
+
+}	/* namespace Base64Kernel */
+
+#endif	/* __BASE64_KERNELS_HEADER__ */
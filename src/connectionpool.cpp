@@ -0,0 +1,267 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include <libusenet/connectionpool.h>
+
+#include <algorithm>
+
+// the default rate limit for new connections, after the initial burst, and
+// range of the back off after failing to connect
+#define POOL_CONNECT_RATE	1.0
+#define POOL_MIN_BACKOFF	1000
+#define POOL_MAX_BACKOFF	60000
+
+namespace NntpClient {
+
+void ConnectionPool::Lease::release()
+{
+	if(nullptr != m_pool)
+		m_pool->give_back(std::move(m_connection), true);
+	m_pool = nullptr;
+}
+
+void ConnectionPool::Lease::discard()
+{
+	if(nullptr != m_pool)
+		m_pool->give_back(std::move(m_connection), false);
+	m_pool = nullptr;
+}
+
+ConnectionPool::Lease& ConnectionPool::Lease::operator =(Lease&& that)
+{
+	if(this != &that)
+	{
+		release();
+		m_pool = that.m_pool;
+		m_connection = std::move(that.m_connection);
+		that.m_pool = nullptr;
+	}
+	return *this;
+}
+
+ConnectionPool::ConnectionPool(const ServerAddr& server, bool use_ssl/* = false*/)
+throw(std::runtime_error)
+:	ConnectionPool(server, Factory())
+{
+#ifdef LIBUSENET_USE_SSL
+	if(use_ssl)
+	{
+		m_factory = []() { return std::unique_ptr<Connection>(new SslConnection()); };
+		return;
+	}
+#else
+	if(use_ssl)
+		throw std::runtime_error("NntpClient::ConnectionPool: libusenet was built without SSL");
+#endif  /* LIBUSENET_USE_SSL */
+
+	m_factory = []() { return std::unique_ptr<Connection>(new Connection()); };
+}
+
+ConnectionPool::ConnectionPool(const ServerAddr& server, const Factory& factory)
+:	m_server(server), m_factory(factory), m_mutex(), m_returned(), m_idle(), m_open(0),
+	m_connect_rate(POOL_CONNECT_RATE), m_tokens(0), m_token_time(Clock::now()),
+	m_min_backoff(POOL_MIN_BACKOFF), m_max_backoff(POOL_MAX_BACKOFF), m_backoff(0), m_retry_time()
+{
+	m_tokens = get_max_connections();
+}
+
+ConnectionPool::~ConnectionPool()
+{
+	close_idle();
+}
+
+size_t ConnectionPool::get_max_connections() const
+{
+	return std::max(m_server.get_number_of_connections(), 1);
+}
+
+size_t ConnectionPool::get_open_count() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_open;
+}
+
+size_t ConnectionPool::get_idle_count() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_idle.size();
+}
+
+void ConnectionPool::set_connect_rate(double connect_rate)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_connect_rate = connect_rate;
+}
+
+void ConnectionPool::set_backoff(std::chrono::milliseconds min_backoff, std::chrono::milliseconds max_backoff)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_min_backoff = min_backoff;
+	m_max_backoff = std::max(min_backoff, max_backoff);
+	m_backoff = std::min(m_backoff, m_max_backoff);
+}
+
+ConnectionPool::Lease ConnectionPool::lease()
+throw(std::runtime_error)
+{
+	return acquire(true);
+}
+
+ConnectionPool::Lease ConnectionPool::try_lease()
+throw(std::runtime_error)
+{
+	return acquire(false);
+}
+
+void ConnectionPool::execute(const std::function<void(Connection&)>& fn, unsigned int retries/* = 1*/)
+throw(std::runtime_error)
+{
+	for(unsigned int attempt = 0; ; ++attempt)
+	{
+		Lease lease(acquire(true));
+		try
+		{
+			fn(*lease);
+			return;
+		}
+		catch(std::system_error&)
+		{
+			lease.discard();
+			if(attempt >= retries)
+				throw;
+		}
+	}
+}
+
+void ConnectionPool::close_idle()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_open -= m_idle.size();
+	m_idle.clear();
+	m_returned.notify_all();
+}
+
+ConnectionPool::Clock::time_point ConnectionPool::next_connect_time(Clock::time_point now) const
+{
+	if(m_connect_rate <= 0)
+		return m_retry_time;
+
+	// the time the bucket has a whole token, and not before the back off is over
+	const double tokens = std::min((double)get_max_connections(),
+		m_tokens + (std::chrono::duration<double>(now - m_token_time).count() * m_connect_rate));
+	Clock::time_point result = now;
+	if(tokens < 1)
+		result += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((1 - tokens) / m_connect_rate));
+
+	return std::max(result, m_retry_time);
+}
+
+ConnectionPool::Lease ConnectionPool::acquire(bool wait)
+throw(std::runtime_error)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for(;;)
+	{
+		// the most recently returned connection is the least likely to have been
+		// dropped by the server, the others are closed when they aren't idle
+		while(!m_idle.empty())
+		{
+			std::unique_ptr<Connection> connection(std::move(m_idle.back()));
+			m_idle.pop_back();
+			if(connection->is_idle())
+				return Lease(this, std::move(connection));
+			--m_open;
+		}
+
+		if(m_open < get_max_connections())
+		{
+			const Clock::time_point now = Clock::now();
+			const Clock::time_point next = next_connect_time(now);
+			if(next <= now)
+			{
+				// take a token, and count the connection as open while it's opened outside of the lock
+				if(m_connect_rate > 0)
+				{
+					m_tokens = std::min((double)get_max_connections(),
+						m_tokens + (std::chrono::duration<double>(now - m_token_time).count() * m_connect_rate)) - 1;
+					m_token_time = now;
+				}
+				++m_open;
+				break;
+			}
+
+			if(!wait)
+				return Lease();
+			m_returned.wait_until(lock, next);
+		}
+		else
+		{
+			if(!wait)
+				return Lease();
+			m_returned.wait(lock);
+		}
+	}
+	lock.unlock();
+
+	try
+	{
+		std::unique_ptr<Connection> connection(m_factory());
+		Response response;
+		connection->open(m_server, response);
+
+		lock.lock();
+		m_backoff = std::chrono::milliseconds(0);
+		m_retry_time = Clock::time_point();
+		lock.unlock();
+
+		return Lease(this, std::move(connection));
+	}
+	catch(...)
+	{
+		lock.lock();
+		--m_open;
+		m_backoff = (0 == m_backoff.count()) ? m_min_backoff : std::min(m_backoff * 2, m_max_backoff);
+		m_retry_time = Clock::now() + m_backoff;
+		lock.unlock();
+
+		m_returned.notify_one();
+		throw;
+	}
+}
+
+void ConnectionPool::give_back(std::unique_ptr<Connection>&& connection, bool is_reusable)
+{
+	// check the connection before taking the lock, it polls the socket
+	std::unique_ptr<Connection> returned(std::move(connection));
+	if(is_reusable && returned)
+		is_reusable = returned->is_idle();
+	if(!is_reusable)
+		returned.reset();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if(returned)
+			m_idle.push_back(std::move(returned));
+		else
+			--m_open;
+	}
+	m_returned.notify_one();
+}
+
+}	// namespace NntpClient
@@ -18,6 +18,23 @@
 	Boston, MA 02110-1301 USA.
 */
 #include <libusenet/crc32.h>
+#include "crc32Kernels.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#	define CRC32_KERNELS_X86
+#	include <immintrin.h>
+#endif
 
 static const uint32_t scCrc32Table[256] = {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba,
@@ -86,6 +103,283 @@ static const uint32_t scCrc32Table[256] = {
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
 };
 
+// scCrc32Table extended for slice-by-16, table n gives the CRC of a byte followed
+// by n zero bytes so 16 bytes can be looked up independently
+static uint32_t scCrc32Slices[16][256];
+
+static void init_slice_tables()
+{
+	memcpy(scCrc32Slices[0], scCrc32Table, sizeof(scCrc32Table));
+	for(int n = 0; n < 256; ++n)
+	{
+		for(int slice = 1; slice < 16; ++slice)
+		{
+			uint32_t crc = scCrc32Slices[slice - 1][n];
+			scCrc32Slices[slice][n] = (crc >> 8) ^ scCrc32Table[uint8_t(crc)];
+		}
+	}
+}
+
+namespace Crc32Kernel {
+
+/*
+ * The classic byte at a time loop, which is the reference for the other kernels
+ */
+static uint32_t update_table(uint32_t crc, const uint8_t *p_buf, unsigned long len)
+{
+	for(; len--; ++p_buf)
+		crc = (crc >> 8) ^ scCrc32Table[uint8_t(crc ^ *p_buf)];
+	return crc;
+}
+
+static inline uint32_t load_le32(const uint8_t *p_buf)
+{
+	uint32_t value;
+	memcpy(&value, p_buf, sizeof(value));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	value = __builtin_bswap32(value);
+#endif
+	return value;
+}
+
+static uint32_t update_slice16(uint32_t crc, const uint8_t *p_buf, unsigned long len)
+{
+	for(; len >= 16; len -= 16, p_buf += 16)
+	{
+		const uint32_t a = crc ^ load_le32(p_buf);
+		const uint32_t b = load_le32(p_buf + 4);
+		const uint32_t c = load_le32(p_buf + 8);
+		const uint32_t d = load_le32(p_buf + 12);
+
+		crc = scCrc32Slices[15][a & 0xff] ^ scCrc32Slices[14][(a >> 8) & 0xff]
+			^ scCrc32Slices[13][(a >> 16) & 0xff] ^ scCrc32Slices[12][a >> 24]
+			^ scCrc32Slices[11][b & 0xff] ^ scCrc32Slices[10][(b >> 8) & 0xff]
+			^ scCrc32Slices[9][(b >> 16) & 0xff] ^ scCrc32Slices[8][b >> 24]
+			^ scCrc32Slices[7][c & 0xff] ^ scCrc32Slices[6][(c >> 8) & 0xff]
+			^ scCrc32Slices[5][(c >> 16) & 0xff] ^ scCrc32Slices[4][c >> 24]
+			^ scCrc32Slices[3][d & 0xff] ^ scCrc32Slices[2][(d >> 8) & 0xff]
+			^ scCrc32Slices[1][(d >> 16) & 0xff] ^ scCrc32Slices[0][d >> 24];
+	}
+
+	if(len >= 8)
+	{
+		const uint32_t a = crc ^ load_le32(p_buf);
+		const uint32_t b = load_le32(p_buf + 4);
+
+		crc = scCrc32Slices[7][a & 0xff] ^ scCrc32Slices[6][(a >> 8) & 0xff]
+			^ scCrc32Slices[5][(a >> 16) & 0xff] ^ scCrc32Slices[4][a >> 24]
+			^ scCrc32Slices[3][b & 0xff] ^ scCrc32Slices[2][(b >> 8) & 0xff]
+			^ scCrc32Slices[1][(b >> 16) & 0xff] ^ scCrc32Slices[0][b >> 24];
+
+		len -= 8;
+		p_buf += 8;
+	}
+
+	return update_table(crc, p_buf, len);
+}
+
+#ifdef CRC32_KERNELS_X86
+
+/*
+ * Carry-less multiply folding, from Intel's "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction".  The fold constants are the bit
+ * reflected values of x^(D+32) mod P and x^(D-32) mod P, shifted left one bit,
+ * for a fold distance of D bits.
+ */
+static const uint64_t scFold2048[2] = { 0x011542778aULL, 0x01322d1430ULL };
+static const uint64_t scFold512[2] = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+static const uint64_t scFold128[2] = { 0x01751997d0ULL, 0x00ccaa009eULL };
+static const uint64_t scFold64[2] = { 0x0163cd6124ULL, 0 };
+
+// P(x) and the Barrett constant floor(x^64 / P(x)), bit reflected
+static const uint64_t scBarrett[2] = { 0x01db710641ULL, 0x01f7011641ULL };
+
+static inline __m128i fold_128(__m128i x, __m128i k, __m128i data)
+__attribute__((target("pclmul,sse4.1"), always_inline));
+
+static inline __m128i fold_128(__m128i x, __m128i k, __m128i data)
+{
+	return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), data);
+}
+
+/*
+ * Reduces four 128 bit fold accumulators and any remaining 16 byte blocks to the
+ * 32 bit CRC, '*p_len' is reduced by the number of bytes used from p_buf.
+ */
+static inline uint32_t reduce_128(__m128i x1, __m128i x2, __m128i x3, __m128i x4, const uint8_t *p_buf, unsigned long *p_len)
+__attribute__((target("pclmul,sse4.1"), always_inline));
+
+static inline uint32_t reduce_128(__m128i x1, __m128i x2, __m128i x3, __m128i x4, const uint8_t *p_buf, unsigned long *p_len)
+{
+	// fold into 128 bits
+	__m128i k = _mm_loadu_si128((const __m128i*)scFold128);
+	x1 = fold_128(x1, k, x2);
+	x1 = fold_128(x1, k, x3);
+	x1 = fold_128(x1, k, x4);
+
+	// single fold of 16 byte blocks
+	for(; *p_len >= 16; *p_len -= 16, p_buf += 16)
+		x1 = fold_128(x1, k, _mm_loadu_si128((const __m128i*)p_buf));
+
+	// fold 128 bits to 64 bits
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x2r = _mm_clmulepi64_si128(x1, k, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2r);
+
+	k = _mm_loadu_si128((const __m128i*)scFold64);
+	x2r = _mm_srli_si128(x1, 4);
+	x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00);
+	x1 = _mm_xor_si128(x1, x2r);
+
+	// Barrett reduction to 32 bits
+	k = _mm_loadu_si128((const __m128i*)scBarrett);
+	x2r = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+	x2r = _mm_clmulepi64_si128(_mm_and_si128(x2r, mask32), k, 0x00);
+	x1 = _mm_xor_si128(x1, x2r);
+
+	return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t update_pclmul(uint32_t crc, const uint8_t *p_buf, unsigned long len)
+__attribute__((target("pclmul,sse4.1")));
+
+static uint32_t update_pclmul(uint32_t crc, const uint8_t *p_buf, unsigned long len)
+{
+	if(len < 64)
+		return update_slice16(crc, p_buf, len);
+
+	__m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)p_buf), _mm_cvtsi32_si128(crc));
+	__m128i x2 = _mm_loadu_si128((const __m128i*)(p_buf + 16));
+	__m128i x3 = _mm_loadu_si128((const __m128i*)(p_buf + 32));
+	__m128i x4 = _mm_loadu_si128((const __m128i*)(p_buf + 48));
+	p_buf += 64;
+	len -= 64;
+
+	// parallel fold of 64 byte blocks
+	const __m128i k = _mm_loadu_si128((const __m128i*)scFold512);
+	for(; len >= 64; len -= 64, p_buf += 64)
+	{
+		x1 = fold_128(x1, k, _mm_loadu_si128((const __m128i*)p_buf));
+		x2 = fold_128(x2, k, _mm_loadu_si128((const __m128i*)(p_buf + 16)));
+		x3 = fold_128(x3, k, _mm_loadu_si128((const __m128i*)(p_buf + 32)));
+		x4 = fold_128(x4, k, _mm_loadu_si128((const __m128i*)(p_buf + 48)));
+	}
+
+	unsigned long rest = len;
+	crc = reduce_128(x1, x2, x3, x4, p_buf, &rest);
+	return update_slice16(crc, p_buf + (len - rest), rest);
+}
+
+static inline __m512i fold_512(__m512i x, __m512i k, __m512i data)
+__attribute__((target("avx512f,vpclmulqdq"), always_inline));
+
+static inline __m512i fold_512(__m512i x, __m512i k, __m512i data)
+{
+	return _mm512_ternarylogic_epi64(
+		_mm512_clmulepi64_epi128(x, k, 0x00), _mm512_clmulepi64_epi128(x, k, 0x11), data, 0x96);
+}
+
+static uint32_t update_vpclmul(uint32_t crc, const uint8_t *p_buf, unsigned long len)
+__attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.1")));
+
+static uint32_t update_vpclmul(uint32_t crc, const uint8_t *p_buf, unsigned long len)
+{
+	if(len < 256)
+		return update_pclmul(crc, p_buf, len);
+
+	// four 512 bit accumulators, which hold 16 of the 128 bit fold lanes
+	__m512i z1 = _mm512_xor_si512(_mm512_loadu_si512((const void*)p_buf), _mm512_castsi128_si512(_mm_cvtsi32_si128(crc)));
+	__m512i z2 = _mm512_loadu_si512((const void*)(p_buf + 64));
+	__m512i z3 = _mm512_loadu_si512((const void*)(p_buf + 128));
+	__m512i z4 = _mm512_loadu_si512((const void*)(p_buf + 192));
+	p_buf += 256;
+	len -= 256;
+
+	__m512i k = _mm512_maskz_broadcast_i32x4(0xffff, _mm_loadu_si128((const __m128i*)scFold2048));
+	for(; len >= 256; len -= 256, p_buf += 256)
+	{
+		z1 = fold_512(z1, k, _mm512_loadu_si512((const void*)p_buf));
+		z2 = fold_512(z2, k, _mm512_loadu_si512((const void*)(p_buf + 64)));
+		z3 = fold_512(z3, k, _mm512_loadu_si512((const void*)(p_buf + 128)));
+		z4 = fold_512(z4, k, _mm512_loadu_si512((const void*)(p_buf + 192)));
+	}
+
+	// fold the accumulators into one, then any remaining 64 byte blocks
+	k = _mm512_maskz_broadcast_i32x4(0xffff, _mm_loadu_si128((const __m128i*)scFold512));
+	z1 = fold_512(z1, k, z2);
+	z1 = fold_512(z1, k, z3);
+	z1 = fold_512(z1, k, z4);
+	for(; len >= 64; len -= 64, p_buf += 64)
+		z1 = fold_512(z1, k, _mm512_loadu_si512((const void*)p_buf));
+
+	unsigned long rest = len;
+	crc = reduce_128(
+		_mm512_maskz_extracti32x4_epi32(0xf, z1, 0), _mm512_maskz_extracti32x4_epi32(0xf, z1, 1),
+		_mm512_maskz_extracti32x4_epi32(0xf, z1, 2), _mm512_maskz_extracti32x4_epi32(0xf, z1, 3),
+		p_buf, &rest);
+	return update_slice16(crc, p_buf + (len - rest), rest);
+}
+
+#endif	/* CRC32_KERNELS_X86 */
+
+const UpdateKernel *get_update_kernels()
+{
+	static const UpdateKernel *sKernels = []() -> const UpdateKernel*
+	{
+		static UpdateKernel kernels[] = {
+			{ "table", update_table, true },
+			{ "slice16", update_slice16, true },
+#ifdef CRC32_KERNELS_X86
+			{ "pclmul", update_pclmul, false },
+			{ "vpclmul", update_vpclmul, false },
+#endif
+			{ nullptr, nullptr, false },
+		};
+
+		init_slice_tables();
+
+#ifdef CRC32_KERNELS_X86
+		__builtin_cpu_init();
+		kernels[2].is_supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+		kernels[3].is_supported = kernels[2].is_supported
+			&& __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq");
+#endif
+
+		return kernels;
+	}();
+
+	return sKernels;
+}
+
+static const UpdateKernel& get_selected_kernel()
+{
+	// the last supported kernel in the list is the fastest
+	static const UpdateKernel& sKernel = []() -> const UpdateKernel&
+	{
+		const UpdateKernel *p_best = get_update_kernels();
+		for(const UpdateKernel *p = p_best; nullptr != p->name; ++p)
+		{
+			if(p->is_supported)
+				p_best = p;
+		}
+		return *p_best;
+	}();
+
+	return sKernel;
+}
+
+uint32_t update(uint32_t crc, const uint8_t *p_buf, unsigned long len)
+{
+	return get_selected_kernel().update(crc, p_buf, len);
+}
+
+const char *get_update_kernel_name()
+{
+	return get_selected_kernel().name;
+}
+
+}	/* namespace Crc32Kernel */
+
 Crc32::Crc32()
 {
 	reset();
@@ -93,6 +387,254 @@ Crc32::Crc32()
 
 void Crc32::update_crc(const uint8_t *p_buf, unsigned int len)
 {
-	for(; len--; ++p_buf)
-		m_crc = (m_crc >> 8) ^ scCrc32Table[uint8_t(m_crc ^ *p_buf)];
+	m_crc = Crc32Kernel::update(m_crc, p_buf, len);
+}
+
+/*
+ * CRC combination, working with polynomials over GF(2) modulo P in the bit
+ * reflected form of the CRC.  This is the x^n mod P method used by zlib:
+ * CRC(A+B) = CRC(A) * x^(8 * len(B)) mod P xor CRC(B)
+ */
+#define CRC32_POLY		0xedb88320
+
+// a * b mod P
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = uint32_t(1) << 31, p = 0;
+	for(;;)
+	{
+		if(a & m)
+		{
+			p ^= b;
+			if(0 == (a & (m - 1)))
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? ((b >> 1) ^ CRC32_POLY) : (b >> 1);
+	}
+	return p;
+}
+
+// x^(2^n) mod P for n = 0..31
+static const uint32_t *crc32_x2n_table()
+{
+	static const uint32_t *sTable = []() -> const uint32_t*
+	{
+		static uint32_t table[32];
+		uint32_t p = uint32_t(1) << 30;		/* x^1 */
+		table[0] = p;
+		for(int n = 1; n < 32; ++n)
+			table[n] = p = crc32_multmodp(p, p);
+		return table;
+	}();
+
+	return sTable;
+}
+
+// x^(n * 2^k) mod P
+static uint32_t crc32_x2nmodp(unsigned long n, unsigned int k)
+{
+	const uint32_t *p_table = crc32_x2n_table();
+	uint32_t p = uint32_t(1) << 31;		/* x^0 */
+	for(; n; n >>= 1, ++k)
+	{
+		if(n & 1)
+			p = crc32_multmodp(p_table[k & 31], p);
+	}
+	return p;
+}
+
+uint32_t Crc32::combine(uint32_t crc_a, uint32_t crc_b, unsigned long len_b)
+{
+	return crc32_multmodp(crc32_x2nmodp(len_b, 3), crc_a) ^ crc_b;
+}
+
+void Crc32::combine(uint32_t crc, unsigned long len)
+{
+	m_crc = ~combine(get_value(), crc, len);
+}
+
+// pieces smaller than this are not worth a thread
+#define CRC32_MIN_THREAD_LEN	(1024 * 1024)
+
+static unsigned int crc32_thread_count(unsigned long len, unsigned int num_threads)
+{
+	if(0 == num_threads)
+		num_threads = std::max(1U, std::thread::hardware_concurrency());
+	return (unsigned int)std::max(1UL, std::min((unsigned long)num_threads, len / CRC32_MIN_THREAD_LEN));
+}
+
+// join the threads started so far when starting another one fails
+static void crc32_join(std::vector<std::thread>& threads)
+{
+	for(auto& thread : threads)
+	{
+		if(thread.joinable())
+			thread.join();
+	}
+}
+
+// closes the file on every way out of compute_file
+struct Crc32File
+{
+	explicit Crc32File(int fd) : fd(fd) {}
+	~Crc32File() { ::close(fd); }
+	int fd;
+};
+
+uint32_t Crc32::compute(const void *p_buf, unsigned long len, unsigned int num_threads/* = 0*/)
+{
+	const uint8_t *p_bytes = (const uint8_t*)p_buf;
+
+	num_threads = crc32_thread_count(len, num_threads);
+	if(1 == num_threads)
+		return ~Crc32Kernel::update(~uint32_t(0), p_bytes, len);
+
+	// each thread has an equal piece and the last one also has the remainder
+	const unsigned long piece_len = len / num_threads;
+	std::vector<uint32_t> crcs(num_threads);
+	std::vector<std::thread> threads;
+	try
+	{
+		for(unsigned int i = 0; i < num_threads; ++i)
+		{
+			const unsigned long piece = (i == (num_threads - 1)) ? (len - (i * piece_len)) : piece_len;
+			threads.emplace_back([&crcs, i, p_bytes, piece_len, piece]()
+			{
+				crcs[i] = ~Crc32Kernel::update(~uint32_t(0), p_bytes + (i * piece_len), piece);
+			});
+		}
+	}
+	catch(...)
+	{
+		crc32_join(threads);
+		throw;
+	}
+
+	uint32_t result = 0;
+	for(unsigned int i = 0; i < num_threads; ++i)
+	{
+		threads[i].join();
+		result = (0 == i) ? crcs[0] : combine(result, crcs[i], (i == (num_threads - 1)) ? (len - (i * piece_len)) : piece_len);
+	}
+
+	return result;
+}
+
+uint32_t Crc32::compute_file(const char *path, unsigned int num_threads/* = 0*/)
+throw(std::runtime_error)
+{
+	const int fd = ::open(path, O_RDONLY);
+	if(-1 == fd)
+		throw std::runtime_error(std::string("Cannot open file: ") + path);
+	Crc32File file(fd);
+
+	struct stat statbuf;
+	if(0 != fstat(fd, &statbuf))
+		throw std::runtime_error(strerror(errno));
+
+	const unsigned long len = statbuf.st_size;
+	num_threads = crc32_thread_count(len, num_threads);
+	const unsigned long piece_len = len / num_threads;
+
+	// each thread reads its piece with pread, so the file offset is not shared
+	std::vector<uint32_t> crcs(num_threads);
+	std::vector<int> errors(num_threads, 0);
+	auto crc_piece = [fd, &crcs, &errors](unsigned int i, unsigned long offset, unsigned long piece)
+	{
+		std::unique_ptr<uint8_t[]> buf(new uint8_t[CRC32_MIN_THREAD_LEN]);
+		uint32_t crc = ~uint32_t(0);
+		while(piece > 0)
+		{
+			ssize_t rdsz = pread(fd, buf.get(), std::min(piece, (unsigned long)CRC32_MIN_THREAD_LEN), offset);
+			if(rdsz <= 0)
+			{
+				if((-1 == rdsz) && (EINTR == errno))
+					continue;
+				errors[i] = (0 == rdsz) ? EIO : errno;
+				return;
+			}
+			crc = Crc32Kernel::update(crc, buf.get(), rdsz);
+			offset += rdsz;
+			piece -= rdsz;
+		}
+		crcs[i] = ~crc;
+	};
+
+	std::vector<std::thread> threads;
+	try
+	{
+		for(unsigned int i = 1; i < num_threads; ++i)
+		{
+			const unsigned long piece = (i == (num_threads - 1)) ? (len - (i * piece_len)) : piece_len;
+			threads.emplace_back(crc_piece, i, i * piece_len, piece);
+		}
+		crc_piece(0, 0, (1 == num_threads) ? len : piece_len);
+	}
+	catch(...)
+	{
+		crc32_join(threads);
+		throw;
+	}
+	crc32_join(threads);
+
+	uint32_t result = 0;
+	for(unsigned int i = 0; i < num_threads; ++i)
+	{
+		if(0 != errors[i])
+			throw std::runtime_error(strerror(errors[i]));
+		result = (0 == i) ? crcs[0] : combine(result, crcs[i], (i == (num_threads - 1)) ? (len - (i * piece_len)) : piece_len);
+	}
+
+	return result;
+}
+
+unsigned long Crc32Combiner::get_size() const
+{
+	auto it = m_pieces.find(0);
+	return (it == m_pieces.end()) ? 0 : it->second.len;
+}
+
+uint32_t Crc32Combiner::get_value() const
+{
+	auto it = m_pieces.find(0);
+	return (it == m_pieces.end()) ? 0 : it->second.crc;
+}
+
+bool Crc32Combiner::is_complete(unsigned long total_size) const
+{
+	return (1 == m_pieces.size()) && (get_size() == total_size);
+}
+
+bool Crc32Combiner::add(unsigned long offset, unsigned long len, uint32_t crc)
+{
+	if(0 == len)
+		return true;
+
+	// check for an overlap with the pieces before and after
+	auto next = m_pieces.lower_bound(offset);
+	if((next != m_pieces.end()) && (next->first < (offset + len)))
+		return false;
+	auto prev = (next == m_pieces.begin()) ? m_pieces.end() : std::prev(next);
+	if((prev != m_pieces.end()) && ((prev->first + prev->second.len) > offset))
+		return false;
+
+	// join the piece before, which keeps its offset as the key
+	if((prev != m_pieces.end()) && ((prev->first + prev->second.len) == offset))
+	{
+		prev->second.crc = Crc32::combine(prev->second.crc, crc, len);
+		prev->second.len += len;
+	}
+	else
+		prev = m_pieces.emplace_hint(next, offset, Piece{ len, crc });
+
+	// join the piece after
+	if((next != m_pieces.end()) && ((prev->first + prev->second.len) == next->first))
+	{
+		prev->second.crc = Crc32::combine(prev->second.crc, next->second.crc, next->second.len);
+		prev->second.len += next->second.len;
+		m_pieces.erase(next);
+	}
+
+	return true;
 }
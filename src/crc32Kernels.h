@@ -0,0 +1,53 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __CRC32_KERNELS_HEADER__
+#define __CRC32_KERNELS_HEADER__
+
+#include <cstdint>
+
+namespace Crc32Kernel {
+
+/*
+ * Updates the running (inverted) CRC value 'crc' with 'len' bytes from 'p_buf'
+ * and returns the new running value, as held in Crc32::m_crc.
+ */
+typedef uint32_t (*update_fn)(uint32_t crc, const uint8_t *p_buf, unsigned long len);
+
+struct UpdateKernel
+{
+	const char *name;
+	update_fn update;
+	bool is_supported;
+};
+
+// update using the fastest kernel supported by this CPU, the kernel is
+// selected once, on first use, by checking the CPU features (cpuid)
+uint32_t update(uint32_t crc, const uint8_t *p_buf, unsigned long len);
+
+// get the name of the kernel selected for 'update'
+const char *get_update_kernel_name();
+
+// get the list of all CRC kernels built into the library, the table kernel
+// is the reference and always first, the list ends with a null name
+const UpdateKernel *get_update_kernels();
+
+}	/* namespace Crc32Kernel */
+
+#endif	/* __CRC32_KERNELS_HEADER__ */
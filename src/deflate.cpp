@@ -0,0 +1,227 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include <libusenet/deflate.h>
+#include <libusenet/options.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef LIBUSENET_USE_ZLIB
+#	include <zlib.h>
+#endif
+
+// the size the compressed input buffer starts at
+#define DEFLATE_INPUT_SIZE	(64 * 1024)
+
+namespace NetStream {
+
+#ifdef LIBUSENET_USE_ZLIB
+
+struct Deflate::Streams
+{
+	z_stream in;
+	z_stream out;
+};
+
+static inline std::runtime_error __zlib_error(const char *what, const z_stream& stream)
+{
+	return std::runtime_error(std::string(what) + ": " + ((nullptr != stream.msg) ? stream.msg : "zlib error"));
+}
+
+Deflate::Deflate()
+throw(std::runtime_error)
+:	m_streams(new Streams), m_in(new char[DEFLATE_INPUT_SIZE]), m_in_size(DEFLATE_INPUT_SIZE), m_in_begin(0), m_in_end(0),
+	m_is_out_full(false), m_is_stalled(false), m_compressed_in(0), m_plain_in(0), m_compressed_out(0), m_plain_out(0)
+{
+	// RFC 8054 is raw deflate, without the zlib header, in both directions
+	memset(m_streams.get(), 0, sizeof(Streams));
+	if(Z_OK != inflateInit2(&m_streams->in, -MAX_WBITS))
+		throw __zlib_error("NetStream::Deflate: inflateInit2", m_streams->in);
+	if(Z_OK != deflateInit2(&m_streams->out, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY))
+	{
+		inflateEnd(&m_streams->in);
+		throw __zlib_error("NetStream::Deflate: deflateInit2", m_streams->out);
+	}
+}
+
+Deflate::~Deflate()
+{
+	inflateEnd(&m_streams->in);
+	deflateEnd(&m_streams->out);
+}
+
+bool Deflate::is_supported()
+{
+	return true;
+}
+
+bool Deflate::is_pending() const
+{
+	// input that is only part of a block can't be inflated until the rest is added
+	return(m_is_out_full || ((m_in_begin < m_in_end) && !m_is_stalled));
+}
+
+char *Deflate::get_input_space(size_t min_len, size_t *p_len)
+{
+	// move the input not yet inflated to the front, or grow the buffer to fit
+	if(m_in_begin > 0)
+	{
+		m_in_end -= m_in_begin;
+		if(m_in_end > 0)
+			memmove(m_in.get(), m_in.get() + m_in_begin, m_in_end);
+		m_in_begin = 0;
+	}
+
+	if((m_in_size - m_in_end) < min_len)
+	{
+		const size_t size = std::max(m_in_size * 2, m_in_end + min_len);
+		std::unique_ptr<char[]> in(new char[size]);
+		memcpy(in.get(), m_in.get(), m_in_end);
+		m_in.swap(in);
+		m_in_size = size;
+	}
+
+	*p_len = m_in_size - m_in_end;
+	return m_in.get() + m_in_end;
+}
+
+void Deflate::commit_input(size_t len)
+{
+	m_in_end += len;
+	m_compressed_in += len;
+	m_is_stalled = false;
+}
+
+void Deflate::put(const void *buf, size_t len)
+{
+	size_t space;
+	memcpy(get_input_space(len, &space), buf, len);
+	commit_input(len);
+}
+
+size_t Deflate::inflate(void *buf, size_t len)
+throw(std::runtime_error)
+{
+	z_stream& stream = m_streams->in;
+	stream.next_in = (Bytef*)(m_in.get() + m_in_begin);
+	stream.avail_in = m_in_end - m_in_begin;
+	stream.next_out = (Bytef*)buf;
+	stream.avail_out = len;
+
+	// Z_BUF_ERROR is only that no progress could be made without more input
+	const int result = ::inflate(&stream, Z_SYNC_FLUSH);
+	if((Z_OK != result) && (Z_BUF_ERROR != result) && (Z_STREAM_END != result))
+		throw __zlib_error("NetStream::Deflate: inflate", stream);
+
+	m_in_begin = m_in_end - stream.avail_in;
+	if(m_in_begin == m_in_end)
+		m_in_begin = m_in_end = 0;
+
+	// a full output buffer may have left output held by zlib
+	const size_t plain = len - stream.avail_out;
+	m_is_out_full = (0 == stream.avail_out);
+	m_is_stalled = (0 == plain);
+	m_plain_in += plain;
+	return plain;
+}
+
+void Deflate::deflate(const void *buf, size_t len, std::string& out)
+throw(std::runtime_error)
+{
+	z_stream& stream = m_streams->out;
+	stream.next_in = (Bytef*)buf;
+	stream.avail_in = len;
+
+	// the sync flush ends on a byte boundary, so the peer can inflate it all now
+	const size_t begin = out.size();
+	do
+	{
+		const size_t bound = deflateBound(&stream, stream.avail_in) + 16;
+		const size_t used = out.size();
+		out.resize(used + bound);
+		stream.next_out = (Bytef*)&out[used];
+		stream.avail_out = bound;
+
+		const int result = ::deflate(&stream, Z_SYNC_FLUSH);
+		if((Z_OK != result) && (Z_BUF_ERROR != result))
+			throw __zlib_error("NetStream::Deflate: deflate", stream);
+		out.resize(used + (bound - stream.avail_out));
+	} while((0 != stream.avail_in) || (0 == stream.avail_out));
+
+	m_plain_out += len;
+	m_compressed_out += out.size() - begin;
+}
+
+#else
+
+struct Deflate::Streams
+{
+};
+
+Deflate::Deflate()
+throw(std::runtime_error)
+:	m_in_size(0), m_in_begin(0), m_in_end(0), m_is_out_full(false), m_is_stalled(false),
+	m_compressed_in(0), m_plain_in(0), m_compressed_out(0), m_plain_out(0)
+{
+	throw std::runtime_error("NetStream::Deflate: built without zlib");
+}
+
+Deflate::~Deflate()
+{
+}
+
+bool Deflate::is_supported()
+{
+	return false;
+}
+
+bool Deflate::is_pending() const
+{
+	return false;
+}
+
+char *Deflate::get_input_space(size_t min_len, size_t *p_len)
+{
+	*p_len = 0;
+	return nullptr;
+}
+
+void Deflate::commit_input(size_t len)
+{
+}
+
+void Deflate::put(const void *buf, size_t len)
+{
+}
+
+size_t Deflate::inflate(void *buf, size_t len)
+throw(std::runtime_error)
+{
+	return 0;
+}
+
+void Deflate::deflate(const void *buf, size_t len, std::string& out)
+throw(std::runtime_error)
+{
+}
+
+#endif	/* LIBUSENET_USE_ZLIB */
+
+}	/* namespace NetStream */
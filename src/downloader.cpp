@@ -0,0 +1,579 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include <libusenet/downloader.h>
+#include <libusenet/yenc.h>
+#include "ioUring.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+
+// the defaults for the segments in a request and the body data waiting to be decoded
+#define DOWNLOAD_BATCH_SIZE		16
+#define DOWNLOAD_MAX_QUEUED		(256UL * 1024 * 1024)
+
+// the most writes in flight on the io_uring writer's ring
+#define DOWNLOAD_URING_ENTRIES	64
+
+namespace NntpClient {
+
+Downloader::Downloader(ServerGroup& servers, const std::string& output_dir)
+:	m_servers(servers), m_output_dir(output_dir), m_fetch_threads(0), m_decode_threads(0),
+	m_batch_size(DOWNLOAD_BATCH_SIZE), m_max_queued_bytes(DOWNLOAD_MAX_QUEUED),
+	m_p_files(nullptr), m_on_file(), m_segments(), m_next_segment(0), m_states(), m_report_mutex(),
+	m_queue_mutex(), m_queue_ready(), m_queue_room(), m_queue(), m_queued_bytes(0), m_fetch_done(false),
+	m_is_queued_writes(false), m_write_mutex(), m_write_ready(), m_write_room(), m_writes(), m_write_bytes(0),
+	m_decode_done(false), m_cancel(false), m_error(), m_segments_done(0), m_bytes_received(0), m_bytes_written(0)
+{
+	if(m_output_dir.empty())
+		m_output_dir = ".";
+}
+
+Downloader::Progress Downloader::get_progress() const
+{
+	return Progress{ m_segments.size(), m_segments_done, m_bytes_received, m_bytes_written };
+}
+
+std::vector<Downloader::FileResult> Downloader::download(const NZB::FileCollection& files, const FileHandler& on_file/* = FileHandler()*/)
+throw(std::runtime_error)
+{
+	m_p_files = &files;
+	m_on_file = on_file;
+	m_segments.clear();
+	m_next_segment = 0;
+	m_queue.clear();
+	m_queued_bytes = 0;
+	m_fetch_done = false;
+	m_writes.clear();
+	m_write_bytes = 0;
+	m_decode_done = false;
+	m_cancel = false;
+	m_error = nullptr;
+	m_segments_done = m_bytes_received = m_bytes_written = 0;
+
+	// the segments are fetched in the order of the files, and the segments of each file
+	const int file_count = files.getFileCount();
+	m_states.reset(new FileState[file_count]);
+	for(int i = 0; i < file_count; ++i)
+	{
+		const NZB::File& file = files[i];
+		FileState& state = m_states[i];
+		state.fd = -1;
+		state.done = 0;
+		state.is_file_crc = false;
+		state.file_crc = 0;
+		state.result = FileResult{ i, std::string(), std::string(), 0, file.getSegmentCount(), 0, 0, false };
+
+		for(int j = 0; j < file.getSegmentCount(); ++j)
+			m_segments.push_back(SegmentRef{ i, j });
+	}
+
+	// a fetch thread for each connection of the first tier, the rest are only used for failover
+	unsigned int fetch_threads = m_fetch_threads;
+	if(0 == fetch_threads)
+	{
+		int first_tier = INT_MAX;
+		for(size_t i = 0; i < m_servers.get_server_count(); ++i)
+			first_tier = std::min(first_tier, m_servers.get_tier(i));
+		for(size_t i = 0; i < m_servers.get_server_count(); ++i)
+		{
+			if(first_tier == m_servers.get_tier(i))
+				fetch_threads += m_servers.get_pool(i).get_max_connections();
+		}
+	}
+	const size_t batches = (m_segments.size() + m_batch_size - 1) / m_batch_size;
+	fetch_threads = std::max(1U, (unsigned int)std::min((size_t)fetch_threads, batches));
+
+	unsigned int decode_threads = m_decode_threads;
+	if(0 == decode_threads)
+		decode_threads = std::max(1U, std::thread::hardware_concurrency());
+
+	// files without any segments are done now
+	for(int i = 0; i < file_count; ++i)
+	{
+		if(0 == m_states[i].result.segments)
+			finish_file(i);
+	}
+
+	auto run = [this](void (Downloader::*work)())
+	{
+		try
+		{
+			(this->*work)();
+		}
+		catch(...)
+		{
+			fail(std::current_exception());
+		}
+	};
+
+	// the decoded parts go to a writer thread when there's a ring for it
+	std::thread writer;
+#ifdef LIBUSENET_USE_IO_URING
+	std::unique_ptr<Uring::Ring> p_ring;
+	try
+	{
+		p_ring.reset(new Uring::Ring(DOWNLOAD_URING_ENTRIES));
+	}
+	catch(std::system_error&)
+	{
+	}
+	m_is_queued_writes = (nullptr != p_ring);
+	if(m_is_queued_writes)
+	{
+		writer = std::thread([&]()
+		{
+			try
+			{
+				write_parts(*p_ring);
+			}
+			catch(...)
+			{
+				fail(std::current_exception());
+			}
+		});
+	}
+#endif
+
+	std::vector<std::thread> decoders, fetchers;
+	for(unsigned int i = 0; i < decode_threads; ++i)
+		decoders.emplace_back(run, &Downloader::decode);
+	if(!m_segments.empty())
+	{
+		for(unsigned int i = 0; i < fetch_threads; ++i)
+			fetchers.emplace_back(run, &Downloader::fetch);
+	}
+	for(auto& thread : fetchers)
+		thread.join();
+
+	// the decoders finish the queue and stop
+	{
+		std::lock_guard<std::mutex> lock(m_queue_mutex);
+		m_fetch_done = true;
+	}
+	m_queue_ready.notify_all();
+	for(auto& thread : decoders)
+		thread.join();
+
+	// and then the writer finishes the writes
+	if(writer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_write_mutex);
+			m_decode_done = true;
+		}
+		m_write_ready.notify_all();
+		writer.join();
+	}
+
+	// the files left open by a cancel or an error
+	std::vector<FileResult> results;
+	results.reserve(file_count);
+	for(int i = 0; i < file_count; ++i)
+	{
+		if(m_states[i].fd >= 0)
+			::close(m_states[i].fd);
+		results.push_back(m_states[i].result);
+	}
+	m_states.reset();
+	m_p_files = nullptr;
+
+	if(m_error)
+		std::rethrow_exception(m_error);
+
+	return results;
+}
+
+void Downloader::fail(std::exception_ptr error)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queue_mutex);
+		if(!m_error)
+			m_error = error;
+		m_cancel = true;
+	}
+	m_queue_ready.notify_all();
+	m_queue_room.notify_all();
+
+	{
+		std::lock_guard<std::mutex> lock(m_write_mutex);
+	}
+	m_write_ready.notify_all();
+	m_write_room.notify_all();
+}
+
+void Downloader::fetch()
+throw(std::runtime_error)
+{
+	std::vector<std::string> message_ids;
+	message_ids.reserve(m_batch_size);
+
+	while(!m_cancel)
+	{
+		const size_t first = m_next_segment.fetch_add(m_batch_size);
+		if(first >= m_segments.size())
+			break;
+		const size_t last = std::min(first + m_batch_size, m_segments.size());
+
+		message_ids.clear();
+		for(size_t i = first; i < last; ++i)
+			message_ids.push_back((*m_p_files)[m_segments[i].file].getSegment(m_segments[i].segment).getMessageId());
+		std::vector<bool> is_queued(last - first, false);
+
+		auto results = m_servers.body(message_ids, [&](const ServerGroup::SegmentResult& result, Connection& connection)
+		{
+			const SegmentRef& ref = m_segments[first + result.index];
+			const long byte_count = (*m_p_files)[ref.file].getSegment(ref.segment).getByteCount();
+
+			// the lines have the NNTP dot-stuffing removed, and the decoder splits them again
+			DecodeJob job{ ref.file, std::string() };
+			job.body.reserve(std::max(byte_count, 0L) + 4096);
+			LineView line;
+			while(0 != connection.read_line(line))
+				job.body.append(line.p_line, line.len);
+			m_bytes_received += job.body.size();
+
+			// wait for the decoders when they're behind, the first job always fits
+			std::unique_lock<std::mutex> lock(m_queue_mutex);
+			m_queue_room.wait(lock, [&]()
+				{ return m_cancel || (0 == m_queued_bytes) || ((m_queued_bytes + job.body.size()) <= m_max_queued_bytes); });
+			if(m_cancel)
+				return;
+			m_queued_bytes += job.body.size();
+			m_queue.push_back(std::move(job));
+			lock.unlock();
+			m_queue_ready.notify_one();
+			is_queued[result.index] = true;
+		});
+
+		// a segment found but not read, when the connection failed in its body,
+		// is as missing as one that wasn't found
+		for(auto& result : results)
+		{
+			if(!is_queued[result.index])
+				segment_done(m_segments[first + result.index].file, true, false, 0);
+		}
+	}
+}
+
+void Downloader::decode()
+throw(std::runtime_error)
+{
+	for(;;)
+	{
+		DecodeJob job;
+		{
+			std::unique_lock<std::mutex> lock(m_queue_mutex);
+			m_queue_ready.wait(lock, [this]() { return m_cancel || m_fetch_done || !m_queue.empty(); });
+			if(m_cancel || m_queue.empty())
+				return;
+
+			job = std::move(m_queue.front());
+			m_queue.pop_front();
+			m_queued_bytes -= job.body.size();
+		}
+		m_queue_room.notify_all();
+
+		decode_job(job);
+	}
+}
+
+void Downloader::decode_job(DecodeJob& job)
+throw(std::runtime_error)
+{
+	// decode each line of the body, which has the line endings kept
+	yEnc::Decoder decoder;
+	std::unique_ptr<unsigned char[]> data(new unsigned char[job.body.size() + 1]);
+	int len = 0;
+	const char *p_line = job.body.data();
+	const char *p_end = p_line + job.body.size();
+	while(p_line < p_end)
+	{
+		const char *p_nl = (const char*)memchr(p_line, '\n', p_end - p_line);
+		const char *p_next = (nullptr != p_nl) ? (p_nl + 1) : p_end;
+		const char *p_eol = (nullptr != p_nl) ? p_nl : p_end;
+		if((p_eol > p_line) && ('\r' == p_eol[-1]))
+			--p_eol;
+
+		decoder.decode(data.get() + len, &len, p_line, p_eol - p_line);
+		p_line = p_next;
+	}
+
+	// without a =ybegin line there is nothing to place in a file
+	if(!decoder.is_header())
+	{
+		segment_done(job.file, false, true, 0);
+		return;
+	}
+
+	const bool is_damaged = !decoder.is_trailer() || !decoder.is_consistent() || !decoder.get_damage().empty();
+	const unsigned long offset = decoder.is_part() ? (decoder.get_part_begin() - 1) : 0;
+
+	FileState& state = m_states[job.file];
+	int fd;
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if(state.fd < 0)
+		{
+			open_file(state, decoder.get_file_name());
+			state.result.size = decoder.get_header_size();
+		}
+		fd = state.fd;
+
+		// crc32= is the CRC of the whole file
+		if(decoder.is_crc32() && !state.is_file_crc)
+		{
+			state.is_file_crc = true;
+			state.file_crc = decoder.get_crc32();
+		}
+
+		// a damaged part is still written, a repair only has to fix its damage
+		if(!is_damaged)
+			decoder.add_part_crc(state.crc);
+	}
+
+	if(m_is_queued_writes && (0 != len))
+	{
+		queue_write(WriteJob{ job.file, fd, offset, std::move(data), (unsigned long)len, 0, is_damaged });
+		return;
+	}
+
+	// the file stays open until its last segment is done, which is after this one
+	for(unsigned long written = 0; written < (unsigned long)len; )
+	{
+		ssize_t result = pwrite(fd, data.get() + written, len - written, offset + written);
+		if(-1 == result)
+		{
+			if(EINTR == errno)
+				continue;
+			throw std::system_error(std::error_code(errno, std::system_category()), state.result.path);
+		}
+		written += result;
+	}
+
+	segment_done(job.file, false, is_damaged, len);
+}
+
+void Downloader::queue_write(WriteJob&& job)
+{
+	// wait for the writer when it's behind, the first part always fits
+	std::unique_lock<std::mutex> lock(m_write_mutex);
+	m_write_room.wait(lock, [&]()
+		{ return m_cancel || (0 == m_write_bytes) || ((m_write_bytes + job.len) <= m_max_queued_bytes); });
+	if(m_cancel)
+		return;
+	m_write_bytes += job.len;
+	m_writes.push_back(std::move(job));
+	lock.unlock();
+	m_write_ready.notify_one();
+}
+
+#ifdef LIBUSENET_USE_IO_URING
+
+void Downloader::write_parts(Uring::Ring& ring)
+throw(std::runtime_error)
+{
+	// the writes in flight by their user data, and those to submit again
+	std::unordered_map<uint64_t, WriteJob> in_flight;
+	std::vector<WriteJob> batch;
+	uint64_t next_key = 0;
+
+	auto complete = [&](bool is_draining)
+	{
+		io_uring_cqe *p_cqe;
+		while(nullptr != (p_cqe = ring.peek_cqe()))
+		{
+			auto it = in_flight.find(p_cqe->user_data);
+			const int res = p_cqe->res;
+			ring.cqe_seen();
+			if(in_flight.end() == it)
+				continue;
+
+			if(is_draining)
+			{
+				in_flight.erase(it);
+				continue;
+			}
+
+			// a short write breaks its link and the rest of the chain is cancelled,
+			// both are written again from where they got to
+			WriteJob& job = it->second;
+			if(res > 0)
+				job.written += res;
+			else if((-ECANCELED != res) && (-EINTR != res) && (-EAGAIN != res))
+			{
+				const int error = (0 == res) ? EIO : -res;
+				throw std::system_error(std::error_code(error, std::system_category()), m_states[job.file].result.path);
+			}
+
+			if(job.written < job.len)
+				batch.push_back(std::move(job));
+			else
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_write_mutex);
+					m_write_bytes -= job.len;
+				}
+				m_write_room.notify_all();
+				segment_done(job.file, false, job.is_damaged, job.len);
+			}
+			in_flight.erase(it);
+		}
+	};
+
+	try
+	{
+		for(;;)
+		{
+			// wait for parts only when nothing is in flight
+			{
+				std::unique_lock<std::mutex> lock(m_write_mutex);
+				if(in_flight.empty() && batch.empty())
+					m_write_ready.wait(lock, [this]() { return m_cancel || m_decode_done || !m_writes.empty(); });
+				if(m_cancel)
+					break;
+				if(in_flight.empty() && batch.empty() && m_writes.empty())
+					break;
+
+				while(!m_writes.empty() && ((in_flight.size() + batch.size()) < DOWNLOAD_URING_ENTRIES))
+				{
+					batch.push_back(std::move(m_writes.front()));
+					m_writes.pop_front();
+				}
+			}
+
+			// each file's writes in order of their offsets, linked so they're written in that order
+			std::sort(batch.begin(), batch.end(), [](const WriteJob& a, const WriteJob& b)
+				{ return (a.fd < b.fd) || ((a.fd == b.fd) && (a.offset < b.offset)); });
+			for(size_t i = 0; i < batch.size(); ++i)
+			{
+				WriteJob& job = batch[i];
+				io_uring_sqe *p_sqe = ring.get_sqe();
+				p_sqe->opcode = IORING_OP_WRITE;
+				p_sqe->fd = job.fd;
+				p_sqe->addr = (uint64_t)(uintptr_t)(job.data.get() + job.written);
+				p_sqe->len = job.len - job.written;
+				p_sqe->off = job.offset + job.written;
+				if(((i + 1) < batch.size()) && (batch[i + 1].fd == job.fd))
+					p_sqe->flags = IOSQE_IO_LINK;
+				p_sqe->user_data = next_key;
+				in_flight.emplace(next_key++, std::move(job));
+			}
+			batch.clear();
+
+			ring.submit(1);
+			complete(false);
+		}
+	}
+	catch(...)
+	{
+		// the buffers can't be freed while the kernel is writing them
+		while(!in_flight.empty())
+		{
+			ring.submit(1);
+			complete(true);
+		}
+		throw;
+	}
+
+	while(!in_flight.empty())
+	{
+		ring.submit(1);
+		complete(true);
+	}
+}
+
+#else
+
+void Downloader::write_parts(Uring::Ring& ring)
+throw(std::runtime_error)
+{
+}
+
+#endif	/* LIBUSENET_USE_IO_URING */
+
+void Downloader::open_file(FileState& state, const std::string& name)
+throw(std::runtime_error)
+{
+	// only the last path component of the name is used
+	std::string file_name(name.substr(name.find_last_of("/\\") + 1));
+	if(file_name.empty() || ("." == file_name) || (".." == file_name))
+		file_name = "file." + std::to_string(state.result.file);
+
+	state.result.name = name;
+	state.result.path = m_output_dir + '/' + file_name;
+	state.fd = ::open(state.result.path.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+	if(-1 == state.fd)
+		throw std::system_error(std::error_code(errno, std::system_category()), state.result.path);
+}
+
+void Downloader::segment_done(int file, bool is_missing, bool is_damaged, unsigned long written)
+{
+	FileState& state = m_states[file];
+	bool is_done;
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if(is_missing)
+			++state.result.missing;
+		if(is_damaged)
+			++state.result.damaged;
+		is_done = (++state.done == state.result.segments);
+	}
+
+	++m_segments_done;
+	m_bytes_written += written;
+
+	if(is_done)
+		finish_file(file);
+}
+
+void Downloader::finish_file(int file)
+{
+	FileState& state = m_states[file];
+	FileResult result;
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+
+		// a missing part at the end would leave the file short
+		if(state.fd >= 0)
+		{
+			if(0 != state.result.size)
+				(void)ftruncate(state.fd, state.result.size);
+			::close(state.fd);
+			state.fd = -1;
+		}
+
+		state.result.is_crc_ok = (0 != state.result.size) && state.crc.is_complete(state.result.size)
+			&& (!state.is_file_crc || (state.crc.get_value() == state.file_crc));
+		result = state.result;
+	}
+
+	if(m_on_file)
+	{
+		std::lock_guard<std::mutex> lock(m_report_mutex);
+		m_on_file(result);
+	}
+}
+
+}	// namespace NntpClient
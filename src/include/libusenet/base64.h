@@ -0,0 +1,102 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __BASE64_HEADER__
+#define __BASE64_HEADER__
+
+#include <string>
+#include <libusenet/yenc.h>
+
+/*
+ * Line by line decoder for MIME base64 attachments, with the same conventions
+ * as yEnc::Decoder.  The part headers (Content-Type, Content-Disposition) give
+ * the file name and the data lines which follow the blank line are decoded to
+ * the caller's buffer until a blank line or a MIME boundary completes the file.
+ * The parts of a multipart message which aren't base64 are skipped, and the
+ * "begin-base64" / "====" framing of uuencode -m is also understood.
+ */
+class Base64Decoder
+{
+// construction
+public:
+
+	Base64Decoder();
+	Base64Decoder(const Base64Decoder&) = default;
+	Base64Decoder(Base64Decoder&&) = default;
+	virtual ~Base64Decoder();
+
+// attributes
+public:
+
+	unsigned int get_lines() const { return m_line; }
+
+	const std::string& get_file_name() const { return m_name; }
+	const std::string& get_content_type() const { return m_content_type; }
+
+	unsigned long get_decoded_size() const { return m_decoded_size; }
+	unsigned int get_actual_crc32() const { return m_calc_crc32.get_value(); }
+
+// operations
+public:
+
+	bool is_header() const { return m_header; }
+	bool is_trailer() const { return B64_END == m_state; }
+
+	// true if a data line held a char outside of the base64 alphabet or
+	// data after the '=' padding
+	bool is_truncated() const { return m_truncated; }
+
+	void reset();
+
+	// pBuf needs room for (len * 3) / 4 + 3 bytes
+	yEnc::DecodeResult decode(unsigned char **ppMem, const char *encoded_line, int len);
+	yEnc::DecodeResult decode(unsigned char *pBuf, int *pLen, const char *encoded_line, int len);
+
+	Base64Decoder& operator =(const Base64Decoder&) = default;
+	Base64Decoder& operator =(Base64Decoder&&) = default;
+
+// implementation
+protected:
+
+	void decode_header_line(const char *encoded_line, int len);
+	bool decode_begin_line(const char *encoded_line, int len);
+	long decode_line(unsigned char *pBuf, const char *encoded_line, int len);
+
+	enum State { B64_START, B64_HEADERS, B64_SKIP, B64_DATA, B64_END, };
+	State m_state;
+
+	unsigned int m_line;
+	std::string m_name;
+	std::string m_content_type;
+	std::string m_transfer_encoding;
+	unsigned long m_decoded_size;
+
+	bool m_header;
+	bool m_begin_base64;
+	bool m_truncated;
+
+	// a group of four chars split between lines, and the '=' padding
+	uint32_t m_quad;
+	int m_quad_len;
+	bool m_padded;
+
+	Crc32 m_calc_crc32;
+};
+
+#endif	/* __BASE64_HEADER__ */
@@ -0,0 +1,158 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __NNTP_CONNECTION_POOL_HEADER__
+#define __NNTP_CONNECTION_POOL_HEADER__
+
+#include <libusenet/nntpclient.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace NntpClient {
+
+/*
+ * A thread-safe pool of up to ServerAddr::get_number_of_connections()
+ * open, authenticated connections to one server.
+ *
+ * Connections are leased and returned to the pool when the Lease goes out
+ * of scope, a returned connection that isn't idle is closed instead of being
+ * reused.  New connections are rate limited, a burst of up to the number of
+ * connections and then 'connect_rate' per second, and each failure to connect
+ * doubles a back off delay which is reset by the next success.
+ */
+class ConnectionPool
+{
+// construction
+public:
+
+	// creates the unopened connections for the pool, a Connection or SslConnection
+	typedef std::function<std::unique_ptr<Connection>()> Factory;
+
+	explicit ConnectionPool(const ServerAddr& server, bool use_ssl = false) throw(std::runtime_error);
+	ConnectionPool(const ServerAddr& server, const Factory& factory);
+	ConnectionPool(const ConnectionPool&) = delete;
+	~ConnectionPool();
+
+// attributes
+public:
+
+	/*
+	 * A leased connection, which is returned to its pool when released or
+	 * destroyed.  The pool has to outlive its leases.
+	 */
+	class Lease
+	{
+	public:
+
+		Lease() : m_pool(nullptr), m_connection() {}
+		Lease(Lease&& that) : m_pool(that.m_pool), m_connection(std::move(that.m_connection)) { that.m_pool = nullptr; }
+		Lease(const Lease&) = delete;
+		~Lease() { release(); }
+
+		Connection *get() const { return m_connection.get(); }
+		Connection& operator *() const { return *m_connection; }
+		Connection *operator ->() const { return m_connection.get(); }
+		explicit operator bool() const { return(nullptr != m_connection); }
+
+		// return the connection to the pool
+		void release();
+
+		// close the connection instead of returning it, for a connection in an
+		// unknown state after an error
+		void discard();
+
+		Lease& operator =(Lease&& that);
+		Lease& operator =(const Lease&) = delete;
+
+	private:
+
+		friend class ConnectionPool;
+
+		Lease(ConnectionPool *pool, std::unique_ptr<Connection>&& connection) : m_pool(pool), m_connection(std::move(connection)) {}
+
+		ConnectionPool *m_pool;
+		std::unique_ptr<Connection> m_connection;
+	};
+
+	const ServerAddr& get_server() const { return m_server; }
+
+	size_t get_max_connections() const;
+	size_t get_open_count() const;
+	size_t get_idle_count() const;
+
+	// connections opened per second after the initial burst, and the range of
+	// the back off after failures
+	void set_connect_rate(double connect_rate);
+	void set_backoff(std::chrono::milliseconds min_backoff, std::chrono::milliseconds max_backoff);
+
+// operations
+public:
+
+	// lease an idle connection, or open a new one when there are fewer than the
+	// max, waiting for a connection to be returned or for the rate limit.  The
+	// error opening a connection is thrown.
+	Lease lease() throw(std::runtime_error);
+
+	// as lease, but returns an empty lease instead of waiting
+	Lease try_lease() throw(std::runtime_error);
+
+	// run 'fn' with a leased connection, and on a std::system_error, which
+	// leaves the connection broken, run it again on a new connection up to
+	// 'retries' times
+	void execute(const std::function<void(Connection&)>& fn, unsigned int retries = 1) throw(std::runtime_error);
+
+	// close the idle connections
+	void close_idle();
+
+	ConnectionPool& operator =(const ConnectionPool&) = delete;
+
+// implementation
+protected:
+
+	typedef std::chrono::steady_clock Clock;
+
+	Lease acquire(bool wait) throw(std::runtime_error);
+	void give_back(std::unique_ptr<Connection>&& connection, bool is_reusable);
+	Clock::time_point next_connect_time(Clock::time_point now) const;
+
+	const ServerAddr m_server;
+	Factory m_factory;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_returned;
+	std::vector<std::unique_ptr<Connection>> m_idle;
+	size_t m_open;
+
+	// connection rate limit, a token bucket, and the back off after failures
+	double m_connect_rate;
+	double m_tokens;
+	Clock::time_point m_token_time;
+	std::chrono::milliseconds m_min_backoff;
+	std::chrono::milliseconds m_max_backoff;
+	std::chrono::milliseconds m_backoff;
+	Clock::time_point m_retry_time;
+};
+
+}	// NntpClient
+
+#endif	/* __NNTP_CONNECTION_POOL_HEADER__ */
@@ -21,6 +21,8 @@
 #define __CRC32_HEADER__
 
 #include <cstdint>
+#include <map>
+#include <stdexcept>
 
 /*
  *
@@ -45,10 +47,67 @@ public:
 	void update_crc(uint8_t byte)		{ update_crc(&byte, 1); }
 	void update_crc(const uint8_t *p_buf, unsigned int len);
 
+	// append a block of 'len' bytes which has the CRC value 'crc', as if the
+	// block had been given to update_crc
+	void combine(uint32_t crc, unsigned long len);
+
+	// the CRC of block A followed by block B from the CRC of each and the length
+	// of B, gives the same result as zlib's crc32_combine
+	static uint32_t combine(uint32_t crc_a, uint32_t crc_b, unsigned long len_b);
+
+	// the CRC of a buffer or a file, split across threads and combined, a
+	// 'num_threads' of 0 uses one thread per CPU
+	static uint32_t compute(const void *p_buf, unsigned long len, unsigned int num_threads = 0);
+	static uint32_t compute_file(const char *path, unsigned int num_threads = 0)
+		throw(std::runtime_error);
+
 // implementation
 private:
 
 	uint32_t m_crc;
 };
 
+/*
+ * Collects the CRC values of pieces of a file, which can be added in any order,
+ * and combines adjacent pieces as they are added to give the whole file CRC.
+ */
+class Crc32Combiner
+{
+// construction
+public:
+
+	Crc32Combiner() {}
+	~Crc32Combiner() {}
+
+// attributes
+public:
+
+	// the number of contiguous bytes from offset 0 and their CRC
+	unsigned long get_size() const;
+	uint32_t get_value() const;
+
+	// true when a single piece covers offsets 0 to total_size
+	bool is_complete(unsigned long total_size) const;
+
+	// the number of separate pieces, so gaps + 1 when there are gaps
+	int get_piece_count() const			{ return int(m_pieces.size()); }
+
+// operations
+public:
+
+	// add the CRC of the 'len' bytes at 'offset', returns false if the
+	// piece overlaps one that was already added and it is ignored
+	bool add(unsigned long offset, unsigned long len, uint32_t crc);
+
+	void clear()						{ m_pieces.clear(); }
+
+// implementation
+private:
+
+	struct Piece { unsigned long len; uint32_t crc; };
+
+	// pieces keyed by the file offset
+	std::map<unsigned long, Piece> m_pieces;
+};
+
 #endif	/* __CRC32_HEADER__ */
@@ -0,0 +1,106 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __NET_DEFLATE_HEADER__
+#define __NET_DEFLATE_HEADER__
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace NetStream {
+
+/*
+ * The raw deflate streams, in both directions, of a connection that has
+ * negotiated NNTP COMPRESS DEFLATE (RFC 8054).
+ *
+ * The compressed data received is added with put, or read straight in to
+ * the space from get_input_space, and taken out decompressed with inflate.
+ * Each block of data sent is compressed with deflate and flushed, so the
+ * peer can decompress all of it without waiting for more.
+ */
+class Deflate
+{
+// construction
+public:
+
+	// throws if the library was built without zlib
+	Deflate() throw(std::runtime_error);
+	Deflate(const Deflate&) = delete;
+	~Deflate();
+
+// attributes
+public:
+
+	// the library was built with zlib
+	static bool is_supported();
+
+	// inflate has more to give without more input
+	bool is_pending() const;
+
+	// the bytes on the wire and the bytes they are, received and sent
+	unsigned long long get_compressed_in() const { return m_compressed_in; }
+	unsigned long long get_plain_in() const { return m_plain_in; }
+	unsigned long long get_compressed_out() const { return m_compressed_out; }
+	unsigned long long get_plain_out() const { return m_plain_out; }
+
+// operations
+public:
+
+	// add compressed data which has been received
+	void put(const void *buf, size_t len);
+
+	// get space to read compressed data in to, of at least 'min_len' bytes,
+	// and add the 'len' bytes read to it
+	char *get_input_space(size_t min_len, size_t *p_len);
+	void commit_input(size_t len);
+
+	// decompress up to 'len' bytes in to 'buf', and return the number of bytes,
+	// which is 0 when more input is needed
+	size_t inflate(void *buf, size_t len) throw(std::runtime_error);
+
+	// compress 'len' bytes from 'buf' and append them, flushed, to 'out'
+	void deflate(const void *buf, size_t len, std::string& out) throw(std::runtime_error);
+
+	Deflate& operator =(const Deflate&) = delete;
+
+// implementation
+protected:
+
+	struct Streams;
+	std::unique_ptr<Streams> m_streams;
+
+	// compressed input, from m_in_begin to m_in_end
+	std::unique_ptr<char[]> m_in;
+	size_t m_in_size;
+	size_t m_in_begin;
+	size_t m_in_end;
+	bool m_is_out_full;
+	bool m_is_stalled;
+
+	unsigned long long m_compressed_in;
+	unsigned long long m_plain_in;
+	unsigned long long m_compressed_out;
+	unsigned long long m_plain_out;
+};
+
+}	/* namespace NetStream */
+
+#endif	/* __NET_DEFLATE_HEADER__ */
@@ -0,0 +1,206 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __NNTP_DOWNLOADER_HEADER__
+#define __NNTP_DOWNLOADER_HEADER__
+
+#include <libusenet/servergroup.h>
+#include <libusenet/nzb.h>
+#include <libusenet/crc32.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace NntpClient {
+
+namespace Uring { class Ring; }
+
+/*
+ * Downloads the files of a NZB::FileCollection from a ServerGroup.
+ *
+ * The segments are fetched in pipelined batches by a thread for each tier 0
+ * connection, with the failover of the ServerGroup for the missing ones, and
+ * the yEnc bodies are decoded by a pool of worker threads which write each
+ * part to its file at the =ypart begin offset.  The files are named by the
+ * =ybegin name and written to the output directory, and each one is reported
+ * when all of its segments are done.
+ *
+ * When the library is built with io_uring the decoded parts are written by a
+ * thread which submits them in batches, with the writes to each file linked
+ * in order, instead of a pwrite by each decoder.
+ */
+class Downloader
+{
+// construction
+public:
+
+	Downloader(ServerGroup& servers, const std::string& output_dir);
+	Downloader(const Downloader&) = delete;
+	~Downloader() {}
+
+// attributes
+public:
+
+	struct FileResult
+	{
+		int file;					// the index in the FileCollection
+		std::string name;			// the =ybegin name, empty if no segment was decoded
+		std::string path;
+		unsigned long size;			// the =ybegin size
+		int segments;
+		int missing;				// segments no server had
+		int damaged;				// segments decoded with damage, e.g. a bad CRC
+		bool is_crc_ok;				// the parts cover the file and the file CRC matched, if given
+
+		bool is_complete() const { return((0 == missing) && (0 == damaged) && is_crc_ok); }
+	};
+
+	// called as each file is done, from one thread at a time
+	typedef std::function<void(const FileResult& result)> FileHandler;
+
+	struct Progress
+	{
+		unsigned long segments;
+		unsigned long segments_done;
+		unsigned long bytes_received;
+		unsigned long bytes_written;
+	};
+
+	Progress get_progress() const;
+
+	// the number of fetch threads, 0 for one per tier 0 connection, and decode
+	// threads, 0 for one per CPU
+	void set_fetch_threads(unsigned int fetch_threads) { m_fetch_threads = fetch_threads; }
+	void set_decode_threads(unsigned int decode_threads) { m_decode_threads = decode_threads; }
+
+	// the segments pipelined in each request, and the most body data waiting to
+	// be decoded before fetching waits for the decoders
+	void set_batch_size(unsigned int batch_size) { m_batch_size = std::max(batch_size, 1U); }
+	void set_max_queued_bytes(size_t max_queued_bytes) { m_max_queued_bytes = max_queued_bytes; }
+
+// operations
+public:
+
+	// download all of the files and return their results, the first error
+	// writing a file, or thrown by 'on_file', stops the download and is thrown
+	std::vector<FileResult> download(const NZB::FileCollection& files, const FileHandler& on_file = FileHandler())
+		throw(std::runtime_error);
+
+	// stop a download, from another thread or 'on_file'
+	void cancel() { m_cancel = true; }
+
+	Downloader& operator =(const Downloader&) = delete;
+
+// implementation
+protected:
+
+	struct SegmentRef
+	{
+		int file;
+		int segment;
+	};
+
+	struct FileState
+	{
+		std::mutex mutex;
+		int fd;
+		int done;
+		Crc32Combiner crc;
+		bool is_file_crc;
+		uint32_t file_crc;
+		FileResult result;
+	};
+
+	struct DecodeJob
+	{
+		int file;
+		std::string body;
+	};
+
+	struct WriteJob
+	{
+		int file;
+		int fd;
+		unsigned long offset;
+		std::unique_ptr<unsigned char[]> data;
+		unsigned long len;
+		unsigned long written;
+		bool is_damaged;
+	};
+
+	void fetch() throw(std::runtime_error);
+	void decode() throw(std::runtime_error);
+	void decode_job(DecodeJob& job) throw(std::runtime_error);
+	void queue_write(WriteJob&& job);
+	void write_parts(Uring::Ring& ring) throw(std::runtime_error);
+	void open_file(FileState& state, const std::string& name) throw(std::runtime_error);
+	void segment_done(int file, bool is_missing, bool is_damaged, unsigned long written);
+	void finish_file(int file);
+	void fail(std::exception_ptr error);
+
+	ServerGroup& m_servers;
+	std::string m_output_dir;
+	unsigned int m_fetch_threads;
+	unsigned int m_decode_threads;
+	unsigned int m_batch_size;
+	size_t m_max_queued_bytes;
+
+	// the download in progress
+	const NZB::FileCollection *m_p_files;
+	FileHandler m_on_file;
+	std::vector<SegmentRef> m_segments;
+	std::atomic<size_t> m_next_segment;
+	std::unique_ptr<FileState[]> m_states;
+	std::mutex m_report_mutex;
+
+	// bodies waiting to be decoded
+	std::mutex m_queue_mutex;
+	std::condition_variable m_queue_ready;
+	std::condition_variable m_queue_room;
+	std::deque<DecodeJob> m_queue;
+	size_t m_queued_bytes;
+	bool m_fetch_done;
+
+	// decoded parts waiting to be written, when they're written with io_uring
+	bool m_is_queued_writes;
+	std::mutex m_write_mutex;
+	std::condition_variable m_write_ready;
+	std::condition_variable m_write_room;
+	std::deque<WriteJob> m_writes;
+	size_t m_write_bytes;
+	bool m_decode_done;
+
+	std::atomic<bool> m_cancel;
+	std::exception_ptr m_error;
+
+	std::atomic<unsigned long> m_segments_done;
+	std::atomic<unsigned long> m_bytes_received;
+	std::atomic<unsigned long> m_bytes_written;
+};
+
+}	// NntpClient
+
+#endif	/* __NNTP_DOWNLOADER_HEADER__ */
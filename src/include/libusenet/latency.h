@@ -0,0 +1,145 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __NET_LATENCY_HEADER__
+#define __NET_LATENCY_HEADER__
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+namespace NetStream {
+
+/*
+ * The response times and receive rate of a connection, and the time to
+ * wait on the server they give.
+ *
+ * The time from a request sent to an idle connection to the first byte of
+ * its response is the time to first byte.  The round trip times the owner
+ * adds, which are usually the same, are smoothed with their mean deviation
+ * as TCP does for its retransmit timeout (RFC 6298), and the timeout is the
+ * smoothed time plus four deviations, kept between the least and the most
+ * timeout.  Until there is a round trip time the timeout is the most, and
+ * 0 for the most is no timeout at all.
+ */
+class Latency
+{
+public:
+
+	typedef std::chrono::steady_clock clock;
+
+// construction
+public:
+
+	explicit Latency(double max_timeout = 0);
+	Latency(const Latency&) = default;
+	~Latency() {}
+
+// attributes
+public:
+
+	// the smoothed round trip time and its mean deviation in seconds, and the
+	// number of them, which are 0 until the first
+	double get_srtt() const { return m_srtt; }
+	double get_rtt_variance() const { return m_rttvar; }
+	unsigned long get_samples() const { return m_samples; }
+
+	// the smoothed time to first byte in seconds
+	double get_ttfb() const { return m_ttfb; }
+
+	// bytes/sec received from the first to the last byte of the responses, and
+	// the mean size of a response, which is only measured between responses
+	// to pipelined commands
+	double get_bandwidth() const { return m_bandwidth; }
+	double get_response_size() const { return m_response_size; }
+
+	// the time to wait on the server in seconds, or 0 for no timeout
+	double get_timeout() const;
+
+	double get_min_timeout() const { return m_min_timeout; }
+	void set_min_timeout(double seconds) { m_min_timeout = seconds; }
+	double get_max_timeout() const { return m_max_timeout; }
+	void set_max_timeout(double seconds) { m_max_timeout = seconds; }
+
+	// a request is waiting on the first byte of its response
+	bool is_waiting() const { return(clock::time_point() != m_sent); }
+
+	// the last time a request was sent or anything received
+	clock::time_point get_last_activity() const { return std::max(m_last_sent, m_last_received); }
+
+// operations
+public:
+
+	// a request has been sent, and if the connection was idle, with no other
+	// response to come ahead of it, the first byte of its response is timed
+	void sent(bool is_idle = true, clock::time_point now = clock::now());
+
+	// 'len' bytes have been received, returns the time to first byte when it
+	// was the start of a timed response, or else 0
+	double received(size_t len, clock::time_point now = clock::now());
+
+	// the response to a pipelined command has started, and the bytes received
+	// since the one before started are that response, which gives the receive
+	// rate and the size of a response.  The next response is only measured
+	// from this one if 'is_more' are on their way.
+	void response_started(bool is_more, clock::time_point now = clock::now());
+
+	// the responses to the pipelined commands stopped, as the connection was
+	// closed, and what was received isn't a whole response
+	void responses_stopped() { m_response_start = clock::time_point(); }
+
+	// smooth in a round trip time in seconds
+	void add_sample(double rtt);
+
+	// forget everything measured, for a new connection
+	void reset();
+
+	Latency& operator =(const Latency&) = default;
+
+// implementation
+protected:
+
+	double m_srtt;
+	double m_rttvar;
+	unsigned long m_samples;
+	double m_ttfb;
+	double m_bandwidth;
+	double m_response_size;
+
+	double m_min_timeout;
+	double m_max_timeout;
+
+	// the request waiting on its first byte, and the response being received
+	clock::time_point m_sent;
+	clock::time_point m_last_sent;
+	clock::time_point m_last_received;
+	clock::time_point m_first_byte;
+	size_t m_response_bytes;
+
+	// all of the bytes received, and the start of the last pipelined response
+	unsigned long m_bytes;
+	clock::time_point m_response_start;
+	unsigned long m_response_start_bytes;
+
+	void add_bandwidth(double bandwidth);
+};
+
+}	/* namespace NetStream */
+
+#endif	/* __NET_LATENCY_HEADER__ */
@@ -0,0 +1,157 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __NET_ADDR_HEADER__
+#define __NET_ADDR_HEADER__
+
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <system_error>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+namespace NetStream {
+
+/*
+ * One of the IPv6 or IPv4 addresses a host name resolves to
+ */
+struct SockAddr
+{
+	sockaddr_storage addr;
+	socklen_t addrlen;
+
+	const sockaddr *get() const { return (const sockaddr*)&addr; }
+	int get_family() const { return addr.ss_family; }
+};
+
+typedef std::vector<SockAddr> SockAddrList;
+
+// the time to wait on a connect before the next address is tried as well,
+// the "Connection Attempt Delay" of RFC 8305
+const int connect_attempt_delay = 250;
+
+/*
+ * A cache of resolved addresses, shared by all of the threads using it.
+ *
+ * Each lookup runs on a thread of its own and everyone wanting the same
+ * name waits on that one lookup.  An answer is kept for the TTL, and after
+ * that it's still used while a new lookup runs in the background, so only
+ * the first use of a name waits on DNS.  A failed lookup is kept for the
+ * shorter error TTL.  getaddrinfo doesn't give the TTLs of the DNS records,
+ * so the TTL is the cache's own.
+ */
+class Resolver
+{
+public:
+
+	struct Result
+	{
+		int error;
+		SockAddrList addrs;
+		std::string canon_name;
+		std::chrono::steady_clock::time_point time;
+	};
+
+	typedef std::shared_future<Result> Future;
+
+// construction
+public:
+
+	Resolver();
+	Resolver(const Resolver&) = delete;
+	~Resolver() {}
+
+// attributes
+public:
+
+	// the resolver used by resolve(), so by ServerAddr, usenet::ServerProfile
+	// and the socket streams
+	static Resolver& get_default();
+
+	// seconds an answer, or a failure, is used before it's looked up again
+	int get_ttl() const;
+	void set_ttl(int seconds);
+	int get_error_ttl() const;
+	void set_error_ttl(int seconds);
+
+	size_t get_size() const;
+
+// operations
+public:
+
+	// get the result, from the cache or of a lookup which is started if there isn't one running
+	Future resolve_async(const char *node, const char *service, int flags = 0) throw(std::system_error);
+
+	// wait for resolve_async, and give its result as the resolve() function
+	int resolve(const char *node, const char *service, SockAddrList& addrs,
+		std::string *p_canon_name = nullptr, int flags = 0) throw(std::system_error);
+
+	void clear();
+
+	Resolver& operator =(const Resolver&) = delete;
+
+// implementation
+protected:
+
+	// the result used, and the lookup to replace it after it has expired
+	struct Lookup
+	{
+		Future result;
+		Future refresh;
+		std::chrono::steady_clock::time_point retry;
+	};
+
+	static Future start_lookup(const char *node, const char *service, int flags) throw(std::system_error);
+
+	mutable std::mutex m_mutex;
+	std::map<std::string, Lookup> m_cache;
+	std::chrono::seconds m_ttl;
+	std::chrono::seconds m_error_ttl;
+};
+
+/*
+ * Resolve 'node' and 'service' to all of their IPv6 and IPv4 addresses, in
+ * the order getaddrinfo sorts them with the two families interleaved, as
+ * RFC 8305 has them tried.  The canonical name goes in *p_canon_name, and
+ * the result is the getaddrinfo error code.  The addresses come from the
+ * cache of the default Resolver.
+ */
+int resolve(const char *node, const char *service, SockAddrList& addrs,
+	std::string *p_canon_name = nullptr, int flags = 0);
+
+// as resolve, without the cache
+int lookup(const char *node, const char *service, SockAddrList& addrs,
+	std::string *p_canon_name = nullptr, int flags = 0);
+
+/*
+ * Connect to the first of the addresses to answer, "Happy Eyeballs" as
+ * RFC 8305, which starts a connect to the next address every 'delay_ms'
+ * while none has connected, or as soon as one fails.  The connected,
+ * blocking, socket is returned and the other attempts are closed.  It's
+ * -1 with errno set when none of the addresses can be connected to.
+ */
+int connect_race(const SockAddrList& addrs, int delay_ms = connect_attempt_delay);
+
+}	/* namespace NetStream */
+
+#endif	/* __NET_ADDR_HEADER__ */
@@ -23,10 +23,16 @@
 #include <cstdlib>
 #include <stdexcept>
 #include <system_error>
+#include <chrono>
+#include <deque>
 #include <memory>
 #include <string>
 #include <istream>
+#include <vector>
 #include <sys/socket.h>
+#include <libusenet/deflate.h>
+#include <libusenet/latency.h>
+#include <libusenet/netaddr.h>
 
 #include "options.h"
 
@@ -42,6 +48,7 @@ const int nntp_tcp_protocol = 6;
 class ServerAddr;
 class StatusResponse;
 class Connection;
+class Reactor;
 
 
 /*
@@ -65,9 +72,11 @@ public:
 
 public:
 
-	// remote host info
-	const sockaddr& get_addr() const { return m_addr; }
-	size_t get_addrlen() const { return m_addr_len; }
+	// remote host info, the first address and all of the IPv6 and IPv4
+	// addresses in the order they're tried
+	const sockaddr& get_addr() const;
+	size_t get_addrlen() const;
+	const NetStream::SockAddrList& get_addr_list() const { return m_addrs; }
 	const std::string& get_canon_name() const { return m_canon_name; }
 
 	// connection and auth info
@@ -90,8 +99,7 @@ public:
 private:
 
 	// network info
-	sockaddr m_addr;
-	size_t m_addr_len;
+	NetStream::SockAddrList m_addrs;
 	std::string m_canon_name;
 
 	// NNTP info
@@ -103,6 +111,10 @@ private:
 enum ResponseStatus { S_NONE = 0, INFO = 1, CMD_OK, CMD_OK_SOFAR, CMD_FAIL, ERROR, };
 enum ResponseFunction { F_NONE = -1, CONNECTION, GROUP_SELECTION, ARTICLE_SELECTION, DISTRO, POSTING, NON_STD = 8, DEBUGGING, };
 
+// the result of a non-blocking operation, which is either done or needs to
+// be called again when the socket is ready for the given direction
+enum IoStatus { IO_DONE = 0, IO_WANT_READ, IO_WANT_WRITE, IO_EOF, };
+
 /*
  *
  */
@@ -140,10 +152,91 @@ private:
 
 	friend class Connection;
 
+	Response& assign(const char *p_line, size_t len);
+
 	char m_buf[1024];
 	int m_len;
 };
 
+/*
+ * A line of a response, which points in to the receive buffer of the
+ * Connection it was read from and is only valid until the next read
+ */
+struct LineView
+{
+	const char *p_line;
+	size_t len;
+};
+
+/*
+ * A NNTP command line formatted in place, without allocating, and cut to the
+ * 512 char max of a command, which includes the "\r\n" that always ends it
+ */
+class CommandLine
+{
+// construction
+public:
+
+	CommandLine();
+	explicit CommandLine(const char *cmd);
+
+// attributes
+public:
+
+	// the most chars of a command, not counting the "\r\n"
+	enum { MAX_LENGTH = 510, };
+
+	// the command line, ended with "\r\n"
+	const char *data() const { return m_buf; }
+	size_t size() const { return m_len + 2; }
+
+// operations
+public:
+
+	// add text as it is, a token after a space, or a message-id wrapped in '<' and '>'
+	CommandLine& append(const char *text);
+	CommandLine& add(const char *token);
+	CommandLine& add_message_id(const char *message_id);
+
+	CommandLine& clear();
+
+// implementation
+protected:
+
+	char m_buf[MAX_LENGTH + 2];
+	size_t m_len;
+};
+
+/*
+ * A BODY or STAT command sent, or to be sent, by a pipelined Connection
+ */
+struct PipelineRequest
+{
+	enum Command { BODY, STAT, };
+
+	unsigned long seq;
+	Command command;
+	std::string message_id;
+	std::chrono::steady_clock::time_point sent;
+};
+
+/*
+ * Where a Connection in non-blocking mode takes the data it receives from,
+ * instead of reading the socket, when something else reads the socket for it
+ */
+class ReceiveSource
+{
+public:
+
+	virtual ~ReceiveSource() {}
+
+	// as Connection::read_some, copy up to 'nbyte' bytes in to 'buf'
+	virtual IoStatus take(void *buf, size_t nbyte, size_t *p_len) throw(std::system_error) = 0;
+
+	// anything, including the end of the stream or an error, is waiting to be taken
+	virtual bool is_pending() const = 0;
+};
+
 /*
  *
  */
@@ -161,9 +254,58 @@ public:
 // attributes
 public:
 
+	// the most time to wait on the server in seconds, the read timeout set on
+	// the socket adapts below it to the response times
 	int get_timeout() const;
 	void set_timeout(int seconds);
 
+	// pipelined commands sent and not yet answered, and queued to be sent
+	size_t get_pipeline_depth() const { return m_in_flight.size(); }
+	size_t get_pipeline_queued() const { return m_pipeline_queue.size(); }
+
+	// the number of commands kept in flight, which adapts between the min and
+	// max to the measured round trip time x bandwidth
+	size_t get_pipeline_window() const { return m_window; }
+	void set_pipeline_window(size_t min_window, size_t max_window);
+
+	// the measured round trip time in seconds, the window is this times the
+	// receive rate of get_latency over its response size
+	double get_rtt() const { return m_rtt; }
+
+	// the smoothed response times, time to first byte and receive rate, and the
+	// timeout to wait on the server they give, which is the read timeout of a
+	// blocking connection and the Reactor's deadline for a non-blocking one
+	const NetStream::Latency& get_latency() const { return m_latency; }
+
+	// the time a response stops being waited for if nothing is received, while
+	// there is one to wait for, or while connecting, the time the next address
+	// is tried as well, or else the epoch
+	std::chrono::steady_clock::time_point get_deadline() const;
+
+	int get_socket() const { return m_sock; }
+
+	// the descriptor to wait on, which is an epoll of the sockets of the
+	// connects racing during a non-blocking connect, and else the socket
+	int get_event_fd() const { return (m_connect_epfd >= 0) ? m_connect_epfd : m_sock; }
+
+	// in non-blocking mode only the non-blocking operations can be used
+	bool is_nonblocking() const { return m_nonblocking; }
+	virtual void set_nonblocking(bool nonblocking) throw(std::system_error);
+
+	// bytes queued by queue_send and not yet sent
+	size_t get_send_queued() const { return m_obuf.size() - m_obuf_sent; }
+
+	// COMPRESS DEFLATE is active, and the bytes sent and received with it
+	bool is_compressed() const { return(nullptr != m_deflate); }
+	const NetStream::Deflate *get_compression() const { return m_deflate.get(); }
+
+	// open with no command or response outstanding, and nothing received from
+	// the server since, which would be it closing the connection or an error
+	bool is_idle() const;
+
+	// a pipelined BODY was answered with 222 and its lines aren't all read
+	bool is_in_body() const { return m_in_body; }
+
 // operations
 public:
 
@@ -173,16 +315,75 @@ public:
 	ResponseStatus read_response(Response& response) throw(std::runtime_error);
 	int read_line(char *buf, size_t buflen) throw(std::runtime_error);
 
+	// read a line without copying it, the same as read_line the line includes
+	// its "\r\n", has a leading '.' removed and is 0 length for the ".\r\n"
+	// end of a multi-line response
+	int read_line(LineView& line) throw(std::runtime_error);
+
+	// read up to 'max_lines' of the lines already received, or wait for at least
+	// one line, and return the number read.  The lines are as read_line(LineView&)
+	// and reading stops after the end of a multi-line response, which is flagged
+	// in *p_end.  All of the lines are valid until the next read.
+	size_t read_lines(LineView *p_lines, size_t max_lines, bool *p_end = nullptr) throw(std::runtime_error);
+
 	ResponseStatus group(const char *group_name, Response response) throw(std::runtime_error);
 	ResponseStatus stat(const char *message_id, Response response) throw(std::runtime_error);
 	ResponseStatus article(const char *message_id, Response& response) throw(std::runtime_error);
 	ResponseStatus header(const char *message_id, Response& response) throw(std::runtime_error);
 	ResponseStatus body(const char *message_id, Response& response) throw(std::runtime_error);
 
+	// negotiate COMPRESS DEFLATE (RFC 8054), after which everything sent and received
+	// is compressed, on a blocking connection with nothing in flight.  Headers,
+	// overviews and lists compress well and yEnc bodies hardly at all, so it's
+	// best left off for the connections used for bodies.  Throws if the library
+	// was built without zlib.
+	ResponseStatus compress(Response& response) throw(std::runtime_error);
+
+	// queue a pipelined BODY or STAT command and return its sequence number, the
+	// commands are sent as the window allows and answered in the order queued
+	unsigned long pipeline_body(const char *message_id) throw(std::runtime_error);
+	unsigned long pipeline_stat(const char *message_id) throw(std::runtime_error);
+
+	// send queued commands to fill the window, then read the response of the
+	// oldest command in flight into 'response' and its request into *p_request.
+	// A multi-line response (222 for BODY) has to be read to its end with read_line
+	// before the next call, and the commands which aren't pipelined can't be used
+	// while any are in flight.
+	ResponseStatus read_pipelined_response(Response& response, PipelineRequest *p_request = nullptr)
+		throw(std::runtime_error);
+
 	void send(const char *cmd) throw(std::runtime_error);
 	void send(const char *cmd, const char *arg1, ...) throw(std::runtime_error);
 
 	void send(const void *buf, unsigned long len) throw(std::runtime_error);
+	void send(const CommandLine& cmdline) throw(std::runtime_error);
+
+	// non-blocking operations, driven by a Reactor or the caller's own polling.
+	// start_connect starts connecting to 'server' and continue_connect has to
+	// be called as the socket is ready, and at get_deadline, until it returns
+	// IO_DONE, which for a SslConnection includes the TLS handshake.  The
+	// addresses race as with a blocking connect, and while they do, it is the
+	// get_event_fd that becomes ready.
+	IoStatus start_connect(const ServerAddr& server) throw(std::system_error);
+	virtual IoStatus continue_connect() throw(std::system_error);
+
+	// read what has been received in to the block buffer, which moves the lines
+	// already taken from it, then take the whole lines from the buffer as
+	// read_line(LineView&) and read_response do
+	IoStatus receive() throw(std::runtime_error);
+	bool take_line(LineView& line);
+	bool take_response(Response& response);
+
+	// as read_pipelined_response, returns false until the response has been received
+	bool take_pipelined_response(Response& response, PipelineRequest *p_request = nullptr)
+		throw(std::runtime_error);
+
+	// queue a command, as send(cmd) would send it, or data to be sent and send
+	// as much of the queue as the socket takes
+	void queue_send(const char *cmd);
+	void queue_send(const void *buf, unsigned long len);
+	void queue_send(const CommandLine& cmdline);
+	IoStatus flush() throw(std::system_error);
 
 	virtual Connection& operator =(Connection&& transConnection);
 	Connection& operator =(const Connection&) = delete;
@@ -197,13 +398,115 @@ protected:
 	virtual void write(const void *buf, size_t nbyte) throw(std::system_error);
 	virtual int read(void *buf, size_t nbyte) throw(std::system_error);
 
+	// non-blocking read and write, which give the number of bytes in *p_len
+	virtual IoStatus read_some(void *buf, size_t nbyte, size_t *p_len) throw(std::system_error);
+	virtual IoStatus write_some(const void *buf, size_t nbyte, size_t *p_len) throw(std::system_error);
+
+	// data that has been received and can't be seen by polling the socket
+	virtual bool is_read_pending() const;
+
+	// read_some reads the socket itself, so a ReceiveSource can be used in its place
+	virtual bool is_raw_socket() const { return true; }
+
+	// the reads and writes of the NNTP stream, which go through the compression
+	// when it's active
+	int read_data(void *buf, size_t nbyte) throw(std::runtime_error);
+	IoStatus read_data_some(void *buf, size_t nbyte, size_t *p_len) throw(std::runtime_error);
+	void write_data(const void *buf, size_t nbyte) throw(std::runtime_error);
+	void queue_data(const void *buf, size_t nbyte) throw(std::runtime_error);
+
+	unsigned long queue_pipelined(PipelineRequest::Command command, const char *message_id) throw(std::runtime_error);
+	void fill_pipeline() throw(std::runtime_error);
+	void update_window(double rtt_sample);
+	void reset_pipeline();
+	void complete_pipelined(const Response& response, PipelineRequest *p_request);
+	void release_pipelined();
+
+	bool fill_line(size_t *p_eol) throw(std::runtime_error);
+
+	// time the responses, and set the read timeout from them
+	void sent_command();
+	void received(size_t len);
+	void apply_timeout();
+
+	// start a connect to the next of the addresses of start_connect, after one
+	// has had its delay or has failed with 'error', put the first one made in
+	// the place of the socket, and close the rest
+	IoStatus connect_next(int error) throw(std::system_error);
+	IoStatus connect_won(int sock) throw(std::system_error);
+	void stop_connect();
+	void replace_socket(int sock) throw(std::system_error);
+
+	friend class Reactor;
+
 	int m_sock;
 
 	int m_rdsz;
 	int m_ibuf;
 
+	// the block buffer is at the start of a line, and not at the rest of one
+	// that was longer than the buffer, which has no '.' to remove
+	bool m_line_start;
+
 	int m_buflen;
 	std::unique_ptr<char[]> m_bufptr;
+
+	// a pipelined command, queued or in flight, which is the 'length' chars of
+	// its command line at 'offset' in m_pipeline_cmds
+	struct PipelineEntry
+	{
+		unsigned long seq;
+		PipelineRequest::Command command;
+		unsigned long offset;
+		size_t length;
+		std::chrono::steady_clock::time_point sent;
+	};
+
+	// pipelining, the command lines are formatted in the order they're queued,
+	// and the offsets are from the start of all of them, so the space of the
+	// ones answered can be reused without changing them
+	std::deque<PipelineEntry> m_pipeline_queue;
+	std::deque<PipelineEntry> m_in_flight;
+	std::string m_pipeline_cmds;
+	unsigned long m_pipeline_base;
+	unsigned long m_next_seq;
+	size_t m_min_window;
+	size_t m_max_window;
+	size_t m_window;
+
+	// RTT is the least of the recent response times
+	enum { RTT_SAMPLES = 16, };
+	double m_rtt_samples[RTT_SAMPLES];
+	unsigned int m_rtt_index;
+	double m_rtt;
+
+	// the response times, the read timeout last set on the socket, and the
+	// lines of a pipelined BODY are still to come
+	NetStream::Latency m_latency;
+	double m_rcvtimeo;
+	bool m_in_body;
+
+	// non-blocking mode, the send queue and the direction the last read or
+	// write is waiting on when it isn't its own
+	bool m_nonblocking;
+	bool m_connecting;
+	std::string m_obuf;
+	size_t m_obuf_sent;
+	bool m_read_wants_write;
+	bool m_write_wants_read;
+	ReceiveSource *m_p_source;
+
+	// the addresses of a non-blocking connect, the next one to try and when,
+	// and the connects racing, which are watched by an epoll
+	NetStream::SockAddrList m_connect_addrs;
+	size_t m_connect_next;
+	std::chrono::steady_clock::time_point m_connect_time;
+	std::vector<int> m_connect_socks;
+	int m_connect_epfd;
+
+	// COMPRESS DEFLATE, and the compressed data of a blocking write
+	std::unique_ptr<NetStream::Deflate> m_deflate;
+	std::string m_zbuf;
 };
 
 #ifdef LIBUSENET_USE_SSL
@@ -222,11 +525,28 @@ public:
 	SslConnection(const SslConnection&) = delete;
 	~SslConnection();
 
+// attributes
+public:
+
+	// kernel TLS, set before the connection is opened, hands the encryption to
+	// the kernel after the handshake so the socket is read and written as a
+	// plain one, which works with the Reactor's io_uring receive.  Without the
+	// kernel's "tls" module, or a cipher it supports, SSL carries on as usual
+	// and is_ktls_receive and is_ktls_send are false
+	void set_ktls(bool enable);
+	bool is_ktls_receive() const { return m_ktls_recv; }
+	bool is_ktls_send() const { return m_ktls_send; }
+
 // operations
 public:
 
 	void close();
 
+	void set_nonblocking(bool nonblocking) throw(std::system_error);
+
+	// steps the TLS handshake once the TCP connection has been made
+	IoStatus continue_connect() throw(std::system_error);
+
 	SslConnection& operator =(SslConnection&& transConnection);
 	SslConnection& operator =(const SslConnection&) = delete;
 
@@ -240,9 +560,18 @@ protected:
 	void write(const void *buf, size_t nbyte) throw(std::system_error);
 	int read(void *buf, size_t nbyte) throw(std::system_error);
 
-	// SSL data structures
-	std::unique_ptr<SSL_CTX, void(*)(SSL_CTX*)> m_ctxptr;
+	IoStatus read_some(void *buf, size_t nbyte, size_t *p_len) throw(std::system_error);
+	IoStatus write_some(const void *buf, size_t nbyte, size_t *p_len) throw(std::system_error);
+	bool is_read_pending() const;
+	bool is_raw_socket() const { return(m_ktls_recv && m_ktls_send); }
+
+	// checks for kernel TLS once the handshake is done
+	void start_ktls();
+
+	// SSL data structures, the SSL_CTX is shared by all of the connections
 	std::unique_ptr<SSL, void(*)(SSL*)> m_sslptr;
+	bool m_ktls_recv;
+	bool m_ktls_send;
 };
 
 #endif  /* LIBUSENET_USE_SSL */
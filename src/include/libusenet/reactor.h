@@ -0,0 +1,202 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __NNTP_REACTOR_HEADER__
+#define __NNTP_REACTOR_HEADER__
+
+#include <libusenet/nntpclient.h>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace NntpClient {
+
+namespace Uring { class Ring; class BufferRing; }
+
+/*
+ * An event loop which drives many non-blocking Connections and
+ * SslConnections from one thread, on epoll or io_uring.
+ *
+ * A connection is made non-blocking when it's added and calls its Handler
+ * as it becomes readable or its send queue has been sent.  The reactor
+ * watches for writes while there is anything queued, so commands queued with
+ * Connection::queue_send, or pipelined, outside of a callback need update().
+ * A connection can't be moved or destroyed while it is in the reactor.
+ *
+ * With io_uring the data of a Connection is received by a multishot receive
+ * in to a ring of buffers shared by all of the connections, and taken from
+ * there by Connection::receive, so there is no read syscall for each one.  A
+ * SslConnection reads its socket itself, so it is only polled on the ring,
+ * unless its handshake sets up kernel TLS for both directions.
+ *
+ * A connection waiting on a response which gets nothing for the timeout its
+ * response times give, Connection::get_deadline, is removed and its Handler
+ * gets an ETIMEDOUT error.  While a connection is opening, its deadline is
+ * when its connect races the next of the server's addresses.
+ */
+class Reactor
+{
+// construction
+public:
+
+	enum Backend { AUTO, EPOLL, IO_URING, };
+
+	// AUTO uses io_uring when the library was built with it and the kernel has
+	// the features used, or else epoll
+	explicit Reactor(Backend backend = AUTO) throw(std::system_error);
+	Reactor(const Reactor&) = delete;
+	~Reactor();
+
+// attributes
+public:
+
+	/*
+	 * The callbacks for the events of a connection
+	 */
+	class Handler
+	{
+	public:
+
+		virtual ~Handler() {}
+
+		// the connection has been made, and for a SslConnection the TLS
+		// handshake is done, the server's greeting is read as any response
+		virtual void on_open(Connection& connection) {}
+
+		// data can be read with Connection::receive, and all of the lines
+		// already received should be taken before returning
+		virtual void on_readable(Connection& connection) = 0;
+
+		// the send queue has been sent
+		virtual void on_writable(Connection& connection) {}
+
+		// an error was thrown by the connection or a callback, the connection
+		// has been removed from the reactor before this is called
+		virtual void on_error(Connection& connection, const std::exception& error) {}
+	};
+
+	size_t get_connection_count() const { return m_entries.size(); }
+
+	Backend get_backend() const { return m_backend; }
+
+// operations
+public:
+
+	// start connecting 'connection' to 'server', Handler::on_open is called when it's open
+	void open(Connection& connection, const ServerAddr& server, Handler& handler) throw(std::system_error);
+
+	// add a connection that is already open
+	void add(Connection& connection, Handler& handler) throw(std::system_error);
+
+	// data received for the connection with io_uring, and not yet taken, is moved
+	// to its block buffer, and if there's more than fits the connection is closed
+	void remove(Connection& connection);
+
+	// update the events watched for after queuing data to send outside of a callback
+	void update(Connection& connection) throw(std::system_error);
+
+	// wait up to 'timeout_ms', or forever for -1, for events and dispatch them,
+	// returns the number of events dispatched
+	int run_once(int timeout_ms = -1) throw(std::system_error);
+
+	// dispatch events until stop is called or there are no connections
+	void run() throw(std::system_error);
+	void stop() { m_stop = true; }
+
+	Reactor& operator =(const Reactor&) = delete;
+
+// implementation
+protected:
+
+	// a buffer of the BufferRing filled by the multishot receive
+	struct Received
+	{
+		uint16_t bid;
+		unsigned int offset;
+		unsigned int len;
+	};
+
+	struct Entry : public ReceiveSource
+	{
+		Entry(Connection& connection, Handler& handler, bool is_opening, IoStatus open_status);
+
+		IoStatus take(void *buf, size_t nbyte, size_t *p_len) throw(std::system_error);
+		bool is_pending() const;
+
+		Connection *p_connection;
+		Handler *p_handler;
+		bool is_opening;
+		IoStatus open_status;
+		int fd;
+		uint32_t events;
+
+		// io_uring, the operations in flight, the events completed and not yet
+		// dispatched, and what the receive has given
+		Uring::BufferRing *p_buffers;
+		unsigned int armed;
+		uint32_t ready;
+		bool is_ready;
+		bool is_multishot;
+		std::deque<Received> received;
+		bool is_eof;
+		int error;
+	};
+
+	void insert(Connection& connection, Handler& handler, bool is_opening, IoStatus open_status) throw(std::system_error);
+	void dispatch(uint64_t id, uint32_t events);
+	void watch(uint64_t id, Entry& entry) throw(std::system_error);
+	void fail(uint64_t id, const std::exception& error);
+	Entry *find(uint64_t id);
+
+	// the time to wait for events, which ends at the first deadline of the
+	// connections, and the failing of the connections past their deadline
+	int get_wait(int timeout_ms) const;
+	void expire();
+
+	void watch_uring(uint64_t id, Entry& entry) throw(std::system_error);
+	void arm(uint64_t id, Entry& entry, unsigned int op, int fd) throw(std::system_error);
+	void reap();
+	void set_ready(uint64_t id, Entry& entry, uint32_t events);
+	int run_uring(int timeout_ms) throw(std::system_error);
+	void remove_uring(uint64_t id, Entry& entry);
+
+	Backend m_backend;
+	int m_epfd;
+	bool m_stop;
+
+	// the ring, the buffers of the receives and the entries with completions to dispatch
+	std::unique_ptr<Uring::Ring> m_ring;
+	std::unique_ptr<Uring::BufferRing> m_buffers;
+	std::vector<uint64_t> m_ready;
+
+	// entries are found by an id, which isn't reused like a socket, so
+	// events for a connection removed during a dispatch are dropped
+	uint64_t m_next_id;
+	std::unordered_map<uint64_t, Entry> m_entries;
+	std::unordered_map<const Connection*, uint64_t> m_ids;
+
+	// connections with data held by SSL, which are dispatched again without waiting
+	std::vector<uint64_t> m_pending;
+};
+
+}	// NntpClient
+
+#endif	/* __NNTP_REACTOR_HEADER__ */
@@ -0,0 +1,141 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __NNTP_SERVER_GROUP_HEADER__
+#define __NNTP_SERVER_GROUP_HEADER__
+
+#include <libusenet/connectionpool.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace NntpClient {
+
+/*
+ * A group of servers in priority tiers, each with its own ConnectionPool.
+ *
+ * Articles are requested from the servers of tier 0 first, and the ones a
+ * server doesn't have (430 no such article) or can't be reached for are
+ * requested from the next server, in tier order and then in the order the
+ * servers were added.  The pools only connect when a connection is leased, so
+ * the servers of the fill tiers aren't connected to until an article is
+ * missing from all of the servers before them.
+ *
+ * The servers are added before the group is used, after that it can be
+ * used by any number of threads.
+ */
+class ServerGroup
+{
+// construction
+public:
+
+	ServerGroup();
+	ServerGroup(const ServerGroup&) = delete;
+	~ServerGroup() {}
+
+// attributes
+public:
+
+	/*
+	 * The result for one segment, from the last server it was requested from
+	 */
+	struct SegmentResult
+	{
+		std::string message_id;
+		size_t index;				// in the request
+		ResponseStatus status;		// CMD_OK when found, S_NONE when no server answered
+		int code;					// the NNTP response code, 0 when no server answered
+		int server;					// the index of the server, -1 when none was asked
+		int tier;
+		unsigned int tried;			// the number of servers asked
+
+		bool is_found() const { return(CMD_OK == status); }
+	};
+
+	struct ServerStats
+	{
+		unsigned long found;
+		unsigned long missing;
+		unsigned long errors;
+	};
+
+	// called with a connection that has just read the 222 response to a BODY,
+	// it reads as much of the body as it wants and the rest is skipped after it
+	// returns, as is the whole body without a handler.  After an error breaks
+	// the connection the segment is requested again and the handler has to
+	// start over.
+	typedef std::function<void(const SegmentResult& result, Connection& connection)> BodyHandler;
+
+	size_t get_server_count() const { return m_servers.size(); }
+	int get_tier(int server) const { return m_servers.at(server).tier; }
+	ConnectionPool& get_pool(int server) { return *m_servers.at(server).pool; }
+	ServerStats get_stats(int server) const;
+
+// operations
+public:
+
+	// add a server to a tier and return its index
+	int add_server(const ServerAddr& server, int tier = 0, bool use_ssl = false) throw(std::runtime_error);
+	int add_server(const ServerAddr& server, int tier, const ConnectionPool::Factory& factory);
+
+	// request articles with BODY, calling 'handler' for the ones found, or with STAT,
+	// the articles are pipelined on one connection to each server in turn
+	SegmentResult body(const std::string& message_id, const BodyHandler& handler) throw(std::runtime_error);
+	std::vector<SegmentResult> body(const std::vector<std::string>& message_ids, const BodyHandler& handler)
+		throw(std::runtime_error);
+	SegmentResult stat(const std::string& message_id) throw(std::runtime_error);
+	std::vector<SegmentResult> stat(const std::vector<std::string>& message_ids) throw(std::runtime_error);
+
+	// close the idle connections of the servers in 'min_tier' and after,
+	// which lets the fill servers sleep again
+	void close_idle(int min_tier = 1);
+
+	ServerGroup& operator =(const ServerGroup&) = delete;
+
+// implementation
+protected:
+
+	struct Server
+	{
+		std::unique_ptr<ConnectionPool> pool;
+		int tier;
+		ServerStats stats;
+	};
+
+	int insert(std::unique_ptr<ConnectionPool>&& pool, int tier);
+
+	std::vector<SegmentResult> request(PipelineRequest::Command command, const std::vector<std::string>& message_ids,
+		const BodyHandler& handler) throw(std::runtime_error);
+	std::vector<size_t> request_from(int server, PipelineRequest::Command command, const std::vector<std::string>& message_ids,
+		const std::vector<size_t>& pending, std::vector<SegmentResult>& results, const BodyHandler& handler)
+		throw(std::runtime_error);
+
+	std::vector<Server> m_servers;
+
+	// server indexes in the order they're asked, by tier and then as added
+	std::vector<int> m_order;
+
+	mutable std::mutex m_stats_mutex;
+};
+
+}	// NntpClient
+
+#endif	/* __NNTP_SERVER_GROUP_HEADER__ */
@@ -0,0 +1,93 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __UUDECODE_HEADER__
+#define __UUDECODE_HEADER__
+
+#include <string>
+#include <libusenet/yenc.h>
+
+/*
+ * Line by line decoder for uuencoded data, with the same conventions as
+ * yEnc::Decoder: the "begin" line is the header, each data line is decoded
+ * to the caller's buffer and the "end" line completes the file.
+ */
+class UUDecoder
+{
+// construction
+public:
+
+	UUDecoder();
+	UUDecoder(const UUDecoder&) = default;
+	UUDecoder(UUDecoder&&) = default;
+	virtual ~UUDecoder();
+
+// attributes
+public:
+
+	unsigned int get_lines() const { return m_line; }
+
+	const std::string& get_file_name() const { return m_name; }
+	unsigned int get_mode() const { return m_mode; }
+
+	// the size from the optional "size" line after "end", 0 if there is none
+	unsigned long get_size() const { return m_size; }
+
+	unsigned long get_decoded_size() const { return m_decoded_size; }
+	unsigned int get_actual_crc32() const { return m_calc_crc32.get_value(); }
+
+// operations
+public:
+
+	bool is_header() const { return m_header; }
+	bool is_trailer() const { return m_trailer; }
+
+	// true if a data line had a bad length char or a char outside of the
+	// uuencode alphabet
+	bool is_truncated() const { return m_truncated; }
+
+	void reset();
+
+	// pBuf needs room for 45 bytes, the most that a line can hold
+	yEnc::DecodeResult decode(unsigned char **ppMem, const char *encoded_line, int len);
+	yEnc::DecodeResult decode(unsigned char *pBuf, int *pLen, const char *encoded_line, int len);
+
+	UUDecoder& operator =(const UUDecoder&) = default;
+	UUDecoder& operator =(UUDecoder&&) = default;
+
+// implementation
+protected:
+
+	bool decode_begin_line(const char *encoded_line, int len);
+	long decode_line(unsigned char *pBuf, const char *encoded_line, int len);
+
+	unsigned int m_line;
+	unsigned int m_mode;
+	std::string m_name;
+	unsigned long m_size;
+	unsigned long m_decoded_size;
+
+	bool m_header;
+	bool m_trailer;
+	bool m_truncated;
+
+	Crc32 m_calc_crc32;
+};
+
+#endif	/* __UUDECODE_HEADER__ */
@@ -24,33 +24,66 @@
 #include <functional>
 #include <bitset>
 #include <string>
+#include <vector>
 #include <iostream>
 #include "crc32.h"
 
 namespace yEnc {
 
 // encode from the file given in filename to the given output stream
-// the name keyword of =ybegin header is set to the value of filename
-void encode_file(const std::string& path, std::ostream& out, int line_size = 128)
+// the name keyword of =ybegin header is set to the value of filename.
+// A regular file is read through a read-only mapping, unless 'map_input' is
+// false, and must not be truncated while it is encoded, which would raise a
+// SIGBUS; without the mapping it is read with pread and a truncation is an
+// error
+void encode_file(const std::string& path, std::ostream& out, int line_size = 128, bool map_input = true)
 	throw(std::runtime_error);
 
-void encode_file_for_usenet(const std::string& path, std::ostream& out, int line_size/* = 128*/)
+void encode_file_for_usenet(const std::string& path, std::ostream& out, int line_size/* = 128*/, bool map_input = true)
 	throw(std::runtime_error);
 
 void encode_file(
 	const std::string& path,
 	std::ostream& out,
 	std::ostream& (*end_line)(std::ostream&),
-	int line_size = 128)
+	int line_size = 128,
+	bool map_input = true)
 throw(std::runtime_error);
 
 void encode_file_for_usenet(
 	const std::string& path,
 	std::ostream& out,
 	std::ostream& (*end_line)(std::ostream&),
-	int line_size = 128)
+	int line_size = 128,
+	bool map_input = true)
 throw(std::runtime_error);
 
+// called with the complete, usenet ready (CRLF and dot-stuffed) body of
+// each part of a multi-part encode; part_num is 1 based and the calls come
+// from the encoding threads in no particular order
+typedef std::function<void(unsigned int part_num, const char *p_data, unsigned long len)> PartHandler;
+
+// encode the file as parts of 'part_size' bytes on 'num_threads' threads
+// (0 for one per hardware thread), each part has =ypart and pcrc32 and all
+// carry the crc32 of the whole file, which is also returned.  An empty file
+// is one article without =ypart.  'map_input' is as for encode_file
+uint32_t encode_file_parts(
+	const std::string& path,
+	unsigned long part_size,
+	const PartHandler& handler,
+	int line_size = 128,
+	unsigned int num_threads = 0,
+	bool map_input = true)
+throw(std::runtime_error);
+
+/*
+ * Line ending and dot-stuffing policies for the Encoder buffer API
+ */
+struct LineEndLF { static const int size = 1; };
+struct LineEndCRLF { static const int size = 2; };
+struct NoDotStuffing { static const bool enabled = false; };
+struct DotStuffing { static const bool enabled = true; };
+
 /*
  *
  */
@@ -77,6 +110,13 @@ public:
 
 	void set_endl(std::ostream& (*end_line)(std::ostream&));
 
+	// the largest number of chars that encoding 'len' bytes can produce, which
+	// is the buffer size needed by encode_buffer
+	static unsigned long get_max_encoded_size(unsigned long len, int line_size, int eol_size = LineEndCRLF::size);
+
+	// the CRC of the bytes encoded since encode_init
+	uint32_t get_crc32() const			{ return m_crc32.get_value(); }
+
 // operations
 public:
 
@@ -88,8 +128,15 @@ public:
 		unsigned long part_end = 0,
 		unsigned int parts_total = 0);
 
-	void encode_chunk(std::ostream& out, void *p_bytes, unsigned int len);
-	void encode_usenet_chunk(std::ostream& out, void *p_bytes, unsigned int len);
+	void encode_chunk(std::ostream& out, const void *p_bytes, unsigned int len);
+	void encode_usenet_chunk(std::ostream& out, const void *p_bytes, unsigned int len);
+
+	// encode into p_dst, which has room for get_max_encoded_size chars, and return
+	// the number of chars written; the line ending is LineEndLF or LineEndCRLF and
+	// dot-stuffing is NoDotStuffing or DotStuffing (usenet)
+	template<typename LineEnd, typename Dots>
+	unsigned long encode_buffer(char *p_dst, unsigned long dst_len, const void *p_bytes, unsigned long len)
+		throw(std::length_error);
 
 	void encode_close(std::ostream& out);
 	void encode_close(std::ostream& out, unsigned int total_crc32);
@@ -97,6 +144,9 @@ public:
 // implementation
 protected:
 
+	template<typename Dots>
+	void write_chunk(std::ostream& out, const void *p_bytes, unsigned int len);
+
 	// header/trailer info
 	int m_line_size;
 	std::string m_kw_name;
@@ -109,10 +159,38 @@ protected:
 	Crc32 m_crc32;
 
 	std::ostream& (*m_endl)(std::ostream&);
+
+	// encoded output for the ostream API
+	std::vector<char> m_obuf;
 };
 
 enum class DecodeResult { YENC_NONE, YENC_DATA, YENC_COMPLETE, YENC_TRUNCATED, };
 
+// why a range of the decoded data of a part is suspect
+enum class Damage
+{
+	SHORT_LINE,			// a data line, not the last, is shorter than line=
+	LONG_LINE,			// a data line is longer than line= and a trailing escape
+	TRUNCATED_LINE,		// a data line ends with an escape char
+	MISPLACED_DATA,		// the data after a short or long line, when the size is wrong
+	MISSING_DATA,		// the end of the part, when the article ends early
+	SIZE_MISMATCH,		// the size is wrong and no line accounts for it
+	CRC_MISMATCH,		// the CRC is wrong and no line accounts for it
+	BAD_KEYWORDS,		// the =ybegin, =ypart and =yend sizes don't agree
+};
+
+/*
+ * A suspect range of decoded data, as offsets from the start of the part,
+ * end is one past the last byte
+ */
+struct DamageRange
+{
+	unsigned long begin;
+	unsigned long end;
+	unsigned int line;		// the 1 based data line, 0 if the range isn't one line
+	Damage reason;
+};
+
 /*
  *
  */
@@ -147,6 +225,15 @@ public:
 
 	unsigned int get_actual_crc32() const { return m_calc_crc32.get_value(); }
 
+	// the number of bytes decoded and data lines seen, by any of the decode functions
+	unsigned long get_decoded_size() const { return m_data_size; }
+	unsigned int get_data_lines() const { return m_data_lines; }
+
+	// output buffer for feed, decoded data is written from the start of the buffer
+	void set_output(unsigned char *pBuf, unsigned long buflen) { m_out_buf = pBuf; m_out_size = buflen; m_out_len = 0; }
+	unsigned long get_output_length() const { return m_out_len; }
+	unsigned long get_output_room() const { return m_out_size - m_out_len; }
+
 // operations
 public:
 
@@ -155,9 +242,43 @@ public:
 	bool is_trailer() const { return m_part_flags[YENC_TRAILER]; }
 	bool is_crc32() const { return m_part_flags[YENC_CRC32]; }
 
+	// true once decode_body or feed has seen the ".\r\n" end of the NNTP body
+	bool is_body_end() const { return m_part_flags[YENC_BODY_END]; }
+
+	// true if feed has seen a data line which ended with an escape char
+	bool is_truncated() const { return m_part_flags[YENC_TRUNCATED_LINE]; }
+
 	DecodeResult decode(unsigned char **ppMem, const char *encoded_line, int len);
 	DecodeResult decode(unsigned char *pBuf, int *pLen, const char *encoded_line, int len);
 
+	// add the CRC of the decoded data to the whole file CRC, at the offset given
+	// by =ypart begin, returns false if it overlaps a part already added
+	bool add_part_crc(Crc32Combiner& file_crc) const;
+
+	// true if the =ybegin size, the =ypart begin/end and the =yend size and part agree
+	bool is_consistent() const;
+
+	// get the suspect ranges of the decoded part, from the length of each data line
+	// against line= and the sizes and CRC in the keyword lines, so that a repair
+	// can target them; empty if the CRC matches or nothing is known to be wrong
+	std::vector<DamageRange> get_damage() const;
+
+	// decode raw NNTP BODY data, as read from the server, in one pass: the lines are
+	// split at "\r\n", the NNTP dot-stuffing is removed, keyword lines are parsed and
+	// the data lines are decoded to pBuf with *pLen incremented by the decoded size.
+	// 'raw' can be the whole body or any part of it, *pUsed is set to the number of
+	// bytes used, which is short of 'len' by a partial last line or by the data after
+	// the ".\r\n" end of the body.  pBuf needs room for 'len' bytes.
+	DecodeResult decode_body(
+		unsigned char *pBuf, unsigned long *pLen, const char *raw, unsigned long len, unsigned long *pUsed);
+
+	// streaming decode of raw NNTP BODY data which can be split at any point, such
+	// as the buffers from recv() or SSL_read().  A pending escape, a partial keyword
+	// line and the CR/LF/dot state are kept between calls, the data is decoded to the
+	// set_output buffer.  *pUsed, if given, is short of 'len' after the end of the
+	// body or when the output buffer is full.
+	DecodeResult feed(const char *data, size_t len, size_t *pUsed = nullptr);
+
 	Decoder& operator =(const Decoder&) = default;
 	Decoder& operator =(Decoder&&) = default;
 
@@ -167,6 +288,21 @@ protected:
 	bool is_kw_line(const char *encoded_line, int enclen);
 	int decode_kw_line(const char *encoded_line, int enclen);
 
+	// record a data line of 'enclen' chars which decoded to 'declen' bytes at
+	// 'offset', 'stuffed' when a doubled '.' was removed from its start
+	void check_line(unsigned long offset, unsigned long declen, long enclen, bool truncated, bool stuffed);
+
+	struct LineInfo
+	{
+		unsigned int number;
+		unsigned long offset;
+		unsigned long length;
+		long enclen;
+		bool truncated;
+		bool stuffed;
+	};
+	bool get_line_damage(const LineInfo& line, bool is_last, DamageRange *p_range) const;
+
 	// keyword values
 	unsigned int m_line;
 	unsigned long m_head_size;
@@ -184,9 +320,29 @@ protected:
 
 	// decode bookkeeping
 	Crc32 m_calc_crc32;
+	unsigned long m_data_size;
+	unsigned int m_data_lines;
+
+	// damaged lines, the last line is held back as it may be short
+	std::vector<DamageRange> m_damage;
+	LineInfo m_last_line;
+
+	// feed state
+	enum FeedState { FEED_LINE_START, FEED_DOT, FEED_DOT_CR, FEED_EQ, FEED_KEYWORD, FEED_DATA, FEED_DATA_CR, FEED_END, };
+	FeedState m_feed_state;
+	int m_escape;
+	std::string m_kw_line;
+	unsigned long m_feed_line_offset;
+	long m_feed_line_chars;
+	bool m_feed_line_stuffed;
+
+	// feed output
+	unsigned char *m_out_buf;
+	unsigned long m_out_size;
+	unsigned long m_out_len;
 
 	// flags for indicating which yEnc items have been parsed
-	enum { YENC_HEADER, YENC_TRAILER, YENC_PART_HEADER, YENC_CRC32, YENC_COUNT, };
+	enum { YENC_HEADER, YENC_TRAILER, YENC_PART_HEADER, YENC_CRC32, YENC_PART_CRC32, YENC_BODY_END, YENC_TRUNCATED_LINE, YENC_COUNT, };
 	std::bitset<YENC_COUNT> m_part_flags;
 };
 
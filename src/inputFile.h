@@ -0,0 +1,86 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __INPUT_FILE_HEADER__
+#define __INPUT_FILE_HEADER__
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace yEnc {
+
+/*
+ * Read-only input for the encode_file family.  A regular file is mapped and
+ * read in place, so it must not be truncated while it is read, as reading
+ * the mapping past its new end raises a SIGBUS.  A file that isn't to be
+ * mapped, or can't be, is read through a buffer with pread, and a pipe or
+ * other stream is read into memory when opened, as its size is needed for
+ * the =ybegin header before anything is encoded.
+ */
+class InputFile
+{
+// construction
+public:
+
+	explicit InputFile(const std::string& path, bool is_mapped = true) throw(std::runtime_error);
+	InputFile(const InputFile&) = delete;
+	~InputFile();
+
+// attributes
+public:
+
+	unsigned long get_size() const { return m_size; }
+
+	// true if the whole file is addressable without copying, so read_at
+	// never uses the caller's buffer
+	bool is_in_memory() const { return nullptr != m_data; }
+
+	bool is_mapped() const { return nullptr != m_map; }
+
+// operations
+public:
+
+	// set *pp_data to the next 'len' or fewer bytes of the file and return
+	// their count, 0 at the end of the file
+	unsigned long read(const char **pp_data, unsigned long len) throw(std::runtime_error);
+
+	// get 'len' bytes at 'offset', which are read into p_buf, which has room
+	// for 'len' bytes, unless is_in_memory; safe to call from many threads
+	const char *read_at(char *p_buf, unsigned long len, unsigned long offset) const throw(std::runtime_error);
+
+	InputFile& operator =(const InputFile&) = delete;
+
+// implementation
+protected:
+
+	std::string m_path;
+	int m_fd;
+	unsigned long m_size;
+	unsigned long m_offset;
+
+	// the mapping, or the whole of a stream input
+	void *m_map;
+	const char *m_data;
+	std::vector<char> m_buf;
+};
+
+}	/* namespace yEnc */
+
+#endif	/* __INPUT_FILE_HEADER__ */
@@ -0,0 +1,178 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include "inputFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace yEnc {
+
+#define INPUT_READ_LEN		(1024 * 64)
+#define HUGE_PAGE_LEN		(1024 * 1024 * 2)
+
+// the page size, for the read ahead of a part
+static const uintptr_t s_page_size = sysconf(_SC_PAGESIZE);
+
+InputFile::InputFile(const std::string& path, bool is_mapped/* = true*/)
+throw(std::runtime_error)
+:	m_path(path), m_fd(-1), m_size(0), m_offset(0), m_map(nullptr), m_data(nullptr), m_buf()
+{
+	m_fd = ::open(path.c_str(), O_RDONLY);
+	if(-1 == m_fd)
+		throw std::runtime_error("Cannot open file: " + path);
+
+	struct stat statbuf;
+	if(0 != fstat(m_fd, &statbuf))
+	{
+		register int result = errno;
+		::close(m_fd);
+		throw std::runtime_error("Cannot stat file: " + path + ": " + strerror(result));
+	}
+
+	if(S_ISREG(statbuf.st_mode))
+	{
+		m_size = statbuf.st_size;
+		if(0 == m_size)
+		{
+			m_data = "";
+			return;
+		}
+
+		// a file not to be mapped, or a failed mapping, is read with pread
+		if(!is_mapped)
+			return;
+		void *p_map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+		if(MAP_FAILED == p_map)
+			return;
+
+		m_map = p_map;
+		m_data = (const char*)p_map;
+
+#ifdef MADV_HUGEPAGE
+		// huge pages for a file mapping need a kernel with read-only file
+		// THP, other kernels ignore or reject the hint, which is harmless
+		if(m_size >= HUGE_PAGE_LEN)
+			madvise(m_map, m_size, MADV_HUGEPAGE);
+#endif
+		return;
+	}
+
+	// a pipe or device has no size until it is read to the end
+	for(;;)
+	{
+		const unsigned long used = m_buf.size();
+		m_buf.resize(used + INPUT_READ_LEN);
+
+		ssize_t rdsz = ::read(m_fd, &m_buf[used], INPUT_READ_LEN);
+		if(rdsz < 0)
+		{
+			if(EINTR == errno)
+			{
+				m_buf.resize(used);
+				continue;
+			}
+			register int result = errno;
+			::close(m_fd);
+			throw std::runtime_error("Cannot read file: " + path + ": " + strerror(result));
+		}
+
+		m_buf.resize(used + rdsz);
+		if(0 == rdsz)
+			break;
+	}
+
+	::close(m_fd);
+	m_fd = -1;
+
+	m_size = m_buf.size();
+	m_data = m_buf.empty() ? "" : &m_buf[0];
+}
+
+InputFile::~InputFile()
+{
+	if(nullptr != m_map)
+		munmap(m_map, m_size);
+	if(-1 != m_fd)
+		::close(m_fd);
+}
+
+unsigned long InputFile::read(const char **pp_data, unsigned long len)
+throw(std::runtime_error)
+{
+	len = std::min(len, m_size - m_offset);
+	if(0 == len)
+		return 0;
+
+	// read front to back, the kernel can read ahead aggressively and drop
+	// the pages behind
+	if((0 == m_offset) && (nullptr != m_map))
+		madvise(m_map, m_size, MADV_SEQUENTIAL);
+
+	if(nullptr != m_data)
+		*pp_data = m_data + m_offset;
+	else
+	{
+		if(m_buf.size() < len)
+			m_buf.resize(len);
+		*pp_data = read_at(&m_buf[0], len, m_offset);
+	}
+
+	m_offset += len;
+	return len;
+}
+
+const char *InputFile::read_at(char *p_buf, unsigned long len, unsigned long offset) const
+throw(std::runtime_error)
+{
+	if(nullptr != m_data)
+	{
+		// the parts are read by many threads at once, so read each ahead
+		if(nullptr != m_map)
+		{
+			const uintptr_t begin = (uintptr_t)m_data + offset;
+			const uintptr_t page = begin & ~(s_page_size - 1);
+			madvise((void*)page, (begin - page) + len, MADV_WILLNEED);
+		}
+		return m_data + offset;
+	}
+
+	char *p_dst = p_buf;
+	while(len > 0)
+	{
+		ssize_t rdsz = pread(m_fd, p_dst, len, offset);
+		if(rdsz <= 0)
+		{
+			if((-1 == rdsz) && (EINTR == errno))
+				continue;
+			throw std::runtime_error("Cannot read file: " + m_path + ": " + strerror((0 == rdsz) ? EIO : errno));
+		}
+		p_dst += rdsz;
+		offset += rdsz;
+		len -= rdsz;
+	}
+
+	return p_buf;
+}
+
+}	/* namespace yEnc */
@@ -0,0 +1,152 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __IO_URING_HEADER__
+#define __IO_URING_HEADER__
+
+#include <libusenet/options.h>
+
+#ifdef LIBUSENET_USE_IO_URING
+
+#include <cstdint>
+#include <system_error>
+#include <linux/io_uring.h>
+
+namespace NntpClient { namespace Uring {
+
+/*
+ * A minimal io_uring, on the kernel interface, for the reactor and the
+ * downloader's output writes.  It is used from one thread at a time.
+ */
+class Ring
+{
+// construction
+public:
+
+	// throws if the kernel doesn't have io_uring, or the features used here
+	explicit Ring(unsigned int entries) throw(std::system_error);
+	Ring(const Ring&) = delete;
+	~Ring();
+
+// attributes
+public:
+
+	int get_fd() const { return m_fd; }
+
+// operations
+public:
+
+	// get a cleared submission entry, submitting the ones queued when the queue is full
+	io_uring_sqe *get_sqe() throw(std::system_error);
+
+	// submit the queued entries and wait for at least 'wait_nr' completions,
+	// or until 'timeout_ms' has passed when it isn't -1
+	void submit(unsigned int wait_nr = 0, int timeout_ms = -1) throw(std::system_error);
+
+	// the next completion, or nullptr, which is kept until seen
+	io_uring_cqe *peek_cqe();
+	void cqe_seen();
+
+	Ring& operator =(const Ring&) = delete;
+
+// implementation
+protected:
+
+	void unmap();
+
+	int m_fd;
+	unsigned int m_features;
+
+	void *m_sq_ptr;
+	size_t m_sq_size;
+	void *m_cq_ptr;
+	size_t m_cq_size;
+	io_uring_sqe *m_sqes;
+	size_t m_sqes_size;
+
+	unsigned int *m_sq_head;
+	unsigned int *m_sq_tail;
+	unsigned int m_sq_mask;
+	unsigned int m_sq_entries;
+	unsigned int *m_sq_array;
+	unsigned int m_sqe_tail;
+
+	unsigned int *m_cq_head;
+	unsigned int *m_cq_tail;
+	unsigned int m_cq_mask;
+	io_uring_cqe *m_cqes;
+};
+
+/*
+ * A ring of provided buffers registered with a Ring, which the kernel picks
+ * from for the receives with IOSQE_BUFFER_SELECT and the group id
+ */
+class BufferRing
+{
+// construction
+public:
+
+	BufferRing(Ring& ring, uint16_t group, unsigned int count, unsigned int size) throw(std::system_error);
+	BufferRing(const BufferRing&) = delete;
+	~BufferRing();
+
+// attributes
+public:
+
+	uint16_t get_group() const { return m_group; }
+	unsigned int get_size() const { return m_size; }
+
+	const char *get_buffer(uint16_t bid) const { return m_bufs + ((size_t)bid * m_size); }
+
+// operations
+public:
+
+	// give a buffer back to the kernel once its data has been used
+	void recycle(uint16_t bid);
+
+	BufferRing& operator =(const BufferRing&) = delete;
+
+// implementation
+protected:
+
+	Ring& m_ring;
+	uint16_t m_group;
+	unsigned int m_count;
+	unsigned int m_size;
+	io_uring_buf_ring *m_br;
+	size_t m_br_size;
+	char *m_bufs;
+	uint16_t m_tail;
+};
+
+} }	/* namespace NntpClient::Uring */
+
+#else
+
+namespace NntpClient { namespace Uring {
+
+// only declared for the owners of a ring, which never have one without io_uring
+class Ring {};
+class BufferRing {};
+
+} }	/* namespace NntpClient::Uring */
+
+#endif	/* LIBUSENET_USE_IO_URING */
+
+#endif	/* __IO_URING_HEADER__ */
@@ -0,0 +1,232 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include "ioUring.h"
+
+#ifdef LIBUSENET_USE_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace NntpClient { namespace Uring {
+
+static inline std::system_error __error(int error)
+{
+	return std::system_error(std::error_code(error, std::system_category()), strerror(error));
+}
+
+Ring::Ring(unsigned int entries)
+throw(std::system_error)
+:	m_fd(-1), m_features(0), m_sq_ptr(MAP_FAILED), m_sq_size(0), m_cq_ptr(MAP_FAILED), m_cq_size(0),
+	m_sqes((io_uring_sqe*)MAP_FAILED), m_sqes_size(0), m_sq_head(nullptr), m_sq_tail(nullptr), m_sq_mask(0),
+	m_sq_entries(0), m_sq_array(nullptr), m_sqe_tail(0), m_cq_head(nullptr), m_cq_tail(nullptr), m_cq_mask(0),
+	m_cqes(nullptr)
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CLAMP;
+	m_fd = syscall(__NR_io_uring_setup, entries, &params);
+	if(-1 == m_fd)
+		throw __error(errno);
+
+	// waiting with a timeout needs EXT_ARG, and completions must not be dropped
+	m_features = params.features;
+	if((IORING_FEAT_EXT_ARG|IORING_FEAT_NODROP) != (m_features & (IORING_FEAT_EXT_ARG|IORING_FEAT_NODROP)))
+	{
+		unmap();
+		throw __error(ENOSYS);
+	}
+
+	m_sq_size = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+	m_cq_size = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+	if(0 != (m_features & IORING_FEAT_SINGLE_MMAP))
+		m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+	m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+	m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if(MAP_FAILED != m_sq_ptr)
+	{
+		if(0 != (m_features & IORING_FEAT_SINGLE_MMAP))
+			m_cq_ptr = m_sq_ptr;
+		else
+			m_cq_ptr = mmap(nullptr, m_cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+	}
+	if(MAP_FAILED != m_cq_ptr)
+		m_sqes = (io_uring_sqe*)mmap(nullptr, m_sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_SQES);
+	if(MAP_FAILED == (void*)m_sqes)
+	{
+		const int error = errno;
+		unmap();
+		throw __error(error);
+	}
+
+	char *p_sq = (char*)m_sq_ptr;
+	m_sq_head = (unsigned int*)(p_sq + params.sq_off.head);
+	m_sq_tail = (unsigned int*)(p_sq + params.sq_off.tail);
+	m_sq_mask = *(unsigned int*)(p_sq + params.sq_off.ring_mask);
+	m_sq_entries = params.sq_entries;
+	m_sq_array = (unsigned int*)(p_sq + params.sq_off.array);
+	m_sqe_tail = *m_sq_tail;
+
+	// the entries are always queued in order, so the index array is fixed
+	for(unsigned int i = 0; i < m_sq_entries; ++i)
+		m_sq_array[i] = i;
+
+	char *p_cq = (char*)m_cq_ptr;
+	m_cq_head = (unsigned int*)(p_cq + params.cq_off.head);
+	m_cq_tail = (unsigned int*)(p_cq + params.cq_off.tail);
+	m_cq_mask = *(unsigned int*)(p_cq + params.cq_off.ring_mask);
+	m_cqes = (io_uring_cqe*)(p_cq + params.cq_off.cqes);
+}
+
+Ring::~Ring()
+{
+	unmap();
+}
+
+void Ring::unmap()
+{
+	if(MAP_FAILED != (void*)m_sqes)
+		munmap(m_sqes, m_sqes_size);
+	if((MAP_FAILED != m_cq_ptr) && (m_cq_ptr != m_sq_ptr))
+		munmap(m_cq_ptr, m_cq_size);
+	if(MAP_FAILED != m_sq_ptr)
+		munmap(m_sq_ptr, m_sq_size);
+	if(m_fd >= 0)
+		::close(m_fd);
+}
+
+io_uring_sqe *Ring::get_sqe()
+throw(std::system_error)
+{
+	if((m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE)) >= m_sq_entries)
+	{
+		submit();
+		if((m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE)) >= m_sq_entries)
+			throw __error(EBUSY);
+	}
+
+	io_uring_sqe *p_sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+	memset(p_sqe, 0, sizeof(*p_sqe));
+	++m_sqe_tail;
+	return p_sqe;
+}
+
+void Ring::submit(unsigned int wait_nr/* = 0*/, int timeout_ms/* = -1*/)
+throw(std::system_error)
+{
+	__atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+	const unsigned int to_submit = m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+
+	unsigned int flags = (0 != wait_nr) ? IORING_ENTER_GETEVENTS : 0;
+	__kernel_timespec ts;
+	io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	if((0 != wait_nr) && (timeout_ms >= 0))
+	{
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+		arg.sigmask_sz = _NSIG / 8;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+
+	if((0 == to_submit) && (0 == wait_nr))
+		return;
+
+	// a timeout, a signal or a full completion queue return to let the caller reap
+	if(-1 == syscall(__NR_io_uring_enter, m_fd, to_submit, wait_nr, flags,
+			(0 != (flags & IORING_ENTER_EXT_ARG)) ? (void*)&arg : nullptr, sizeof(arg)))
+	{
+		if((ETIME != errno) && (EINTR != errno) && (EBUSY != errno) && (EAGAIN != errno))
+			throw __error(errno);
+	}
+}
+
+io_uring_cqe *Ring::peek_cqe()
+{
+	const unsigned int head = *m_cq_head;
+	if(head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+		return nullptr;
+	return &m_cqes[head & m_cq_mask];
+}
+
+void Ring::cqe_seen()
+{
+	__atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+BufferRing::BufferRing(Ring& ring, uint16_t group, unsigned int count, unsigned int size)
+throw(std::system_error)
+:	m_ring(ring), m_group(group), m_count(count), m_size(size), m_br((io_uring_buf_ring*)MAP_FAILED),
+	m_br_size(count * sizeof(io_uring_buf)), m_bufs(nullptr), m_tail(0)
+{
+	// the count has to be a power of 2
+	if((0 == count) || (0 != (count & (count - 1))) || (count > 32768))
+		throw __error(EINVAL);
+
+	m_br = (io_uring_buf_ring*)mmap(nullptr, m_br_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(MAP_FAILED == (void*)m_br)
+		throw __error(errno);
+
+	io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)m_br;
+	reg.ring_entries = count;
+	reg.bgid = group;
+	if(-1 == syscall(__NR_io_uring_register, ring.get_fd(), IORING_REGISTER_PBUF_RING, &reg, 1))
+	{
+		const int error = errno;
+		munmap(m_br, m_br_size);
+		throw __error(error);
+	}
+
+	m_bufs = new char[(size_t)count * size];
+	for(unsigned int i = 0; i < count; ++i)
+		recycle(i);
+}
+
+BufferRing::~BufferRing()
+{
+	io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.bgid = m_group;
+	syscall(__NR_io_uring_register, m_ring.get_fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+	munmap(m_br, m_br_size);
+	delete [] m_bufs;
+}
+
+void BufferRing::recycle(uint16_t bid)
+{
+	// the kernel's flexible array of bufs isn't at offset 0 when compiled as C++
+	io_uring_buf *p_buf = (io_uring_buf*)m_br + (m_tail & (m_count - 1));
+	p_buf->addr = (uint64_t)(uintptr_t)(m_bufs + ((size_t)bid * m_size));
+	p_buf->len = m_size;
+	p_buf->bid = bid;
+	__atomic_store_n(&m_br->tail, ++m_tail, __ATOMIC_RELEASE);
+}
+
+} }	/* namespace NntpClient::Uring */
+
+#endif	/* LIBUSENET_USE_IO_URING */
@@ -0,0 +1,131 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include <libusenet/latency.h>
+
+#include <algorithm>
+#include <cmath>
+
+// the least time to wait on the server, which covers the odd slow response
+#define LATENCY_MIN_TIMEOUT		5.0
+
+namespace NetStream {
+
+Latency::Latency(double max_timeout/* = 0*/)
+:	m_srtt(0), m_rttvar(0), m_samples(0), m_ttfb(0), m_bandwidth(0), m_response_size(0),
+	m_min_timeout(LATENCY_MIN_TIMEOUT), m_max_timeout(max_timeout),
+	m_sent(), m_last_sent(), m_last_received(), m_first_byte(), m_response_bytes(0),
+	m_bytes(0), m_response_start(), m_response_start_bytes(0)
+{
+}
+
+double Latency::get_timeout() const
+{
+	if((0 == m_samples) || (m_max_timeout <= 0))
+		return m_max_timeout;
+
+	// RFC 6298: RTO = SRTT + 4 * RTTVAR
+	return std::min(m_max_timeout, std::max(m_min_timeout, m_srtt + (4 * m_rttvar)));
+}
+
+void Latency::sent(bool is_idle/* = true*/, clock::time_point now/* = clock::now()*/)
+{
+	m_last_sent = now;
+	if(!is_idle || is_waiting())
+		return;
+
+	// the response before has all been received, which gives its receive rate
+	if(m_response_bytes > 0)
+	{
+		const double elapsed = std::chrono::duration<double>(m_last_received - m_first_byte).count();
+		if(elapsed > 0)
+			add_bandwidth(m_response_bytes / elapsed);
+		m_response_bytes = 0;
+	}
+
+	m_sent = now;
+}
+
+double Latency::received(size_t len, clock::time_point now/* = clock::now()*/)
+{
+	m_last_received = now;
+	m_bytes += len;
+	if(!is_waiting())
+	{
+		// the rate is of the bytes after the first read, over the time after it
+		if(clock::time_point() != m_first_byte)
+			m_response_bytes += len;
+		return 0;
+	}
+
+	const double ttfb = std::chrono::duration<double>(now - m_sent).count();
+	m_ttfb = (0 == m_ttfb) ? ttfb : (m_ttfb + ((ttfb - m_ttfb) / 8));
+	m_sent = clock::time_point();
+	m_first_byte = now;
+	m_response_bytes = 0;
+	return ttfb;
+}
+
+void Latency::response_started(bool is_more, clock::time_point now/* = clock::now()*/)
+{
+	// the bytes received while the pipeline was busy are the response before
+	if(clock::time_point() != m_response_start)
+	{
+		const double elapsed = std::chrono::duration<double>(now - m_response_start).count();
+		const double bytes = m_bytes - m_response_start_bytes;
+		if(elapsed > 0)
+		{
+			add_bandwidth(bytes / elapsed);
+			m_response_size = (0 == m_response_size) ? bytes : (m_response_size + ((bytes - m_response_size) / 8));
+		}
+	}
+
+	m_response_start = is_more ? now : clock::time_point();
+	m_response_start_bytes = m_bytes;
+}
+
+void Latency::add_sample(double rtt)
+{
+	// RFC 6298, the first sample sets the mean deviation to half of it and
+	// after that they're smoothed by 1/4 and 1/8
+	if(0 == m_samples++)
+	{
+		m_srtt = rtt;
+		m_rttvar = rtt / 2;
+	}
+	else
+	{
+		m_rttvar += (std::fabs(m_srtt - rtt) - m_rttvar) / 4;
+		m_srtt += (rtt - m_srtt) / 8;
+	}
+}
+
+void Latency::add_bandwidth(double bandwidth)
+{
+	m_bandwidth = (0 == m_bandwidth) ? bandwidth : (m_bandwidth + ((bandwidth - m_bandwidth) / 8));
+}
+
+void Latency::reset()
+{
+	const double min_timeout = m_min_timeout, max_timeout = m_max_timeout;
+	*this = Latency(max_timeout);
+	m_min_timeout = min_timeout;
+}
+
+}	/* namespace NetStream */
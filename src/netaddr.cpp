@@ -0,0 +1,342 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include <libusenet/netaddr.h>
+
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+
+// seconds a resolved address, and a failure to resolve one, is used for
+#define RESOLVER_TTL			300
+#define RESOLVER_ERROR_TTL		10
+
+namespace NetStream {
+
+int lookup(const char *node, const char *service, SockAddrList& addrs,
+	std::string *p_canon_name/* = nullptr*/, int flags/* = 0*/)
+{
+	addrinfo hints, *p_addr_info = nullptr;
+
+	// set up the hints structure for both IPv6 and IPv4
+	memset(&hints, 0, sizeof(addrinfo));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	hints.ai_flags = flags | AI_CANONNAME;
+
+	int result = getaddrinfo(node, service, &hints, &p_addr_info);
+	if(0 != result)
+		return result;
+
+	if((nullptr != p_canon_name) && (nullptr != p_addr_info->ai_canonname))
+		p_canon_name->assign(p_addr_info->ai_canonname);
+
+	// getaddrinfo has them sorted (RFC 6724), which is kept for each family with
+	// the family of the first address first and the two taking turns after it
+	SockAddrList first, second;
+	for(addrinfo *p_info = p_addr_info; nullptr != p_info; p_info = p_info->ai_next)
+	{
+		if((p_info->ai_addrlen > sizeof(sockaddr_storage)) || ((AF_INET != p_info->ai_family) && (AF_INET6 != p_info->ai_family)))
+			continue;
+
+		SockAddr addr;
+		memset(&addr.addr, 0, sizeof(addr.addr));
+		memcpy(&addr.addr, p_info->ai_addr, p_info->ai_addrlen);
+		addr.addrlen = p_info->ai_addrlen;
+		((first.empty() || (first.front().get_family() == p_info->ai_family)) ? first : second).push_back(addr);
+	}
+	freeaddrinfo(p_addr_info);
+
+	addrs.clear();
+	addrs.reserve(first.size() + second.size());
+	for(size_t i = 0; (i < first.size()) || (i < second.size()); ++i)
+	{
+		if(i < first.size())
+			addrs.push_back(first[i]);
+		if(i < second.size())
+			addrs.push_back(second[i]);
+	}
+
+	return addrs.empty() ? EAI_FAMILY : 0;
+}
+
+int resolve(const char *node, const char *service, SockAddrList& addrs,
+	std::string *p_canon_name/* = nullptr*/, int flags/* = 0*/)
+{
+	return Resolver::get_default().resolve(node, service, addrs, p_canon_name, flags);
+}
+
+Resolver::Resolver()
+:	m_mutex(), m_cache(), m_ttl(RESOLVER_TTL), m_error_ttl(RESOLVER_ERROR_TTL)
+{
+}
+
+Resolver& Resolver::get_default()
+{
+	static Resolver s_resolver;
+	return s_resolver;
+}
+
+int Resolver::get_ttl() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_ttl.count();
+}
+
+void Resolver::set_ttl(int seconds)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_ttl = std::chrono::seconds(seconds);
+}
+
+int Resolver::get_error_ttl() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_error_ttl.count();
+}
+
+void Resolver::set_error_ttl(int seconds)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_error_ttl = std::chrono::seconds(seconds);
+}
+
+size_t Resolver::get_size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_cache.size();
+}
+
+static bool __is_ready(const Resolver::Future& future)
+{
+	return(std::future_status::ready == future.wait_for(std::chrono::seconds(0)));
+}
+
+Resolver::Future Resolver::resolve_async(const char *node, const char *service, int flags/* = 0*/)
+throw(std::system_error)
+{
+	std::string key(node ? node : "");
+	key.append(1, '\n').append(service ? service : "").append(1, '\n').append(std::to_string(flags));
+
+	const auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Lookup& lookup = m_cache[key];
+
+	// a refresh replaces the result when it's done, unless it failed, which
+	// leaves the old addresses in use and waits the error TTL to try again
+	if(lookup.refresh.valid() && __is_ready(lookup.refresh))
+	{
+		if(0 == lookup.refresh.get().error)
+			lookup.result = lookup.refresh;
+		else
+			lookup.retry = now + m_error_ttl;
+		lookup.refresh = Future();
+	}
+
+	// wait on the lookup running, or on a new one when there's nothing to use
+	if(!lookup.result.valid())
+		lookup.result = start_lookup(node, service, flags);
+	if(!__is_ready(lookup.result))
+		return lookup.result;
+
+	const Result& result = lookup.result.get();
+	if(0 != result.error)
+	{
+		if((now - result.time) >= m_error_ttl)
+			lookup.result = start_lookup(node, service, flags);
+	}
+	else if(((now - result.time) >= m_ttl) && !lookup.refresh.valid() && (now >= lookup.retry))
+		lookup.refresh = start_lookup(node, service, flags);
+
+	return lookup.result;
+}
+
+int Resolver::resolve(const char *node, const char *service, SockAddrList& addrs,
+	std::string *p_canon_name/* = nullptr*/, int flags/* = 0*/)
+throw(std::system_error)
+{
+	Future future = resolve_async(node, service, flags);
+	const Result& result = future.get();
+	if(0 == result.error)
+	{
+		addrs = result.addrs;
+		if(nullptr != p_canon_name)
+			p_canon_name->assign(result.canon_name);
+	}
+
+	return result.error;
+}
+
+void Resolver::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cache.clear();
+}
+
+Resolver::Future Resolver::start_lookup(const char *node, const char *service, int flags)
+throw(std::system_error)
+{
+	// the thread has its own copy of the names, and only the promise to give
+	// the result to, so it can outlive the Resolver
+	std::promise<Result> promise;
+	Future future = promise.get_future().share();
+	std::thread([](std::string node, bool is_node, std::string service, bool is_service, int flags,
+		std::promise<Result> promise)
+	{
+		try
+		{
+			Result result;
+			result.error = lookup(is_node ? node.c_str() : nullptr, is_service ? service.c_str() : nullptr,
+				result.addrs, &result.canon_name, flags);
+			result.time = std::chrono::steady_clock::now();
+			promise.set_value(std::move(result));
+		}
+		catch(...)
+		{
+			promise.set_exception(std::current_exception());
+		}
+	}, std::string(node ? node : ""), (nullptr != node), std::string(service ? service : ""), (nullptr != service),
+		flags, std::move(promise)).detach();
+
+	return future;
+}
+
+int connect_race(const SockAddrList& addrs, int delay_ms/* = connect_attempt_delay*/)
+{
+	std::vector<pollfd> attempts;
+	attempts.reserve(addrs.size());
+
+	int result = -1, error = EHOSTUNREACH;
+	size_t next = 0;
+	bool is_next_due = true;
+	while(-1 == result)
+	{
+		// start a connect to the next address when the last one has had its
+		// delay or has failed
+		if(is_next_due && (next < addrs.size()))
+		{
+			const SockAddr& addr = addrs[next++];
+			is_next_due = false;
+
+			const int sock = socket(addr.get_family(), SOCK_STREAM | SOCK_NONBLOCK, 0);
+			if(-1 == sock)
+			{
+				error = errno;
+				is_next_due = true;
+				continue;
+			}
+
+			int status;
+			while((-1 == (status = ::connect(sock, addr.get(), addr.addrlen))) && (EINTR == errno))
+				;
+
+			if(0 == status)
+				result = sock;
+			else if(EINPROGRESS == errno)
+				attempts.push_back(pollfd{ sock, POLLOUT, 0 });
+			else
+			{
+				error = errno;
+				::close(sock);
+				is_next_due = true;
+			}
+			continue;
+		}
+
+		if(attempts.empty())
+		{
+			if(next < addrs.size())
+			{
+				is_next_due = true;
+				continue;
+			}
+			break;
+		}
+
+		// wait for an attempt to finish, and no longer than the delay while there are addresses left
+		const int count = poll(attempts.data(), attempts.size(), (next < addrs.size()) ? delay_ms : -1);
+		if(-1 == count)
+		{
+			if(EINTR == errno)
+				continue;
+			error = errno;
+			break;
+		}
+
+		if(0 == count)
+		{
+			is_next_due = true;
+			continue;
+		}
+
+		for(auto it = attempts.begin(); it != attempts.end();)
+		{
+			if(0 == it->revents)
+			{
+				++it;
+				continue;
+			}
+
+			int sock_error = 0;
+			socklen_t optValLen = sizeof(sock_error);
+			if(0 != getsockopt(it->fd, SOL_SOCKET, SO_ERROR, &sock_error, &optValLen))
+				sock_error = errno;
+
+			if(0 == sock_error)
+			{
+				result = it->fd;
+				it = attempts.erase(it);
+				break;
+			}
+
+			error = sock_error;
+			::close(it->fd);
+			it = attempts.erase(it);
+			is_next_due = true;
+		}
+	}
+
+	// the attempts which lost the race
+	for(auto& attempt : attempts)
+		::close(attempt.fd);
+
+	if(-1 == result)
+		errno = error;
+	else
+	{
+		const int flags = fcntl(result, F_GETFL);
+		if((-1 == flags) || (-1 == fcntl(result, F_SETFL, flags & ~O_NONBLOCK)))
+		{
+			error = errno;
+			::close(result);
+			errno = error;
+			result = -1;
+		}
+	}
+
+	return result;
+}
+
+}	/* namespace NetStream */
@@ -21,12 +21,15 @@
 
 #include <cstdarg>
 #include <cerrno>
+#include <cmath>
 #include <cstring>
 #include <algorithm>
 #include <utility>
-#include <sstream>
 #include <mutex>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -39,15 +42,40 @@
 
 #include <iostream>
 
+// the most a read waits on the server, until the response times are known
+#define CONNECTION_TIMEOUT		(60 * 3)
+
+// the pipeline window starts here and adapts between the min and max
+#define PIPELINE_START_WINDOW	4
+#define PIPELINE_MAX_WINDOW		32
+
+// the chars of the pipelined command lines answered that are kept before
+// their space is reused
+#define PIPELINE_CMDS_RELEASE	4096
+
+// the least space to read compressed data in to
+#define DEFLATE_READ_SIZE		4096
+
 #ifdef LIBUSENET_USE_SSL
 namespace NetStream {
-// SSL initialization function
+// SSL initialization function, the shared client SSL_CTX and its sessions
 void __init_ssl();
+SSL_CTX *__get_ssl_ctx();
+void __resume_ssl_session(SSL *p_ssl);
+bool __enable_ktls(SSL *p_ssl, bool enable);
+bool __is_ktls_recv(SSL *p_ssl);
+bool __is_ktls_send(SSL *p_ssl);
 }
 #endif  /* LIBUSENET_USE_SSL */
 
 namespace NntpClient {
 
+// a blocking read has waited out the timeout
+static inline std::system_error __timed_out()
+{
+	return std::system_error(std::error_code(ETIMEDOUT, std::system_category()), "NntpClient::Connection: timed out waiting for the server");
+}
+
 ServerAddr::ServerAddr(const char *server_name, const char *port/* = "119"*/)
 throw(std::runtime_error)
 :	ServerAddr(server_name, 1, 0, 0, port)
@@ -68,51 +96,41 @@ throw(std::runtime_error)
 
 ServerAddr::ServerAddr(const char *server_name, int num_connections, const char *username, const char *passwd, const char *port/* = "119"*/)
 throw(std::runtime_error)
-:	m_addr_len(0), m_num_conns(num_connections), m_username(username ? username : ""), m_password(passwd ? passwd : "")
+:	m_num_conns(num_connections), m_username(username ? username : ""), m_password(passwd ? passwd : "")
 {
-	addrinfo hints, *pAddrInfo;
-
-	// set up the hints structure
-	memset(&hints, 0, sizeof(struct addrinfo));
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = nntp_tcp_protocol;
-	hints.ai_flags = AI_NUMERICSERV|AI_CANONNAME;
-
-	// get the address info - looking at the example code
-	// on the man page it seems that freeaddrinfo is not
-	// needed when an error code is returned
-	register int result = getaddrinfo(server_name, port, &hints, &pAddrInfo);
+	// get all of the IPv6 and IPv4 addresses, so a connect can race them
+	register int result = NetStream::resolve(server_name, port, m_addrs, &m_canon_name, AI_NUMERICSERV);
 	if(0 != result)
 		throw std::runtime_error(gai_strerror(result));
-
-	// save the address info and free the returned list
-	memcpy(&m_addr, pAddrInfo->ai_addr, sizeof(struct sockaddr));
-	m_addr_len = pAddrInfo->ai_addrlen;
-	m_canon_name.assign(pAddrInfo->ai_canonname);
-
-	freeaddrinfo(pAddrInfo);
 }
 
 ServerAddr::ServerAddr(const ServerAddr& that)
-:	m_addr_len(that.m_addr_len), m_canon_name(that.m_canon_name),
+:	m_addrs(that.m_addrs), m_canon_name(that.m_canon_name),
 	m_num_conns(that.m_num_conns),
 	m_username(that.m_username), m_password(that.m_password)
 	
 {
-	memcpy(&m_addr, &that.m_addr, sizeof(struct sockaddr));
 }
 
 ServerAddr::ServerAddr(ServerAddr&& that)
-:	m_addr_len(that.m_addr_len), m_canon_name(std::move(that.m_canon_name)),
+:	m_addrs(std::move(that.m_addrs)), m_canon_name(std::move(that.m_canon_name)),
 	m_num_conns(that.m_num_conns),
 	m_username(std::move(that.m_username)), m_password(std::move(that.m_password))
 	
 {
-	that.m_addr_len = 0;
+	that.m_addrs.clear();
 	that.m_num_conns = 1;
-	memcpy(&m_addr, &that.m_addr, sizeof(struct sockaddr));
-	bzero(&that.m_addr, sizeof(struct sockaddr));
+}
+
+const sockaddr& ServerAddr::get_addr() const
+{
+	static const sockaddr_storage s_no_addr = {};
+	return *(m_addrs.empty() ? (const sockaddr*)&s_no_addr : m_addrs.front().get());
+}
+
+size_t ServerAddr::get_addrlen() const
+{
+	return m_addrs.empty() ? 0 : m_addrs.front().addrlen;
 }
 
 Response::Response()
@@ -152,6 +170,13 @@ int Response::get_number() const
 	return result;
 }
 
+Response& Response::assign(const char *p_line, size_t len)
+{
+	m_len = std::min(len, sizeof(m_buf));
+	memcpy(m_buf, p_line, m_len);
+	return *this;
+}
+
 Response& Response::read(std::istream& is)
 {
 	is.getline(m_buf, 1024);
@@ -159,19 +184,71 @@ Response& Response::read(std::istream& is)
 	return *this;
 }
 
+CommandLine::CommandLine()
+:	m_len(0)
+{
+	clear();
+}
+
+CommandLine::CommandLine(const char *cmd)
+:	m_len(0)
+{
+	append(cmd);
+}
+
+CommandLine& CommandLine::append(const char *text)
+{
+	// 512 is max NNTP command, which needs to include "\r\n", so there are 510 command chars max
+	const size_t len = strnlen(text, MAX_LENGTH - m_len);
+	memcpy(m_buf + m_len, text, len);
+	m_len += len;
+
+	m_buf[m_len] = '\r';
+	m_buf[m_len + 1] = '\n';
+	return *this;
+}
+
+CommandLine& CommandLine::add(const char *token)
+{
+	append(" ");
+	return append(token);
+}
+
+CommandLine& CommandLine::add_message_id(const char *message_id)
+{
+	append(" <");
+	append(message_id);
+	return append(">");
+}
+
+CommandLine& CommandLine::clear()
+{
+	m_len = 0;
+	return append("");
+}
+
 //#include <sys/stat.h>
 
 Connection::Connection()
 throw(std::runtime_error)
-:	m_sock(-1), m_rdsz(0), m_ibuf(0), m_buflen(0), m_bufptr()
+:	m_sock(-1), m_rdsz(0), m_ibuf(0), m_line_start(true), m_buflen(0), m_bufptr(),
+	m_pipeline_queue(), m_in_flight(), m_pipeline_cmds(), m_pipeline_base(0), m_next_seq(1),
+	m_min_window(1), m_max_window(PIPELINE_MAX_WINDOW), m_window(PIPELINE_START_WINDOW),
+	m_rtt_index(0), m_rtt(0),
+	m_latency(CONNECTION_TIMEOUT), m_rcvtimeo(CONNECTION_TIMEOUT), m_in_body(false),
+	m_nonblocking(false), m_connecting(false), m_obuf(), m_obuf_sent(0), m_read_wants_write(false), m_write_wants_read(false),
+	m_p_source(nullptr), m_connect_addrs(), m_connect_next(0), m_connect_time(), m_connect_socks(), m_connect_epfd(-1),
+	m_deflate(), m_zbuf()
 {
+	std::fill(m_rtt_samples, m_rtt_samples + RTT_SAMPLES, 0.0);
+
 	// create the socket
 	m_sock = socket(AF_INET, SOCK_STREAM, /*nntp_tcp_protocol*/0);
 	if(-1 == m_sock)
 		throw std::runtime_error(strerror(errno));
 
 	// create a timeout value for socket reads
-	struct timeval to_time = { (60 * 3), 0, };
+	struct timeval to_time = { CONNECTION_TIMEOUT, 0, };
 
 	// Get the internal buffer size of this socket and set the read timeout
 	socklen_t optValLen = sizeof(m_buflen);
@@ -209,14 +286,50 @@ throw(std::system_error)
 Connection::Connection(Connection&& transConnection)
 :	m_sock(transConnection.m_sock),
 	m_rdsz(transConnection.m_rdsz),
-	m_ibuf(transConnection.m_buflen),
-	m_bufptr(std::move(transConnection.m_bufptr))
+	m_ibuf(transConnection.m_ibuf),
+	m_line_start(transConnection.m_line_start),
+	m_buflen(transConnection.m_buflen),
+	m_bufptr(std::move(transConnection.m_bufptr)),
+	m_pipeline_queue(std::move(transConnection.m_pipeline_queue)),
+	m_in_flight(std::move(transConnection.m_in_flight)),
+	m_pipeline_cmds(std::move(transConnection.m_pipeline_cmds)),
+	m_pipeline_base(transConnection.m_pipeline_base),
+	m_next_seq(transConnection.m_next_seq),
+	m_min_window(transConnection.m_min_window),
+	m_max_window(transConnection.m_max_window),
+	m_window(transConnection.m_window),
+	m_rtt_index(transConnection.m_rtt_index),
+	m_rtt(transConnection.m_rtt),
+	m_latency(transConnection.m_latency),
+	m_rcvtimeo(transConnection.m_rcvtimeo),
+	m_in_body(transConnection.m_in_body),
+	m_nonblocking(transConnection.m_nonblocking),
+	m_connecting(transConnection.m_connecting),
+	m_obuf(std::move(transConnection.m_obuf)),
+	m_obuf_sent(transConnection.m_obuf_sent),
+	m_read_wants_write(transConnection.m_read_wants_write),
+	m_write_wants_read(transConnection.m_write_wants_read),
+	m_p_source(nullptr),
+	m_connect_addrs(std::move(transConnection.m_connect_addrs)),
+	m_connect_next(transConnection.m_connect_next),
+	m_connect_time(transConnection.m_connect_time),
+	m_connect_socks(std::move(transConnection.m_connect_socks)),
+	m_connect_epfd(transConnection.m_connect_epfd),
+	m_deflate(std::move(transConnection.m_deflate)),
+	m_zbuf()
 {
+	std::copy(transConnection.m_rtt_samples, transConnection.m_rtt_samples + RTT_SAMPLES, m_rtt_samples);
+
 	// reset the values of the transient instance
 	transConnection.m_sock = -1;
+	transConnection.m_connect_socks.clear();
+	transConnection.m_connect_epfd = -1;
+	transConnection.m_connecting = false;
 	transConnection.m_rdsz = 0;
 	transConnection.m_ibuf = 0;
+	transConnection.m_line_start = true;
 	transConnection.m_buflen = 0;
+	transConnection.reset_pipeline();
 }
 
 Connection& Connection::operator =(Connection&& transConnection)
@@ -224,13 +337,47 @@ Connection& Connection::operator =(Connection&& transConnection)
 	//m_sock = transConnection.m_sock;
 	std::swap(m_sock, transConnection.m_sock);
 	m_rdsz = transConnection.m_rdsz;
-	m_ibuf = transConnection.m_buflen;
+	m_ibuf = transConnection.m_ibuf;
+	m_line_start = transConnection.m_line_start;
+	m_buflen = transConnection.m_buflen;
 	m_bufptr = std::move(transConnection.m_bufptr);
+
+	m_pipeline_queue = std::move(transConnection.m_pipeline_queue);
+	m_in_flight = std::move(transConnection.m_in_flight);
+	m_pipeline_cmds = std::move(transConnection.m_pipeline_cmds);
+	m_pipeline_base = transConnection.m_pipeline_base;
+	m_next_seq = transConnection.m_next_seq;
+	m_min_window = transConnection.m_min_window;
+	m_max_window = transConnection.m_max_window;
+	m_window = transConnection.m_window;
+	std::copy(transConnection.m_rtt_samples, transConnection.m_rtt_samples + RTT_SAMPLES, m_rtt_samples);
+	m_rtt_index = transConnection.m_rtt_index;
+	m_rtt = transConnection.m_rtt;
+	m_latency = transConnection.m_latency;
+	m_rcvtimeo = transConnection.m_rcvtimeo;
+	m_in_body = transConnection.m_in_body;
+	transConnection.reset_pipeline();
+
+	m_nonblocking = transConnection.m_nonblocking;
+	m_connecting = transConnection.m_connecting;
+	m_obuf = std::move(transConnection.m_obuf);
+	m_obuf_sent = transConnection.m_obuf_sent;
+	m_read_wants_write = transConnection.m_read_wants_write;
+	m_write_wants_read = transConnection.m_write_wants_read;
+	m_connect_addrs = std::move(transConnection.m_connect_addrs);
+	m_connect_next = transConnection.m_connect_next;
+	m_connect_time = transConnection.m_connect_time;
+	std::swap(m_connect_socks, transConnection.m_connect_socks);
+	std::swap(m_connect_epfd, transConnection.m_connect_epfd);
+	transConnection.m_obuf.clear();
+	transConnection.m_obuf_sent = 0;
+	m_deflate = std::move(transConnection.m_deflate);
 	
 	// reset the values of the transient instance
 	//transConnection.m_sock = -1;
 	transConnection.m_rdsz = 0;
 	transConnection.m_ibuf = 0;
+	transConnection.m_line_start = true;
 	transConnection.m_buflen = 0;
 
 	return *this;
@@ -241,20 +388,44 @@ Connection::~Connection()
 	close();
 }
 
+bool Connection::is_idle() const
+{
+	if((m_sock < 0) || m_connecting || (m_ibuf < m_rdsz) || (0 != get_send_queued())
+		|| !m_in_flight.empty() || !m_pipeline_queue.empty() || is_read_pending())
+		return false;
+
+	pollfd pfd = { m_sock, POLLIN, 0, };
+	return(0 == poll(&pfd, 1, 0));
+}
+
 int Connection::get_timeout() const
 {
-	struct timeval to_time = { 0, 0, };
-	socklen_t optValLen = sizeof(to_time);
-	if(0 != getsockopt(m_sock, SOL_SOCKET, SO_RCVTIMEO, &to_time, &optValLen))
-		throw std::runtime_error(strerror(errno));
-	return to_time.tv_sec;
+	return (int)m_latency.get_max_timeout();
 }
 
 void Connection::set_timeout(int seconds)
 {
-	struct timeval to_time = { seconds, 0, };
+	m_latency.set_max_timeout(seconds);
+	const double timeout = m_latency.get_timeout();
+	struct timeval to_time = { (time_t)timeout, (suseconds_t)((timeout - (time_t)timeout) * 1000000), };
 	if(0 != setsockopt(m_sock, SOL_SOCKET, SO_RCVTIMEO, &to_time, sizeof(to_time)))
 		throw std::runtime_error(strerror(errno));
+	m_rcvtimeo = timeout;
+}
+
+std::chrono::steady_clock::time_point Connection::get_deadline() const
+{
+	if(m_connecting)
+		return m_connect_time;
+
+	// only while a command waits on its response, pipelined ones are in flight
+	// or the lines of a pipelined BODY are still to come
+	const double timeout = m_latency.get_timeout();
+	if((m_sock < 0) || (timeout <= 0) || (!m_latency.is_waiting() && m_in_flight.empty() && !m_in_body))
+		return std::chrono::steady_clock::time_point();
+
+	return m_latency.get_last_activity()
+		+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
 }
 
 void Connection::open(const ServerAddr& server, Response& response)
@@ -271,6 +442,15 @@ throw(std::runtime_error)
 
 void Connection::close()
 {
+	// the responses to any commands in flight are lost with the connection,
+	// and so is anything not yet sent
+	reset_pipeline();
+	m_obuf.clear();
+	m_obuf_sent = 0;
+	m_read_wants_write = m_write_wants_read = false;
+	m_deflate.reset();
+	stop_connect();
+
 	if(m_sock < 0) return;
 
 	::close(m_sock);
@@ -280,27 +460,7 @@ void Connection::close()
 void Connection::send(const char *cmd)
 throw(std::runtime_error)
 {
-	std::string cmdline(cmd);
-	register std::string::size_type len = cmdline.size();
-
-	// 512 is max NNTP command, which needs to include "\r\n", so there are 510 command chars max
-	if(len > 510)
-	{
-		cmdline[510] = '\r';
-		if(len > 511)
-			cmdline[511] = '\n';
-		else
-			cmdline.push_back('\n');
-		len = 512;
-	}
-	else
-	{
-		cmdline.append("\r\n");
-		len += 2;
-	}
-
-	// send the cmd line to the server
-	write(cmdline.c_str(), cmdline.size());
+	send(CommandLine(cmd));
 }
 
 void Connection::send(const char *cmd, const char *arg1, ...)
@@ -308,14 +468,12 @@ throw(std::runtime_error)
 {
 	bool inArticleId = false;
 
-	std::stringstream cmdbuf;
-
 	// add initial cmd token
-	cmdbuf << cmd;
+	CommandLine cmdline(cmd);
 	if(0 != arg1)
 	{
 		// always will space delineate the cmd from the first arg
-		cmdbuf << ' ' << arg1;
+		cmdline.add(arg1);
 
 		// anything wrapped in '<' and '>' chars is an article ID and no spaces can be between the article ID and the chars
 		inArticleId = (arg1[0] == '<') && (arg1[1] == 0);
@@ -330,10 +488,10 @@ throw(std::runtime_error)
 				inArticleId = (arg[0] == '<') && (arg[1] == 0);
 
 			// add a space unless an article ID has been detected
-			if(!inArticleId) cmdbuf << ' ';
-
-			// add the next token to the NNTP cmd line buffer
-			cmdbuf << arg;
+			if(inArticleId)
+				cmdline.append(arg);
+			else
+				cmdline.add(arg);
 
 			// if we detected an article ID, see if we are done writing it
 			if(inArticleId)
@@ -343,33 +501,21 @@ throw(std::runtime_error)
 		va_end(vargs);
 	}
 
-	std::string cmdline = cmdbuf.str();
-	register std::string::size_type len = cmdline.size();
-
-	// 512 is max NNTP command, which needs to include "\r\n", so there are 510 command chars max
-	if(len > 510)
-	{
-		cmdline[510] = '\r';
-		if(len > 511)
-			cmdline[511] = '\n';
-		else
-			cmdline.push_back('\n');
-		len = 512;
-	}
-	else
-	{
-		cmdline.append("\r\n");
-		len += 2;
-	}
-
 	// send the cmd line to the NNTP server
-	write(cmdline.c_str(), len);
+	send(cmdline);
 }
 
 void Connection::send(const void *buf, unsigned long len)
 throw(std::runtime_error)
 {
-	write(buf, len);
+	write_data(buf, len);
+}
+
+void Connection::send(const CommandLine& cmdline)
+throw(std::runtime_error)
+{
+	write_data(cmdline.data(), cmdline.size());
+	sent_command();
 }
 
 ResponseStatus Connection::read_response(Response& response)
@@ -383,89 +529,838 @@ throw(std::runtime_error)
 int Connection::read_line(char *buf, size_t buflen)
 throw(std::runtime_error)
 {
-	unsigned int linelen;
-	int rdlen;
+	size_t linelen = 0;
+	bool line_start = m_line_start, dotted = false;
 
-	// rdlen is used to track how many chars were pulled from the NntpConnection buffer and
-	// response.m_len is used to track the next available index in the Response when this routine is
-	// finished response.m_len will give the caller the number of chars in of chars in the response buffer
-	for(linelen = rdlen = 0; linelen < buflen; )
+	// copy from the block buffer, refilling it as needed, up to and including the '\n'
+	while(linelen < buflen)
 	{
 		if(m_ibuf >= m_rdsz)
 		{
 			// reset and refill block buffer
 			m_ibuf = 0;
-			m_rdsz = read(m_bufptr.get(), m_buflen);
+			m_rdsz = read_data(m_bufptr.get(), m_buflen);
+			received(m_rdsz);
 
 			// if no data was read then we're done
 			if(0 == m_rdsz) break;
 		}
 
-		// copy bytes to the response buffer until '\n' is seen
-		buf[linelen] = m_bufptr[m_ibuf++];
-
 		// NNTP: lines beginning with a '.' will have that char repeated unless it is the end-of text response
 		// indicator we'll ignore all '.' chars in the first postion of a line and return a 0-length read
 		// if it is actually the end-of-text indicator line, which will end up being "\r\n"
-		if((1 == ++rdlen) && ('.' == buf[linelen]))
-			continue;
+		if(line_start)
+		{
+			line_start = false;
+			if('.' == m_bufptr[m_ibuf])
+			{
+				dotted = true;
+				++m_ibuf;
+				continue;
+			}
+		}
+
+		const char *p_src = m_bufptr.get() + m_ibuf;
+		size_t len = std::min(size_t(m_rdsz - m_ibuf), buflen - linelen);
+		const char *p_eol = (const char*)memchr(p_src, '\n', len);
+		if(nullptr != p_eol)
+			len = p_eol - p_src + 1;
 
-		// check for end-of-line...also incrments the length/next available index
-		if('\n' == buf[linelen++])
+		memcpy(buf + linelen, p_src, len);
+		m_ibuf += len;
+		linelen += len;
+
+		if(nullptr != p_eol)
 			break;
 	}
 
 	// check for a multi-line end-of text response, which came in as ".\r\n" and had the '.' char stripped above
-	if((3 == rdlen) && ('\r' == buf[0]) && ('\n' == buf[1]))
+	if(dotted && (2 == linelen) && ('\r' == buf[0]) && ('\n' == buf[1]))
 		linelen = 0;
+	if(0 == linelen)
+		m_in_body = false;
+	m_line_start = (0 == linelen) || ('\n' == buf[linelen - 1]);
 
 	return linelen;
 }
 
+// take the line ending at 'eol' from the block buffer as a view, removing a leading '.'
+// when it is at the start of a line, and not a piece of a line after the first
+static inline void cut_line(LineView& line, const char *p_buf, int& ibuf, size_t eol, bool& line_start)
+{
+	line.p_line = p_buf + ibuf;
+	line.len = eol - ibuf;
+	ibuf = eol;
+
+	const bool is_line_start = line_start;
+	line_start = (0 != line.len) && ('\n' == line.p_line[line.len - 1]);
+	if(is_line_start && (0 != line.len) && ('.' == *line.p_line))
+	{
+		++line.p_line;
+		--line.len;
+
+		// the end-of-text ".\r\n" is returned with a 0 length
+		if((2 == line.len) && ('\r' == line.p_line[0]) && ('\n' == line.p_line[1]))
+			line.len = 0;
+	}
+}
+
+bool Connection::fill_line(size_t *p_eol)
+throw(std::runtime_error)
+{
+	// only the data added by each refill needs to be searched for the '\n'
+	int iscan = m_ibuf;
+	for(;;)
+	{
+		const char *p_nl = (const char*)memchr(m_bufptr.get() + iscan, '\n', m_rdsz - iscan);
+		if(nullptr != p_nl)
+		{
+			*p_eol = p_nl - m_bufptr.get() + 1;
+			return true;
+		}
+
+		// move a partial line to the front of the block buffer so the rest of it can be read after it
+		if(m_ibuf > 0)
+		{
+			m_rdsz -= m_ibuf;
+			if(m_rdsz > 0)
+				memmove(m_bufptr.get(), m_bufptr.get() + m_ibuf, m_rdsz);
+			m_ibuf = 0;
+		}
+		iscan = m_rdsz;
+
+		// a line longer than the block buffer is returned in buffer sized pieces
+		if(m_rdsz >= m_buflen)
+		{
+			*p_eol = m_rdsz;
+			return true;
+		}
+
+		const int rdsz = read_data(m_bufptr.get() + m_rdsz, m_buflen - m_rdsz);
+		received(rdsz);
+
+		// at the end of the data a partial line is all that's left
+		if(0 == rdsz)
+		{
+			*p_eol = m_rdsz;
+			return(m_rdsz > 0);
+		}
+
+		m_rdsz += rdsz;
+	}
+}
+
+int Connection::read_line(LineView& line)
+throw(std::runtime_error)
+{
+	size_t eol;
+	if(!fill_line(&eol))
+	{
+		line.p_line = m_bufptr.get();
+		line.len = 0;
+		return 0;
+	}
+
+	cut_line(line, m_bufptr.get(), m_ibuf, eol, m_line_start);
+	if(0 == line.len)
+		m_in_body = false;
+	return line.len;
+}
+
+size_t Connection::read_lines(LineView *p_lines, size_t max_lines, bool *p_end/* = nullptr*/)
+throw(std::runtime_error)
+{
+	size_t count = 0, eol;
+	bool is_end = false;
+
+	// only the first line can refill the block buffer, which would move the lines already taken from it
+	if((0 != max_lines) && fill_line(&eol))
+	{
+		const char *p_buf = m_bufptr.get();
+		for(;;)
+		{
+			LineView& line = p_lines[count++];
+			cut_line(line, p_buf, m_ibuf, eol, m_line_start);
+
+			if(0 == line.len)
+			{
+				is_end = true;
+				break;
+			}
+
+			if(count == max_lines)
+				break;
+
+			const char *p_eol = (const char*)memchr(p_buf + m_ibuf, '\n', m_rdsz - m_ibuf);
+			if(nullptr == p_eol)
+				break;
+			eol = p_eol - p_buf + 1;
+		}
+	}
+
+	if(nullptr != p_end)
+		*p_end = is_end;
+
+	return count;
+}
+
 ResponseStatus Connection::group(const char *group_name, Response response)
 throw(std::runtime_error)
 {
-	send("GROUP", group_name, nullptr);
+	send(CommandLine("GROUP").add(group_name));
 	return read_response(response);
 }
 
 ResponseStatus Connection::stat(const char *message_id, Response response)
 throw(std::runtime_error)
 {
-	send("STAT", "<", message_id, ">", nullptr);
+	send(CommandLine("STAT").add_message_id(message_id));
 	return read_response(response);
 }
 
 ResponseStatus Connection::article(const char *message_id, Response& response)
 throw(std::runtime_error)
 {
-	send("ARTICLE", "<", message_id, ">", nullptr);
+	send(CommandLine("ARTICLE").add_message_id(message_id));
 	return read_response(response);
 }
 
 ResponseStatus Connection::header(const char *message_id, Response& response)
 throw(std::runtime_error)
 {
-	send("HEAD", "<", message_id, ">", nullptr);
+	send(CommandLine("HEAD").add_message_id(message_id));
 	return read_response(response);
 }
 
 ResponseStatus Connection::body(const char *message_id, Response& response)
 throw(std::runtime_error)
 {
-	send("BODY", "<", message_id, ">", nullptr);
+	send(CommandLine("BODY").add_message_id(message_id));
 	return read_response(response);
 }
 
-void Connection::connect(const ServerAddr& server)
+ResponseStatus Connection::compress(Response& response)
+throw(std::runtime_error)
+{
+	if(m_deflate)
+		throw std::runtime_error("NntpClient::Connection: compression is already active");
+
+	// made first, so a library without zlib fails before the command is sent
+	std::unique_ptr<NetStream::Deflate> deflate(new NetStream::Deflate);
+	send("COMPRESS DEFLATE");
+	ResponseStatus result = read_response(response);
+
+	// 206, everything after it is compressed, including what has been read after it
+	if((CMD_OK == result) && (CONNECTION == response.get_function()) && (6 == response.get_number()))
+	{
+		if(m_ibuf < m_rdsz)
+			deflate->put(m_bufptr.get() + m_ibuf, m_rdsz - m_ibuf);
+		m_ibuf = m_rdsz = 0;
+		m_line_start = true;
+		m_deflate = std::move(deflate);
+	}
+
+	return result;
+}
+
+void Connection::set_pipeline_window(size_t min_window, size_t max_window)
+{
+	m_min_window = std::max(min_window, (size_t)1);
+	m_max_window = std::max(max_window, m_min_window);
+	m_window = std::min(std::max(m_window, m_min_window), m_max_window);
+}
+
+unsigned long Connection::pipeline_body(const char *message_id)
+throw(std::runtime_error)
+{
+	return queue_pipelined(PipelineRequest::BODY, message_id);
+}
+
+unsigned long Connection::pipeline_stat(const char *message_id)
+throw(std::runtime_error)
+{
+	return queue_pipelined(PipelineRequest::STAT, message_id);
+}
+
+unsigned long Connection::queue_pipelined(PipelineRequest::Command command, const char *message_id)
+throw(std::runtime_error)
+{
+	// "BODY <" + message_id + ">" has to fit the 510 chars a CommandLine has
+	// before its "\r\n"
+	const size_t id_len = strlen(message_id);
+	if((strlen("BODY <>") + id_len) > CommandLine::MAX_LENGTH)
+		throw std::runtime_error("NntpClient::Connection: message-id is too long");
+
+	// the command line is formatted where it waits to be sent
+	const unsigned long offset = m_pipeline_base + m_pipeline_cmds.size();
+	m_pipeline_cmds.append((PipelineRequest::BODY == command) ? "BODY <" : "STAT <", 6);
+	m_pipeline_cmds.append(message_id, id_len);
+	m_pipeline_cmds.append(">\r\n", 3);
+
+	m_pipeline_queue.push_back(PipelineEntry{ m_next_seq, command, offset, id_len + 9, std::chrono::steady_clock::time_point() });
+	return m_next_seq++;
+}
+
+void Connection::fill_pipeline()
+throw(std::runtime_error)
+{
+	if(m_pipeline_queue.empty() || (m_in_flight.size() >= m_window))
+		return;
+
+	// send all of the commands that fit the window in one write, their lines
+	// follow each other in the order they were queued
+	const auto now = std::chrono::steady_clock::now();
+	const bool is_idle = m_in_flight.empty();
+	const char *p_cmds = m_pipeline_cmds.data() + (m_pipeline_queue.front().offset - m_pipeline_base);
+	size_t len = 0;
+	while(!m_pipeline_queue.empty() && (m_in_flight.size() < m_window))
+	{
+		PipelineEntry& entry = m_pipeline_queue.front();
+		entry.sent = now;
+		len += entry.length;
+		m_in_flight.push_back(entry);
+		m_pipeline_queue.pop_front();
+	}
+
+	if(m_nonblocking)
+		queue_data(p_cmds, len);
+	else
+		write_data(p_cmds, len);
+	m_latency.sent(is_idle, now);
+
+	if(m_nonblocking)
+		flush();
+}
+
+ResponseStatus Connection::read_pipelined_response(Response& response, PipelineRequest *p_request/* = nullptr*/)
+throw(std::runtime_error)
+{
+	fill_pipeline();
+	if(m_in_flight.empty())
+		throw std::runtime_error("NntpClient::Connection: no pipelined commands in flight");
+
+	ResponseStatus result = read_response(response);
+	complete_pipelined(response, p_request);
+
+	return result;
+}
+
+bool Connection::take_pipelined_response(Response& response, PipelineRequest *p_request/* = nullptr*/)
+throw(std::runtime_error)
+{
+	fill_pipeline();
+	if(m_in_flight.empty())
+		throw std::runtime_error("NntpClient::Connection: no pipelined commands in flight");
+
+	if(!take_response(response))
+		return false;
+
+	complete_pipelined(response, p_request);
+	return true;
+}
+
+void Connection::complete_pipelined(const Response& response, PipelineRequest *p_request)
+{
+	const auto now = std::chrono::steady_clock::now();
+
+	// only time the next response if it is already on its way
+	const PipelineEntry request = m_in_flight.front();
+	m_in_flight.pop_front();
+	m_latency.response_started(!m_in_flight.empty() || !m_pipeline_queue.empty(), now);
+	m_in_body = (PipelineRequest::BODY == request.command) && (CMD_OK == response.get_status());
+	const double rtt_sample = std::chrono::duration<double>(now - request.sent).count();
+	update_window(rtt_sample);
+
+	// the response time includes the wait behind the responses ahead of it,
+	// which is the time a response can take while the pipeline is full
+	m_latency.add_sample(rtt_sample);
+	apply_timeout();
+
+	// the message-id is between the "BODY <" or "STAT <" and the ">\r\n"
+	if(nullptr != p_request)
+	{
+		p_request->seq = request.seq;
+		p_request->command = request.command;
+		p_request->message_id.assign(m_pipeline_cmds.data() + (request.offset - m_pipeline_base) + 6, request.length - 9);
+		p_request->sent = request.sent;
+	}
+	release_pipelined();
+}
+
+void Connection::release_pipelined()
+{
+	// the lines of the commands answered are dropped once they're most of the
+	// buffer, which keeps its space and only now and then moves the rest down
+	unsigned long next = m_pipeline_base + m_pipeline_cmds.size();
+	if(!m_in_flight.empty())
+		next = m_in_flight.front().offset;
+	else if(!m_pipeline_queue.empty())
+		next = m_pipeline_queue.front().offset;
+
+	const size_t done = next - m_pipeline_base;
+	if((done == m_pipeline_cmds.size()) || ((done >= PIPELINE_CMDS_RELEASE) && ((2 * done) >= m_pipeline_cmds.size())))
+	{
+		m_pipeline_cmds.erase(0, done);
+		m_pipeline_base += done;
+	}
+}
+
+void Connection::update_window(double rtt_sample)
+{
+	// a response waits behind the ones ahead of it, so the smallest recent
+	// response time is the best measure of the round trip
+	m_rtt_samples[m_rtt_index++ % RTT_SAMPLES] = rtt_sample;
+	m_rtt = rtt_sample;
+	for(auto sample : m_rtt_samples)
+	{
+		if((sample > 0) && (sample < m_rtt))
+			m_rtt = sample;
+	}
+
+	// enough commands to keep the bandwidth x delay product of responses in
+	// flight, and one more to cover the time to send the next command
+	const double bandwidth = m_latency.get_bandwidth(), response_size = m_latency.get_response_size();
+	if((bandwidth > 0) && (response_size > 0))
+	{
+		const double window = ((m_rtt * bandwidth) / response_size) + 1;
+		m_window = (size_t)std::min((double)m_max_window, std::max((double)m_min_window, std::ceil(window)));
+	}
+}
+
+void Connection::sent_command()
+{
+	// a command can't be sent while there are pipelined ones in flight, so only
+	// a queued one is sent to a busy connection
+	m_latency.sent(m_in_flight.empty());
+}
+
+void Connection::received(size_t len)
+{
+	if(0 == len)
+		return;
+
+	// the response to a single command is a round trip, a pipelined one is
+	// timed as a whole by complete_pipelined
+	const double ttfb = m_latency.received(len);
+	if((ttfb > 0) && m_in_flight.empty())
+	{
+		m_latency.add_sample(ttfb);
+		apply_timeout();
+	}
+}
+
+void Connection::apply_timeout()
+{
+	// only a blocking read waits on the timeout, and it's only set again on the
+	// socket when it has moved by more than an eighth
+	const double timeout = m_latency.get_timeout();
+	if(m_nonblocking || (m_sock < 0) || (std::fabs(timeout - m_rcvtimeo) <= (m_rcvtimeo / 8)))
+		return;
+
+	struct timeval to_time = { (time_t)timeout, (suseconds_t)((timeout - (time_t)timeout) * 1000000), };
+	if(0 == setsockopt(m_sock, SOL_SOCKET, SO_RCVTIMEO, &to_time, sizeof(to_time)))
+		m_rcvtimeo = timeout;
+}
+
+void Connection::reset_pipeline()
+{
+	m_pipeline_queue.clear();
+	m_in_flight.clear();
+	m_pipeline_base += m_pipeline_cmds.size();
+	m_pipeline_cmds.clear();
+	m_in_body = false;
+	m_latency.responses_stopped();
+}
+
+void Connection::set_nonblocking(bool nonblocking)
 throw(std::system_error)
 {
-	// attempt connection to remote host
-	while(-1 == ::connect(m_sock, &server.get_addr(), server.get_addrlen()) && errno != EISCONN)
+	register int flags = fcntl(m_sock, F_GETFL);
+	if((-1 == flags) || (-1 == fcntl(m_sock, F_SETFL, nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK))))
+		throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+
+	m_nonblocking = nonblocking;
+}
+
+IoStatus Connection::start_connect(const ServerAddr& server)
+throw(std::system_error)
+{
+	if(!m_nonblocking)
+		set_nonblocking(true);
+
+	// as with connect_race, the next address is tried once a connect has had
+	// the attempt delay without an answer, or has failed, and the first made
+	// wins, the connects are watched together by an epoll until then
+	stop_connect();
+	m_connect_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(-1 == m_connect_epfd)
+		throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+
+	m_connect_addrs = server.get_addr_list();
+	m_connect_next = 0;
+	m_connecting = true;
+	return connect_next(EHOSTUNREACH);
+}
+
+IoStatus Connection::continue_connect()
+throw(std::system_error)
+{
+	if(m_connecting)
+	{
+		std::vector<pollfd> attempts;
+		attempts.reserve(m_connect_socks.size());
+		for(auto sock : m_connect_socks)
+			attempts.push_back(pollfd{ sock, POLLOUT, 0 });
+		if((-1 == poll(attempts.data(), attempts.size(), 0)) && (EINTR != errno))
+			throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+
+		int error = 0;
+		for(auto& attempt : attempts)
+		{
+			if(0 == attempt.revents)
+				continue;
+
+			int sock_error = 0;
+			socklen_t optValLen = sizeof(sock_error);
+			if(0 != getsockopt(attempt.fd, SOL_SOCKET, SO_ERROR, &sock_error, &optValLen))
+				sock_error = errno;
+			if(0 == sock_error)
+				return connect_won(attempt.fd);
+
+			// closing the socket takes it out of the epoll
+			error = sock_error;
+			::close(attempt.fd);
+			m_connect_socks.erase(std::find(m_connect_socks.begin(), m_connect_socks.end(), attempt.fd));
+		}
+
+		if((0 != error) || ((std::chrono::steady_clock::time_point() != m_connect_time)
+			&& (std::chrono::steady_clock::now() >= m_connect_time)))
+			return connect_next((0 != error) ? error : ETIMEDOUT);
+		return IO_WANT_READ;
+	}
+
+	return IO_DONE;
+}
+
+IoStatus Connection::connect_next(int error)
+throw(std::system_error)
+{
+	while(m_connect_next < m_connect_addrs.size())
+	{
+		const NetStream::SockAddr& addr = m_connect_addrs[m_connect_next++];
+		const int sock = socket(addr.get_family(), SOCK_STREAM | SOCK_NONBLOCK, 0);
+		if(-1 == sock)
+		{
+			error = errno;
+			continue;
+		}
+
+		int status;
+		while((-1 == (status = ::connect(sock, addr.get(), addr.addrlen))) && (EINTR == errno))
+			;
+		if(0 == status)
+			return connect_won(sock);
+
+		if(EINPROGRESS == errno)
+		{
+			epoll_event event;
+			memset(&event, 0, sizeof(event));
+			event.events = EPOLLOUT;
+			event.data.fd = sock;
+			if(0 == epoll_ctl(m_connect_epfd, EPOLL_CTL_ADD, sock, &event))
+			{
+				m_connect_socks.push_back(sock);
+				m_connect_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(NetStream::connect_attempt_delay);
+				return IO_WANT_READ;
+			}
+		}
+		error = errno;
+		::close(sock);
+	}
+
+	// with no addresses left wait on the connects still racing
+	m_connect_time = std::chrono::steady_clock::time_point();
+	if(!m_connect_socks.empty())
+		return IO_WANT_READ;
+
+	stop_connect();
+	throw std::system_error(std::error_code(error, std::system_category()), strerror(error));
+}
+
+IoStatus Connection::connect_won(int sock)
+throw(std::system_error)
+{
+	m_connect_socks.erase(std::remove(m_connect_socks.begin(), m_connect_socks.end(), sock), m_connect_socks.end());
+	stop_connect();
+	replace_socket(sock);
+	return IO_DONE;
+}
+
+void Connection::stop_connect()
+{
+	// the connects which lost the race
+	for(auto sock : m_connect_socks)
+		::close(sock);
+	m_connect_socks.clear();
+
+	if(m_connect_epfd >= 0)
+	{
+		::close(m_connect_epfd);
+		m_connect_epfd = -1;
+	}
+	m_connect_time = std::chrono::steady_clock::time_point();
+	m_connecting = false;
+}
+
+void Connection::replace_socket(int sock)
+throw(std::system_error)
+{
+	// the new socket takes the descriptor of the old one, which keeps it for
+	// SSL and its owner, and its read timeout
+	timeval to_time = { 0, 0, };
+	socklen_t optValLen = sizeof(to_time);
+	const bool is_timeout = (0 == getsockopt(m_sock, SOL_SOCKET, SO_RCVTIMEO, &to_time, &optValLen));
+
+	register int result;
+	while((-1 == (result = dup2(sock, m_sock))) && (EINTR == errno))
+		;
+	const int error = errno;
+	::close(sock);
+	if(-1 == result)
+		throw std::system_error(std::error_code(error, std::system_category()), strerror(error));
+
+	if(is_timeout)
+		setsockopt(m_sock, SOL_SOCKET, SO_RCVTIMEO, &to_time, sizeof(to_time));
+}
+
+IoStatus Connection::receive()
+throw(std::runtime_error)
+{
+	// move a partial line to the front of the block buffer to make room after it
+	if(m_ibuf > 0)
+	{
+		m_rdsz -= m_ibuf;
+		if(m_rdsz > 0)
+			memmove(m_bufptr.get(), m_bufptr.get() + m_ibuf, m_rdsz);
+		m_ibuf = 0;
+	}
+
+	// read until the socket has nothing more or the block buffer is full
+	IoStatus result = IO_DONE;
+	m_read_wants_write = false;
+	const int rdsz = m_rdsz;
+	while(m_rdsz < m_buflen)
+	{
+		size_t len = 0;
+		result = read_data_some(m_bufptr.get() + m_rdsz, m_buflen - m_rdsz, &len);
+		m_rdsz += len;
+		if(IO_DONE != result)
+			break;
+	}
+	received(m_rdsz - rdsz);
+
+	m_read_wants_write = (IO_WANT_WRITE == result);
+	return result;
+}
+
+bool Connection::take_line(LineView& line)
+{
+	const char *p_buf = m_bufptr.get();
+	const char *p_nl = (const char*)memchr(p_buf + m_ibuf, '\n', m_rdsz - m_ibuf);
+
+	// a line longer than the block buffer is taken in buffer sized pieces
+	size_t eol;
+	if(nullptr != p_nl)
+		eol = p_nl - p_buf + 1;
+	else if((0 == m_ibuf) && (m_rdsz == m_buflen))
+		eol = m_rdsz;
+	else
+		return false;
+
+	cut_line(line, p_buf, m_ibuf, eol, m_line_start);
+	if(0 == line.len)
+		m_in_body = false;
+	return true;
+}
+
+bool Connection::take_response(Response& response)
+{
+	LineView line;
+	if(!take_line(line))
+		return false;
+
+	response.assign(line.p_line, line.len);
+	return true;
+}
+
+void Connection::queue_send(const char *cmd)
+{
+	queue_send(CommandLine(cmd));
+}
+
+void Connection::queue_send(const void *buf, unsigned long len)
+{
+	queue_data(buf, len);
+}
+
+void Connection::queue_send(const CommandLine& cmdline)
+{
+	queue_data(cmdline.data(), cmdline.size());
+	sent_command();
+}
+
+IoStatus Connection::flush()
+throw(std::system_error)
+{
+	IoStatus result = IO_DONE;
+	while(m_obuf_sent < m_obuf.size())
+	{
+		size_t len = 0;
+		result = write_some(m_obuf.data() + m_obuf_sent, m_obuf.size() - m_obuf_sent, &len);
+		m_obuf_sent += len;
+		if(IO_DONE != result)
+			break;
+	}
+
+	if(m_obuf_sent == m_obuf.size())
+	{
+		m_obuf.clear();
+		m_obuf_sent = 0;
+	}
+
+	m_write_wants_read = (IO_WANT_READ == result);
+	return result;
+}
+
+bool Connection::is_read_pending() const
+{
+	return(((nullptr != m_p_source) && m_p_source->is_pending()) || (m_deflate && m_deflate->is_pending()));
+}
+
+int Connection::read_data(void *buf, size_t nbyte)
+throw(std::runtime_error)
+{
+	if(!m_deflate)
+		return read(buf, nbyte);
+
+	// read until there's enough compressed data to inflate some of it
+	for(;;)
+	{
+		if(m_deflate->is_pending())
+		{
+			const size_t len = m_deflate->inflate(buf, nbyte);
+			if(0 != len)
+				return len;
+		}
+
+		size_t space;
+		char *p_space = m_deflate->get_input_space(DEFLATE_READ_SIZE, &space);
+		const int rdsz = read(p_space, space);
+		if(0 == rdsz)
+			return 0;
+		m_deflate->commit_input(rdsz);
+	}
+}
+
+IoStatus Connection::read_data_some(void *buf, size_t nbyte, size_t *p_len)
+throw(std::runtime_error)
+{
+	if(!m_deflate)
+		return read_some(buf, nbyte, p_len);
+
+	for(;;)
+	{
+		if(m_deflate->is_pending())
+		{
+			*p_len = m_deflate->inflate(buf, nbyte);
+			if(0 != *p_len)
+				return IO_DONE;
+		}
+
+		size_t space, len = 0;
+		char *p_space = m_deflate->get_input_space(DEFLATE_READ_SIZE, &space);
+		IoStatus result = read_some(p_space, space, &len);
+		m_deflate->commit_input(len);
+		if(IO_DONE != result)
+		{
+			*p_len = 0;
+			return result;
+		}
+	}
+}
+
+void Connection::write_data(const void *buf, size_t nbyte)
+throw(std::runtime_error)
+{
+	if(!m_deflate)
+	{
+		write(buf, nbyte);
+		return;
+	}
+
+	m_zbuf.clear();
+	m_deflate->deflate(buf, nbyte, m_zbuf);
+	write(m_zbuf.data(), m_zbuf.size());
+}
+
+void Connection::queue_data(const void *buf, size_t nbyte)
+throw(std::runtime_error)
+{
+	if(m_deflate)
+		m_deflate->deflate(buf, nbyte, m_obuf);
+	else
+		m_obuf.append((const char*)buf, nbyte);
+}
+
+IoStatus Connection::read_some(void *buf, size_t nbyte, size_t *p_len)
+throw(std::system_error)
+{
+	// a Reactor may have received the data already
+	if(nullptr != m_p_source)
+		return m_p_source->take(buf, nbyte, p_len);
+
+	register ssize_t result;
+	while(-1 == (result = ::read(m_sock, buf, nbyte)))
 	{
+		*p_len = 0;
+		if((EAGAIN == errno) || (EWOULDBLOCK == errno))
+			return IO_WANT_READ;
 		if(EINTR != errno)
 			throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
 	}
+
+	*p_len = result;
+	return (0 == result) ? IO_EOF : IO_DONE;
+}
+
+IoStatus Connection::write_some(const void *buf, size_t nbyte, size_t *p_len)
+throw(std::system_error)
+{
+	register ssize_t result;
+	while(-1 == (result = ::write(m_sock, buf, nbyte)))
+	{
+		*p_len = 0;
+		if((EAGAIN == errno) || (EWOULDBLOCK == errno))
+			return IO_WANT_WRITE;
+		if(EINTR != errno)
+			throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+	}
+
+	*p_len = result;
+	return IO_DONE;
+}
+
+void Connection::connect(const ServerAddr& server)
+throw(std::system_error)
+{
+	if(m_sock < 0)
+		throw std::system_error(std::error_code(EBADF, std::system_category()), strerror(EBADF));
+
+	// race the addresses of the server, the first one to connect takes the place of the socket
+	const int sock = NetStream::connect_race(server.get_addr_list());
+	if(-1 == sock)
+		throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+	replace_socket(sock);
 }
 
 void Connection::authenticate(const ServerAddr& server, Response& response)
@@ -503,6 +1398,8 @@ throw(std::system_error)
 	register int result;
 	while(-1 == (result = ::read(m_sock, buf, nbyte)))
 	{
+		if((EAGAIN == errno) || (EWOULDBLOCK == errno))
+			throw __timed_out();
 		if(EINTR != errno)
 			throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
 	}
@@ -514,12 +1411,13 @@ throw(std::system_error)
 
 SslConnection::SslConnection()
 throw(std::runtime_error)
-:	Connection(), m_ctxptr((SSL_CTX*)0, SSL_CTX_free), m_sslptr((SSL*)0, SSL_free)
+:	Connection(), m_sslptr((SSL*)0, SSL_free), m_ktls_recv(false), m_ktls_send(false)
 {
-	NetStream::__init_ssl();
+	SSL_CTX *p_ctx = NetStream::__get_ssl_ctx();
+	if(nullptr == p_ctx)
+		throw std::runtime_error("NntpClient::SslConnection: can't create the SSL context");
 
-	m_ctxptr.reset(SSL_CTX_new(SSLv3_client_method()));
-	m_sslptr.reset(SSL_new(m_ctxptr.get()));
+	m_sslptr.reset(SSL_new(p_ctx));
 	SSL_set_fd(m_sslptr.get(), m_sock);
 	SSL_set_mode(m_sslptr.get(), SSL_MODE_AUTO_RETRY);
 }
@@ -533,16 +1431,18 @@ throw(std::runtime_error)
 
 SslConnection::SslConnection(SslConnection&& transConnection)
 :	Connection(std::move(transConnection)),
-	m_ctxptr(std::move(transConnection.m_ctxptr)),
-	m_sslptr(std::move(transConnection.m_sslptr))
+	m_sslptr(std::move(transConnection.m_sslptr)),
+	m_ktls_recv(transConnection.m_ktls_recv),
+	m_ktls_send(transConnection.m_ktls_send)
 {
 }
 
 SslConnection& SslConnection::operator =(SslConnection&& transConnection)
 {
 	Connection::operator =(std::move(transConnection));
-	m_ctxptr = std::move(transConnection.m_ctxptr);
 	m_sslptr = std::move(transConnection.m_sslptr);
+	m_ktls_recv = transConnection.m_ktls_recv;
+	m_ktls_send = transConnection.m_ktls_send;
 
 	return *this;
 }
@@ -567,10 +1467,22 @@ void SslConnection::close()
 	}
 
 	m_sslptr.reset(0);
-	m_ctxptr.reset(0);
+	m_ktls_recv = m_ktls_send = false;
 	Connection::close();
 }
 
+void SslConnection::set_ktls(bool enable)
+{
+	if(m_sslptr)
+		NetStream::__enable_ktls(m_sslptr.get(), enable);
+}
+
+void SslConnection::start_ktls()
+{
+	m_ktls_recv = NetStream::__is_ktls_recv(m_sslptr.get());
+	m_ktls_send = NetStream::__is_ktls_send(m_sslptr.get());
+}
+
 static const char *__get_ssl_err_str(int ssl_errnum, const char *dflt_msg)
 {
 	const char *reason = dflt_msg;
@@ -602,13 +1514,56 @@ static const char *__get_ssl_err_str(int ssl_errnum, const char *dflt_msg)
 	return reason;
 }
 
+void SslConnection::set_nonblocking(bool nonblocking)
+throw(std::system_error)
+{
+	Connection::set_nonblocking(nonblocking);
+
+	// a SSL_write that wants a retry may be retried with more of the send
+	// queue, which can move as it grows
+	if(nonblocking)
+		SSL_set_mode(m_sslptr.get(), SSL_MODE_ENABLE_PARTIAL_WRITE|SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	else
+		SSL_clear_mode(m_sslptr.get(), SSL_MODE_ENABLE_PARTIAL_WRITE|SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+}
+
+IoStatus SslConnection::continue_connect()
+throw(std::system_error)
+{
+	// finish the TCP connection before starting the handshake
+	register IoStatus result = Connection::continue_connect();
+	if(IO_DONE != result)
+		return result;
+
+	// resume the last session with the server, on the first step of the handshake
+	NetStream::__resume_ssl_session(m_sslptr.get());
+	register int ssl_status = SSL_connect(m_sslptr.get());
+	if(1 == ssl_status)
+	{
+		start_ktls();
+		return IO_DONE;
+	}
+
+	int errnum = SSL_get_error(m_sslptr.get(), ssl_status);
+	if(SSL_ERROR_WANT_READ == errnum)
+		return IO_WANT_READ;
+	if(SSL_ERROR_WANT_WRITE == errnum)
+		return IO_WANT_WRITE;
+
+	const char *reason = ERR_reason_error_string(ERR_get_error());
+	if(nullptr == reason)
+		reason = __get_ssl_err_str(errnum, "SslConnection::continue_connect error during SSL_connect");
+	throw std::system_error(std::error_code(errnum, std::generic_category()), reason);
+}
+
 void SslConnection::connect(const ServerAddr& server)
 throw(std::system_error)
 {
 	// attempt connection to remote host
 	Connection::connect(server);
 
-	// do the SSL handshake
+	// do the SSL handshake, resuming the last session with the server
+	NetStream::__resume_ssl_session(m_sslptr.get());
 	int ssl_status;
 	while(1 != (ssl_status = SSL_connect(m_sslptr.get())))
 	{
@@ -623,6 +1578,8 @@ throw(std::system_error)
 			reason = __get_ssl_err_str(errnum, "SslConnection::connect error during SSL_connect");
 		throw std::system_error(std::error_code(errnum, std::generic_category()), reason);
 	}
+
+	start_ktls();
 }
 
 void SslConnection::write(const void *buf, size_t nbyte)
@@ -650,12 +1607,33 @@ throw(std::system_error)
 int SslConnection::read(void *buf, size_t nbyte)
 throw(std::system_error)
 {
+	// with kernel TLS the socket gives the decrypted data, and only fails with
+	// EIO on a record which isn't data, such as a session ticket, for SSL_read
+	if(m_ktls_recv && (0 == SSL_pending(m_sslptr.get())))
+	{
+		register int result;
+		while(-1 == (result = ::read(m_sock, buf, nbyte)))
+		{
+			if(EIO == errno)
+				break;
+			if((EAGAIN == errno) || (EWOULDBLOCK == errno))
+				throw __timed_out();
+			if(EINTR != errno)
+				throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+		}
+
+		if(-1 != result)
+			return result;
+	}
+
 	register int ssl_status = ::SSL_read(m_sslptr.get(), buf, nbyte);
 
-	// error condition
+	// error condition, a blocking read wants more on the read timeout
 	if(0 >= ssl_status)
 	{
 		int errnum = SSL_get_error(m_sslptr.get(), ssl_status);
+		if(SSL_ERROR_WANT_READ == errnum)
+			throw __timed_out();
 		const char *reason = ERR_reason_error_string(ERR_get_error());
 		if(nullptr == reason)
 			reason = __get_ssl_err_str(errnum, "SslConnection::read error during SSL_read");
@@ -665,6 +1643,91 @@ throw(std::system_error)
 	return ssl_status;
 }
 
+IoStatus SslConnection::read_some(void *buf, size_t nbyte, size_t *p_len)
+throw(std::system_error)
+{
+	*p_len = 0;
+
+	// as read, and a Reactor may have received the data already
+	if(m_ktls_recv && (0 == SSL_pending(m_sslptr.get())))
+	{
+		if(nullptr != m_p_source)
+			return m_p_source->take(buf, nbyte, p_len);
+
+		register ssize_t result;
+		while(-1 == (result = ::read(m_sock, buf, nbyte)))
+		{
+			if((EAGAIN == errno) || (EWOULDBLOCK == errno))
+				return IO_WANT_READ;
+			if(EIO == errno)
+				break;
+			if(EINTR != errno)
+				throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+		}
+
+		if(-1 != result)
+		{
+			*p_len = result;
+			return (0 == result) ? IO_EOF : IO_DONE;
+		}
+	}
+
+	register int ssl_status = ::SSL_read(m_sslptr.get(), buf, nbyte);
+	if(0 < ssl_status)
+	{
+		*p_len = ssl_status;
+		return IO_DONE;
+	}
+
+	// a read can want a write while the session is renegotiated
+	int errnum = SSL_get_error(m_sslptr.get(), ssl_status);
+	switch(errnum)
+	{
+		case SSL_ERROR_WANT_READ:
+			return IO_WANT_READ;
+		case SSL_ERROR_WANT_WRITE:
+			return IO_WANT_WRITE;
+		case SSL_ERROR_ZERO_RETURN:
+			return IO_EOF;
+		default:
+			break;
+	}
+
+	const char *reason = ERR_reason_error_string(ERR_get_error());
+	if(nullptr == reason)
+		reason = __get_ssl_err_str(errnum, "SslConnection::read_some error during SSL_read");
+	throw std::system_error(std::error_code(errnum, std::generic_category()), reason);
+}
+
+IoStatus SslConnection::write_some(const void *buf, size_t nbyte, size_t *p_len)
+throw(std::system_error)
+{
+	*p_len = 0;
+	register int ssl_status = ::SSL_write(m_sslptr.get(), buf, nbyte);
+	if(0 < ssl_status)
+	{
+		*p_len = ssl_status;
+		return IO_DONE;
+	}
+
+	int errnum = SSL_get_error(m_sslptr.get(), ssl_status);
+	if(SSL_ERROR_WANT_READ == errnum)
+		return IO_WANT_READ;
+	if(SSL_ERROR_WANT_WRITE == errnum)
+		return IO_WANT_WRITE;
+
+	const char *reason = ERR_reason_error_string(ERR_get_error());
+	if(nullptr == reason)
+		reason = __get_ssl_err_str(errnum, "SslConnection::write_some error during SSL_write");
+	throw std::system_error(std::error_code(errnum, std::generic_category()), reason);
+}
+
+bool SslConnection::is_read_pending() const
+{
+	// decrypted data held by SSL doesn't make the socket readable
+	return(Connection::is_read_pending() || (SSL_pending(m_sslptr.get()) > 0));
+}
+
 #endif  /* LIBUSENET_USE_SSL */
 
 }	// namespace NntpClient
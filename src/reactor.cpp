@@ -0,0 +1,687 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include <libusenet/reactor.h>
+#include "ioUring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+// the most events taken from epoll by each wait
+#define REACTOR_MAX_EVENTS	64
+
+// the io_uring queue size, and the count and size of the receive buffers
+#define REACTOR_URING_ENTRIES		1024
+#define REACTOR_URING_BUFFERS		256
+#define REACTOR_URING_BUFFER_SIZE	16384
+
+// the operations on the ring for an entry, which are in the low bits of the user data
+#define OP_RECV		1
+#define OP_POLL_IN	2
+#define OP_POLL_OUT	3
+#define OP_CANCEL	4
+#define OP_BITS		3
+
+namespace NntpClient {
+
+Reactor::Entry::Entry(Connection& connection, Handler& handler, bool is_opening, IoStatus open_status)
+:	p_connection(&connection), p_handler(&handler), is_opening(is_opening), open_status(open_status), fd(-1), events(0),
+	p_buffers(nullptr), armed(0), ready(0), is_ready(false), is_multishot(true), received(), is_eof(false), error(0)
+{
+}
+
+Reactor::Reactor(Backend backend/* = AUTO*/)
+throw(std::system_error)
+:	m_backend(EPOLL), m_epfd(-1), m_stop(false), m_ring(), m_buffers(), m_ready(),
+	m_next_id(1), m_entries(), m_ids(), m_pending()
+{
+	if(EPOLL != backend)
+	{
+#ifdef LIBUSENET_USE_IO_URING
+		try
+		{
+			m_ring.reset(new Uring::Ring(REACTOR_URING_ENTRIES));
+			m_buffers.reset(new Uring::BufferRing(*m_ring, 0, REACTOR_URING_BUFFERS, REACTOR_URING_BUFFER_SIZE));
+			m_backend = IO_URING;
+			return;
+		}
+		catch(std::system_error&)
+		{
+			m_buffers.reset();
+			m_ring.reset();
+			if(IO_URING == backend)
+				throw;
+		}
+#else
+		if(IO_URING == backend)
+			throw std::system_error(std::error_code(ENOSYS, std::system_category()), "NntpClient::Reactor: built without io_uring");
+#endif
+	}
+
+	m_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(-1 == m_epfd)
+		throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+}
+
+Reactor::~Reactor()
+{
+	// closing the ring cancels what's in flight, and the data not taken is dropped
+	for(auto& it : m_entries)
+		it.second.p_connection->m_p_source = nullptr;
+	m_buffers.reset();
+	m_ring.reset();
+
+	if(m_epfd >= 0)
+		::close(m_epfd);
+}
+
+void Reactor::open(Connection& connection, const ServerAddr& server, Handler& handler)
+throw(std::system_error)
+{
+	// on_open is called on the first event even if the connection was made at once
+	IoStatus status = connection.start_connect(server);
+	insert(connection, handler, true, status);
+}
+
+void Reactor::add(Connection& connection, Handler& handler)
+throw(std::system_error)
+{
+	if(!connection.is_nonblocking())
+		connection.set_nonblocking(true);
+
+	insert(connection, handler, false, IO_DONE);
+
+	// lines already in the block buffer won't make the socket readable
+	if((connection.m_ibuf < connection.m_rdsz) || connection.is_read_pending())
+		m_pending.push_back(m_ids[&connection]);
+}
+
+void Reactor::insert(Connection& connection, Handler& handler, bool is_opening, IoStatus open_status)
+throw(std::system_error)
+{
+	if(m_ids.count(&connection))
+		throw std::system_error(std::error_code(EEXIST, std::system_category()), "NntpClient::Reactor: connection was already added");
+
+	const uint64_t id = m_next_id++;
+	Entry& entry = m_entries.emplace(id, Entry(connection, handler, is_opening, open_status)).first->second;
+	m_ids[&connection] = id;
+
+	// a connection which reads its own socket takes what the ring receives for it
+	if((IO_URING == m_backend) && connection.is_raw_socket())
+	{
+		entry.p_buffers = m_buffers.get();
+		connection.m_p_source = &entry;
+	}
+
+	try
+	{
+		watch(id, entry);
+	}
+	catch(...)
+	{
+		connection.m_p_source = nullptr;
+		m_entries.erase(id);
+		m_ids.erase(&connection);
+		throw;
+	}
+}
+
+void Reactor::remove(Connection& connection)
+{
+	auto it = m_ids.find(&connection);
+	if(m_ids.end() == it)
+		return;
+
+	// the socket may already have been closed, which removes it from epoll
+	if(IO_URING == m_backend)
+		remove_uring(it->second, m_entries.at(it->second));
+	else
+		epoll_ctl(m_epfd, EPOLL_CTL_DEL, m_entries.at(it->second).fd, nullptr);
+	m_entries.erase(it->second);
+	m_ids.erase(it);
+}
+
+void Reactor::update(Connection& connection)
+throw(std::system_error)
+{
+	auto it = m_ids.find(&connection);
+	if(m_ids.end() != it)
+		watch(it->second, m_entries.at(it->second));
+}
+
+Reactor::Entry *Reactor::find(uint64_t id)
+{
+	auto it = m_entries.find(id);
+	return (m_entries.end() == it) ? nullptr : &it->second;
+}
+
+void Reactor::watch(uint64_t id, Entry& entry)
+throw(std::system_error)
+{
+	if(IO_URING == m_backend)
+	{
+		watch_uring(id, entry);
+		return;
+	}
+
+	const Connection& connection = *entry.p_connection;
+
+	// while opening wait on what the connect or handshake wants, once open always
+	// wait for data and wait to write while anything is queued, or SSL_read wants it
+	uint32_t events;
+	if(entry.is_opening)
+		events = (IO_WANT_READ == entry.open_status) ? EPOLLIN : EPOLLOUT;
+	else
+	{
+		events = EPOLLIN|EPOLLRDHUP;
+		if(((0 != connection.get_send_queued()) && !connection.m_write_wants_read) || connection.m_read_wants_write)
+			events |= EPOLLOUT;
+	}
+
+	// the epoll of the racing connects is closed once one is made, which takes
+	// it out of the set, and the socket is added in its place
+	const int fd = connection.get_event_fd();
+	if(fd != entry.fd)
+		entry.events = 0;
+	if(events == entry.events)
+		return;
+
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = events;
+	event.data.u64 = id;
+	if(-1 == epoll_ctl(m_epfd, (0 == entry.events) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event))
+		throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+	entry.fd = fd;
+	entry.events = events;
+}
+
+void Reactor::dispatch(uint64_t id, uint32_t events)
+{
+	Entry *p_entry = find(id);
+	if(nullptr == p_entry)
+		return;
+
+	// the callbacks can remove any connection, so the entry is looked up again after each
+	Connection& connection = *p_entry->p_connection;
+	Handler& handler = *p_entry->p_handler;
+	try
+	{
+		if(p_entry->is_opening)
+		{
+			// called on the events of the connect and at its deadline, when the
+			// next address is tried as well
+			p_entry->open_status = connection.continue_connect();
+			if(IO_DONE == p_entry->open_status)
+			{
+				p_entry->is_opening = false;
+
+				// a SslConnection only reads its own socket once the handshake
+				// has set up kernel TLS, and then takes what the ring receives
+				if((IO_URING == m_backend) && (nullptr == p_entry->p_buffers) && connection.is_raw_socket())
+				{
+					p_entry->p_buffers = m_buffers.get();
+					connection.m_p_source = p_entry;
+				}
+				handler.on_open(connection);
+			}
+		}
+		else
+		{
+			const bool can_read = (0 != (events & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR)));
+			const bool can_write = (0 != (events & EPOLLOUT));
+
+			bool is_sent = false;
+			if((0 != connection.get_send_queued()) && (can_write || (can_read && connection.m_write_wants_read)))
+				is_sent = (IO_DONE == connection.flush());
+
+			if(can_read || (can_write && connection.m_read_wants_write))
+				handler.on_readable(connection);
+
+			if(is_sent && (nullptr != find(id)))
+				handler.on_writable(connection);
+		}
+
+		if(nullptr != (p_entry = find(id)))
+		{
+			if(connection.is_read_pending())
+				m_pending.push_back(id);
+			watch(id, *p_entry);
+		}
+	}
+	catch(std::exception& e)
+	{
+		if(nullptr != find(id))
+			remove(connection);
+		handler.on_error(connection, e);
+	}
+}
+
+int Reactor::run_once(int timeout_ms/* = -1*/)
+throw(std::system_error)
+{
+	if(IO_URING == m_backend)
+		return run_uring(timeout_ms);
+
+	// don't wait while there's data held by SSL to dispatch
+	epoll_event events[REACTOR_MAX_EVENTS];
+	int count = epoll_wait(m_epfd, events, REACTOR_MAX_EVENTS, m_pending.empty() ? get_wait(timeout_ms) : 0);
+	if(-1 == count)
+	{
+		if(EINTR == errno)
+			return 0;
+		throw std::system_error(std::error_code(errno, std::system_category()), strerror(errno));
+	}
+
+	std::vector<uint64_t> pending;
+	pending.swap(m_pending);
+	for(auto id : pending)
+		dispatch(id, EPOLLIN);
+
+	for(int i = 0; i < count; ++i)
+		dispatch(events[i].data.u64, events[i].events);
+
+	expire();
+	return count + pending.size();
+}
+
+int Reactor::get_wait(int timeout_ms) const
+{
+	const auto now = std::chrono::steady_clock::now();
+	for(auto& it : m_entries)
+	{
+		const auto deadline = it.second.p_connection->get_deadline();
+		if(std::chrono::steady_clock::time_point() == deadline)
+			continue;
+
+		// rounded up, so the wait doesn't end just before the deadline
+		const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1);
+		const int wait_ms = (deadline <= now) ? 0 : (int)std::min(wait.count(), (decltype(wait.count()))INT_MAX);
+		if((-1 == timeout_ms) || (wait_ms < timeout_ms))
+			timeout_ms = wait_ms;
+	}
+
+	return timeout_ms;
+}
+
+void Reactor::expire()
+{
+	const auto now = std::chrono::steady_clock::now();
+	std::vector<uint64_t> expired;
+	for(auto& it : m_entries)
+	{
+		const auto deadline = it.second.p_connection->get_deadline();
+		if((std::chrono::steady_clock::time_point() != deadline) && (deadline <= now))
+			expired.push_back(it.first);
+	}
+
+	// a callback of one can remove another, and the deadline of a connect is
+	// when it races the next address
+	for(auto id : expired)
+	{
+		Entry *p_entry = find(id);
+		if((nullptr != p_entry) && p_entry->is_opening)
+			dispatch(id, 0);
+		else
+			fail(id, std::system_error(std::error_code(ETIMEDOUT, std::system_category()), "NntpClient::Reactor: timed out waiting for the server"));
+	}
+}
+
+void Reactor::fail(uint64_t id, const std::exception& error)
+{
+	Entry *p_entry = find(id);
+	if(nullptr == p_entry)
+		return;
+
+	Connection& connection = *p_entry->p_connection;
+	Handler& handler = *p_entry->p_handler;
+	remove(connection);
+	handler.on_error(connection, error);
+}
+
+#ifdef LIBUSENET_USE_IO_URING
+
+IoStatus Reactor::Entry::take(void *buf, size_t nbyte, size_t *p_len)
+throw(std::system_error)
+{
+	*p_len = 0;
+	if(received.empty())
+	{
+		if(0 != error)
+			throw std::system_error(std::error_code(error, std::system_category()), strerror(error));
+		return is_eof ? IO_EOF : IO_WANT_READ;
+	}
+
+	// the buffers go back to the ring as they're emptied
+	char *p_buf = (char*)buf;
+	while((*p_len < nbyte) && !received.empty())
+	{
+		Received& front = received.front();
+		const size_t len = std::min(nbyte - *p_len, (size_t)(front.len - front.offset));
+		memcpy(p_buf + *p_len, p_buffers->get_buffer(front.bid) + front.offset, len);
+		*p_len += len;
+		front.offset += len;
+		if(front.offset == front.len)
+		{
+			p_buffers->recycle(front.bid);
+			received.pop_front();
+		}
+	}
+
+	// once the receive has stopped, the connection reads the socket itself
+	if(received.empty() && !is_multishot)
+		p_connection->m_p_source = nullptr;
+
+	return IO_DONE;
+}
+
+bool Reactor::Entry::is_pending() const
+{
+	return(!received.empty() || is_eof || (0 != error));
+}
+
+void Reactor::watch_uring(uint64_t id, Entry& entry)
+throw(std::system_error)
+{
+	Connection& connection = *entry.p_connection;
+
+	// the same events as with epoll, with a multishot receive in place of waiting
+	// for data once it's open, the polls are one-shot, so they're level triggered
+	bool want_in, want_out;
+	if(entry.is_opening)
+	{
+		want_in = (IO_WANT_READ == entry.open_status);
+		want_out = !want_in;
+	}
+	else
+	{
+		want_in = true;
+		want_out = ((0 != connection.get_send_queued()) && !connection.m_write_wants_read) || connection.m_read_wants_write;
+	}
+
+	const int fd = connection.get_event_fd();
+	entry.fd = fd;
+	if(want_in)
+	{
+		if(!entry.is_opening && (nullptr != entry.p_buffers) && entry.is_multishot)
+		{
+			if(!entry.is_eof && (0 == entry.error))
+				arm(id, entry, OP_RECV, fd);
+		}
+		else
+			arm(id, entry, OP_POLL_IN, fd);
+	}
+	if(want_out)
+		arm(id, entry, OP_POLL_OUT, fd);
+}
+
+void Reactor::arm(uint64_t id, Entry& entry, unsigned int op, int fd)
+throw(std::system_error)
+{
+	if(0 != (entry.armed & (1U << op)))
+		return;
+
+	io_uring_sqe *p_sqe = m_ring->get_sqe();
+	p_sqe->fd = fd;
+	p_sqe->user_data = (id << OP_BITS) | op;
+	if(OP_RECV == op)
+	{
+		p_sqe->opcode = IORING_OP_RECV;
+		p_sqe->ioprio = IORING_RECV_MULTISHOT;
+		p_sqe->flags = IOSQE_BUFFER_SELECT;
+		p_sqe->buf_group = entry.p_buffers->get_group();
+	}
+	else
+	{
+		p_sqe->opcode = IORING_OP_POLL_ADD;
+		p_sqe->poll32_events = (OP_POLL_IN == op) ? (EPOLLIN|EPOLLRDHUP) : EPOLLOUT;
+	}
+	entry.armed |= (1U << op);
+}
+
+void Reactor::set_ready(uint64_t id, Entry& entry, uint32_t events)
+{
+	entry.ready |= events;
+	if(!entry.is_ready)
+	{
+		entry.is_ready = true;
+		m_ready.push_back(id);
+	}
+}
+
+void Reactor::reap()
+{
+	// the completions are only recorded, and dispatched after, so this can be
+	// called while removing a connection in a callback
+	io_uring_cqe *p_cqe;
+	while(nullptr != (p_cqe = m_ring->peek_cqe()))
+	{
+		const uint64_t id = p_cqe->user_data >> OP_BITS;
+		const unsigned int op = p_cqe->user_data & ((1U << OP_BITS) - 1);
+		const int res = p_cqe->res;
+		const uint32_t flags = p_cqe->flags;
+		m_ring->cqe_seen();
+
+		Entry *p_entry = find(id);
+		if(nullptr == p_entry)
+		{
+			if(0 != (flags & IORING_CQE_F_BUFFER))
+				m_buffers->recycle(flags >> IORING_CQE_BUFFER_SHIFT);
+			continue;
+		}
+		Entry& entry = *p_entry;
+
+		switch(op)
+		{
+		case OP_RECV:
+			if(0 == (flags & IORING_CQE_F_MORE))
+				entry.armed &= ~(1U << OP_RECV);
+
+			// without buffers, or when cancelled, the receive is armed again
+			// by the dispatch, and an old kernel without multishot polls
+			if(res > 0)
+			{
+				entry.received.push_back(Received{ (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT), 0, (unsigned int)res });
+				set_ready(id, entry, EPOLLIN);
+			}
+			else if(0 == res)
+			{
+				entry.is_eof = true;
+				set_ready(id, entry, EPOLLIN);
+			}
+			else if((-ENOBUFS == res) || (-ECANCELED == res))
+				set_ready(id, entry, 0);
+			else if((-EINVAL == res) && entry.received.empty())
+			{
+				entry.is_multishot = false;
+				entry.p_connection->m_p_source = nullptr;
+				set_ready(id, entry, 0);
+			}
+			else if(-EIO == res)
+			{
+				// kernel TLS fails on a record which isn't data, for SSL to read,
+				// so the connection is polled once what came before is taken
+				entry.is_multishot = false;
+				if(entry.received.empty())
+					entry.p_connection->m_p_source = nullptr;
+				set_ready(id, entry, EPOLLIN);
+			}
+			else
+			{
+				entry.error = -res;
+				set_ready(id, entry, EPOLLIN);
+			}
+			break;
+
+		case OP_POLL_IN:
+		case OP_POLL_OUT:
+			entry.armed &= ~(1U << op);
+			if(res > 0)
+				set_ready(id, entry, res);
+			else if(-ECANCELED != res)
+				set_ready(id, entry, (OP_POLL_IN == op) ? EPOLLERR : EPOLLOUT);
+			break;
+		}
+	}
+}
+
+int Reactor::run_uring(int timeout_ms)
+throw(std::system_error)
+{
+	// submit what the last dispatch armed and wait in the same call
+	m_ring->submit((m_pending.empty() && m_ready.empty()) ? 1 : 0, get_wait(timeout_ms));
+	reap();
+
+	std::vector<uint64_t> pending, ready;
+	pending.swap(m_pending);
+	ready.swap(m_ready);
+	for(auto id : pending)
+		dispatch(id, EPOLLIN);
+
+	for(auto id : ready)
+	{
+		Entry *p_entry = find(id);
+		if(nullptr == p_entry)
+			continue;
+		const uint32_t events = p_entry->ready;
+		p_entry->ready = 0;
+		p_entry->is_ready = false;
+		dispatch(id, events);
+	}
+
+	expire();
+	return ready.size() + pending.size();
+}
+
+void Reactor::remove_uring(uint64_t id, Entry& entry)
+{
+	Connection& connection = *entry.p_connection;
+
+	// cancel by the user data, the socket may already have been closed, but the
+	// ring holds it open until what's in flight is done
+	for(unsigned int op = OP_RECV; op < OP_CANCEL; ++op)
+	{
+		if(0 == (entry.armed & (1U << op)))
+			continue;
+		try
+		{
+			io_uring_sqe *p_sqe = m_ring->get_sqe();
+			p_sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			p_sqe->fd = -1;
+			p_sqe->addr = (id << OP_BITS) | op;
+			p_sqe->user_data = (id << OP_BITS) | OP_CANCEL;
+		}
+		catch(std::system_error&)
+		{
+		}
+	}
+
+	// the data received before the receive ends has to be kept
+	try
+	{
+		while(0 != (entry.armed & (1U << OP_RECV)))
+		{
+			m_ring->submit(1);
+			reap();
+		}
+	}
+	catch(std::system_error&)
+	{
+	}
+
+	if(!entry.received.empty() && (connection.m_sock >= 0))
+	{
+		entry.is_eof = false;
+		entry.error = 0;
+		try
+		{
+			connection.receive();
+		}
+		catch(std::system_error&)
+		{
+		}
+	}
+	connection.m_p_source = nullptr;
+
+	if(!entry.received.empty())
+	{
+		for(auto& received : entry.received)
+			m_buffers->recycle(received.bid);
+		entry.received.clear();
+		connection.close();
+	}
+}
+
+#else
+
+IoStatus Reactor::Entry::take(void *buf, size_t nbyte, size_t *p_len)
+throw(std::system_error)
+{
+	*p_len = 0;
+	return IO_WANT_READ;
+}
+
+bool Reactor::Entry::is_pending() const
+{
+	return false;
+}
+
+void Reactor::watch_uring(uint64_t id, Entry& entry)
+throw(std::system_error)
+{
+}
+
+void Reactor::arm(uint64_t id, Entry& entry, unsigned int op, int fd)
+throw(std::system_error)
+{
+}
+
+void Reactor::set_ready(uint64_t id, Entry& entry, uint32_t events)
+{
+}
+
+void Reactor::reap()
+{
+}
+
+int Reactor::run_uring(int timeout_ms)
+throw(std::system_error)
+{
+	return 0;
+}
+
+void Reactor::remove_uring(uint64_t id, Entry& entry)
+{
+}
+
+#endif	/* LIBUSENET_USE_IO_URING */
+
+void Reactor::run()
+throw(std::system_error)
+{
+	m_stop = false;
+	while(!m_stop && !m_entries.empty())
+		run_once();
+}
+
+}	// namespace NntpClient
@@ -0,0 +1,248 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include <libusenet/servergroup.h>
+
+#include <algorithm>
+#include <cerrno>
+
+// the number of times a batch is sent again on a new connection after an error
+#define GROUP_RETRIES	1
+
+namespace NntpClient {
+
+// the 3 digit NNTP response code, or 0 if there isn't one
+static int __response_code(const Response& response)
+{
+	if((S_NONE == response.get_status()) || (F_NONE == response.get_function()) || (response.get_number() < 0))
+		return 0;
+	return (response.get_status() * 100) + (response.get_function() * 10) + response.get_number();
+}
+
+ServerGroup::ServerGroup()
+:	m_servers(), m_order(), m_stats_mutex()
+{
+}
+
+ServerGroup::ServerStats ServerGroup::get_stats(int server) const
+{
+	std::lock_guard<std::mutex> lock(m_stats_mutex);
+	return m_servers.at(server).stats;
+}
+
+int ServerGroup::add_server(const ServerAddr& server, int tier/* = 0*/, bool use_ssl/* = false*/)
+throw(std::runtime_error)
+{
+	return insert(std::unique_ptr<ConnectionPool>(new ConnectionPool(server, use_ssl)), tier);
+}
+
+int ServerGroup::add_server(const ServerAddr& server, int tier, const ConnectionPool::Factory& factory)
+{
+	return insert(std::unique_ptr<ConnectionPool>(new ConnectionPool(server, factory)), tier);
+}
+
+int ServerGroup::insert(std::unique_ptr<ConnectionPool>&& pool, int tier)
+{
+	const int index = m_servers.size();
+	m_servers.push_back(Server{ std::move(pool), tier, ServerStats{ 0, 0, 0, } });
+
+	// keep the servers of a tier in the order they were added
+	m_order.insert(std::upper_bound(m_order.begin(), m_order.end(), tier,
+		[this](int t, int server) { return t < m_servers[server].tier; }), index);
+
+	return index;
+}
+
+ServerGroup::SegmentResult ServerGroup::body(const std::string& message_id, const BodyHandler& handler)
+throw(std::runtime_error)
+{
+	return request(PipelineRequest::BODY, std::vector<std::string>(1, message_id), handler).front();
+}
+
+std::vector<ServerGroup::SegmentResult> ServerGroup::body(const std::vector<std::string>& message_ids, const BodyHandler& handler)
+throw(std::runtime_error)
+{
+	return request(PipelineRequest::BODY, message_ids, handler);
+}
+
+ServerGroup::SegmentResult ServerGroup::stat(const std::string& message_id)
+throw(std::runtime_error)
+{
+	return request(PipelineRequest::STAT, std::vector<std::string>(1, message_id), BodyHandler()).front();
+}
+
+std::vector<ServerGroup::SegmentResult> ServerGroup::stat(const std::vector<std::string>& message_ids)
+throw(std::runtime_error)
+{
+	return request(PipelineRequest::STAT, message_ids, BodyHandler());
+}
+
+void ServerGroup::close_idle(int min_tier/* = 1*/)
+{
+	for(auto& server : m_servers)
+	{
+		if(server.tier >= min_tier)
+			server.pool->close_idle();
+	}
+}
+
+std::vector<ServerGroup::SegmentResult> ServerGroup::request(PipelineRequest::Command command,
+	const std::vector<std::string>& message_ids, const BodyHandler& handler)
+throw(std::runtime_error)
+{
+	std::vector<SegmentResult> results;
+	results.reserve(message_ids.size());
+	for(size_t i = 0; i < message_ids.size(); ++i)
+		results.push_back(SegmentResult{ message_ids[i], i, S_NONE, 0, -1, -1, 0 });
+
+	// each server is only asked for what the servers before it didn't have
+	std::vector<size_t> pending(message_ids.size());
+	for(size_t i = 0; i < pending.size(); ++i)
+		pending[i] = i;
+
+	for(auto server : m_order)
+	{
+		if(pending.empty())
+			break;
+		pending = request_from(server, command, message_ids, pending, results, handler);
+	}
+
+	return results;
+}
+
+std::vector<size_t> ServerGroup::request_from(int server, PipelineRequest::Command command,
+	const std::vector<std::string>& message_ids, const std::vector<size_t>& pending,
+	std::vector<SegmentResult>& results, const BodyHandler& handler)
+throw(std::runtime_error)
+{
+	Server& entry = m_servers[server];
+	ServerStats stats = { 0, 0, 0, };
+	std::vector<size_t> missing;
+
+	size_t next = 0;
+	for(unsigned int attempt = 0; next < pending.size(); ++attempt)
+	{
+		ConnectionPool::Lease lease;
+		try
+		{
+			lease = entry.pool->lease();
+		}
+		catch(std::system_error&)
+		{
+			// couldn't connect, the pool's back off paces the retry
+			++stats.errors;
+			if(attempt < GROUP_RETRIES)
+				continue;
+			break;
+		}
+		catch(std::runtime_error&)
+		{
+			// the server refused the connection, e.g. failed authentication
+			++stats.errors;
+			break;
+		}
+
+		try
+		{
+			// pipeline everything not yet answered and take the responses in order
+			for(size_t i = next; i < pending.size(); ++i)
+			{
+				if(PipelineRequest::BODY == command)
+					lease->pipeline_body(message_ids[pending[i]].c_str());
+				else
+					lease->pipeline_stat(message_ids[pending[i]].c_str());
+			}
+
+			for(; next < pending.size(); ++next)
+			{
+				Response response;
+				lease->read_pipelined_response(response);
+
+				// no response is the server closing the connection
+				if(S_NONE == response.get_status())
+					throw std::system_error(std::error_code(ECONNRESET, std::system_category()), "NntpClient::ServerGroup: connection closed by server");
+
+				SegmentResult& result = results[pending[next]];
+				result.status = response.get_status();
+				result.code = __response_code(response);
+				result.server = server;
+				result.tier = entry.tier;
+				++result.tried;
+
+				if(result.is_found())
+				{
+					++stats.found;
+					if(PipelineRequest::BODY == command)
+					{
+						if(handler)
+							handler(result, *lease);
+
+						// what the handler didn't read of the body would be taken
+						// as the responses that follow it
+						LineView line;
+						while(lease->is_in_body() && (0 != lease->read_line(line)))
+							;
+					}
+				}
+				else
+				{
+					++stats.missing;
+					missing.push_back(pending[next]);
+				}
+			}
+		}
+		catch(std::system_error&)
+		{
+			// the connection is broken, what wasn't answered is sent again on a new one
+			++stats.errors;
+			lease.discard();
+			if(attempt >= GROUP_RETRIES)
+				break;
+		}
+	}
+
+	// what this server couldn't be asked for goes to the next server, without
+	// what a response was taken as before the handler or connection failed
+	for(; next < pending.size(); ++next)
+	{
+		SegmentResult& result = results[pending[next]];
+		if(server == result.server)
+		{
+			result.status = S_NONE;
+			result.code = 0;
+			result.server = -1;
+			result.tier = -1;
+		}
+		else
+			++result.tried;
+		missing.push_back(pending[next]);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_stats_mutex);
+		entry.stats.found += stats.found;
+		entry.stats.missing += stats.missing;
+		entry.stats.errors += stats.errors;
+	}
+
+	std::sort(missing.begin(), missing.end());
+	return missing;
+}
+
+}	// namespace NntpClient
@@ -32,8 +32,10 @@
 #   include <openssl/crypto.h>
 #endif  /* LIBUSENET_USE_SSL */
 
-#if defined(LIBUSENET_USE_SSL) && defined(LIBUSENET_SSL_THREADS)
+#if defined(LIBUSENET_USE_SSL)
+#	include <map>
 #	include <mutex>
+#	include <string>
 #endif
 
 namespace NetStream {
@@ -52,7 +54,7 @@ std::unique_ptr<addrinfo, void(*)(addrinfo*)> get_addr_info(const char *node, co
 
 	// set up the hints structure and get the addr info
 	memset(&hints, 0, sizeof(addrinfo));
-	hints.ai_family = AF_INET;
+	hints.ai_family = AF_UNSPEC;
 	hints.ai_socktype = SOCK_STREAM;
 	hints.ai_protocol = 6;
 	hints.ai_flags = AI_CANONNAME;
@@ -94,13 +96,10 @@ bool connect_socket(int sockfd, const sockaddr *p_addr, socklen_t addrlen)
 
 #if defined(LIBUSENET_USE_SSL)
 
-#if defined(LIBUSENET_SSL_THREADS)
-// mutex used to lock SSL initialization calls
-static std::mutex sSslInitMutex;
-
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L) && defined(LIBUSENET_SSL_THREADS)
 // mutex array which is sized to CRYPTO_num_locks() and used
 // for the operation of the crypto lib's locking function that
-// is set using CRYPTO_set_locking_callback
+// is set using CRYPTO_set_locking_callback, OpenSSL 1.1 does its own locking
 static std::unique_ptr<std::recursive_mutex[]> sSslLocks;
 
 /*
@@ -121,15 +120,10 @@ static void _ssl_locking_function(int mode, int n, const char *file, int line)
  */
 void __init_ssl()
 {
-	static bool sIsSslInit = false;
-
-	// do initialization if needed
-#if defined(LIBUSENET_SSL_THREADS)
-	//std::unique_lock<std::mutex> initLock(sSslInitMutex);
-	std::lock_guard<std::mutex> initLock(sSslInitMutex);
-#endif /* LIBUSENET_SSL_THREADS */
-	if(!sIsSslInit)
+	static std::once_flag sSslInitFlag;
+	std::call_once(sSslInitFlag, []()
 	{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
 #if defined(LIBUSENET_SSL_THREADS)
 		// allocate mutex instances according to the value of CRYPTO_num_locks()
 		// add set our locking function, which is used by crypto lib to
@@ -143,10 +137,116 @@ void __init_ssl()
 		SSL_load_error_strings();
 		ERR_load_BIO_strings();
 		OpenSSL_add_all_algorithms();
+#else
+		OPENSSL_init_ssl(OPENSSL_INIT_LOAD_SSL_STRINGS|OPENSSL_INIT_LOAD_CRYPTO_STRINGS, nullptr);
+#endif
+	});
+}
 
-		sIsSslInit = true;
-	}
+// the last session with each server, by the address of the server
+static std::mutex sSslSessionMutex;
+static std::map<std::string, SSL_SESSION*> sSslSessions;
+
+static bool _get_ssl_peer(SSL *p_ssl, std::string& peer)
+{
+	sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	if(0 != getpeername(SSL_get_fd(p_ssl), (sockaddr*)&addr, &addrlen))
+		return false;
+
+	peer.assign((const char*)&addr, addrlen);
+	return true;
+}
+
+/*
+ * Called with each session, or TLS 1.3 ticket, the server gives, and it keeps
+ * the reference to the session
+ */
+static int _new_ssl_session(SSL *p_ssl, SSL_SESSION *p_session)
+{
+	std::string peer;
+	if(!_get_ssl_peer(p_ssl, peer))
+		return 0;
+
+	std::lock_guard<std::mutex> lock(sSslSessionMutex);
+	SSL_SESSION *&p_last = sSslSessions[peer];
+	if(nullptr != p_last)
+		SSL_SESSION_free(p_last);
+	p_last = p_session;
+	return 1;
+}
+
+SSL_CTX *__get_ssl_ctx()
+{
+	static SSL_CTX *sSslCtx = nullptr;
+	static std::once_flag sSslCtxFlag;
+
+	__init_ssl();
+	std::call_once(sSslCtxFlag, []()
+	{
+		// TLS, of any version the two ends have, with the sessions kept by _new_ssl_session
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+		sSslCtx = SSL_CTX_new(SSLv23_client_method());
+#else
+		sSslCtx = SSL_CTX_new(TLS_client_method());
+#endif
+		if(nullptr == sSslCtx)
+			return;
+
+		SSL_CTX_set_options(sSslCtx, SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
+		SSL_CTX_set_session_cache_mode(sSslCtx, SSL_SESS_CACHE_CLIENT|SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(sSslCtx, _new_ssl_session);
+	});
+
+	return sSslCtx;
 }
+
+void __resume_ssl_session(SSL *p_ssl)
+{
+	// only before the handshake has made a session of its own
+	std::string peer;
+	if((nullptr != SSL_get_session(p_ssl)) || !_get_ssl_peer(p_ssl, peer))
+		return;
+
+	std::lock_guard<std::mutex> lock(sSslSessionMutex);
+	auto it = sSslSessions.find(peer);
+	if(it != sSslSessions.end())
+		SSL_set_session(p_ssl, it->second);
+}
+
+bool __enable_ktls(SSL *p_ssl, bool enable)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	// SSL falls back to doing the encryption itself when the kernel hasn't the
+	// "tls" module or doesn't support the cipher negotiated
+	if(enable)
+		SSL_set_options(p_ssl, SSL_OP_ENABLE_KTLS);
+	else
+		SSL_clear_options(p_ssl, SSL_OP_ENABLE_KTLS);
+	return true;
+#else
+	return !enable;
+#endif
+}
+
+bool __is_ktls_recv(SSL *p_ssl)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	return(BIO_get_ktls_recv(SSL_get_rbio(p_ssl)) > 0);
+#else
+	return false;
+#endif
+}
+
+bool __is_ktls_send(SSL *p_ssl)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+	return(BIO_get_ktls_send(SSL_get_wbio(p_ssl)) > 0);
+#else
+	return false;
+#endif
+}
+
 #endif /* LIBUSENET_USE_SSL */
 
 }	/* namespace NetStream */
@@ -23,6 +23,9 @@
 
 #include "config.h"
 
+// the most a read waits on the server, until the response times are known
+#define STREAM_TIMEOUT	(60 * 2)
+
 namespace usenet {
 
 inline bool __check_response(std::basic_iostream<char>& ios, ResponseStatus expected_status)
@@ -32,6 +35,19 @@ inline bool __check_response(std::basic_iostream<char>& ios, ResponseStatus expe
 	return response.get_status() == expected_status;
 }
 
+// COMPRESS DEFLATE, which is active after a 206 response
+static bool __compress(std::basic_iostream<char>& ios)
+{
+	if(!NetStream::Deflate::is_supported())
+		return false;
+
+	Response response;
+	ios << compress << endf;
+	ios >> response;
+	return((ResponseStatus::CMD_OK == response.get_status()) && (ResponseFunction::CONNECTION == response.get_function())
+		&& (6 == response.get_number()));
+}
+
 static bool __authenticate(std::basic_iostream<char>& ios, const ServerProfile& server)
 {
 	std::string response;
@@ -74,51 +90,41 @@ throw(std::runtime_error)
 ServerProfile::ServerProfile(
 	const char *server_name, const char *username, const char *passwd, int num_connections, const char *port/* = "119"*/)
 throw(std::runtime_error)
-:	m_addr_len(0), m_num_conns(num_connections), m_username(username ? username : ""), m_password(passwd ? passwd : "")
+:	m_num_conns(num_connections), m_username(username ? username : ""), m_password(passwd ? passwd : "")
 {
-	addrinfo hints, *pAddrInfo;
-
-	// set up the hints structure
-	memset(&hints, 0, sizeof(struct addrinfo));
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = 6;
-	hints.ai_flags = AI_NUMERICSERV|AI_CANONNAME;
-
-	// get the address info - looking at the example code
-	// on the man page it seems that freeaddrinfo is not
-	// needed when an error code is returned
-	register int result = getaddrinfo(server_name, port, &hints, &pAddrInfo);
+	// get all of the IPv6 and IPv4 addresses, so a connect can race them
+	register int result = NetStream::resolve(server_name, port, m_addrs, &m_canon_name, AI_NUMERICSERV);
 	if(0 != result)
 		throw std::runtime_error(gai_strerror(result));
-
-	// save the address info and free the returned list
-	memcpy(&m_addr, pAddrInfo->ai_addr, sizeof(struct sockaddr));
-	m_addr_len = pAddrInfo->ai_addrlen;
-	m_canon_name.assign(pAddrInfo->ai_canonname);
-
-	freeaddrinfo(pAddrInfo);
 }
 
 ServerProfile::ServerProfile(const ServerProfile& that)
-:	m_addr_len(that.m_addr_len), m_canon_name(that.m_canon_name),
+:	m_addrs(that.m_addrs), m_canon_name(that.m_canon_name),
 	m_num_conns(that.m_num_conns),
 	m_username(that.m_username), m_password(that.m_password)
 	
 {
-	memcpy(&m_addr, &that.m_addr, sizeof(struct sockaddr));
 }
 
 ServerProfile::ServerProfile(ServerProfile&& that)
-:	m_addr_len(that.m_addr_len), m_canon_name(std::move(that.m_canon_name)),
+:	m_addrs(std::move(that.m_addrs)), m_canon_name(std::move(that.m_canon_name)),
 	m_num_conns(that.m_num_conns),
 	m_username(std::move(that.m_username)), m_password(std::move(that.m_password))
 	
 {
-	that.m_addr_len = 0;
+	that.m_addrs.clear();
 	that.m_num_conns = 1;
-	memcpy(&m_addr, &that.m_addr, sizeof(struct sockaddr));
-	bzero(&that.m_addr, sizeof(struct sockaddr));
+}
+
+const sockaddr& ServerProfile::get_addr() const
+{
+	static const sockaddr_storage s_no_addr = {};
+	return *(m_addrs.empty() ? (const sockaddr*)&s_no_addr : m_addrs.front().get());
+}
+
+size_t ServerProfile::get_addrlen() const
+{
+	return m_addrs.empty() ? 0 : m_addrs.front().addrlen;
 }
 
 Response::Response()
@@ -165,7 +171,7 @@ Response::operator bool() const
 }
 
 stream::stream(const ServerProfile& server, int bufsz/* = 2 * 8192*/)
-:	NetStream::basic_sockstream<char>(server.get_addr(), server.get_addrlen(), bufsz)
+:	NetStream::basic_sockstream<char>(server.get_addr_list(), bufsz)
 {
 	// check connection response
 	if(!__check_response(*this, ResponseStatus::CMD_OK))
@@ -174,20 +180,18 @@ stream::stream(const ServerProfile& server, int bufsz/* = 2 * 8192*/)
 		return;
 	}
 
-	// set a read timeout and handle any needed authentication
-	timeval to_time = { (60 * 2), 0, };
-	if(0 != setsockopt(m_buf.get_sock_fd(), SOL_SOCKET, SO_RCVTIMEO, &to_time, sizeof(to_time))
-		|| !__authenticate(*this, server))
-	{
+	// set a read timeout, which adapts below it to the response times, and
+	// handle any needed authentication
+	m_buf.set_timeout(STREAM_TIMEOUT);
+	if(!__authenticate(*this, server))
 		setstate(std::ios::failbit);
-	}
 }
 
 void stream::open(const ServerProfile& server)
 {
 	// close existing connection (if any)
 	close();
-	NetStream::basic_sockstream<char>(server.get_addr(), server.get_addrlen());
+	NetStream::basic_sockstream<char>::open(server.get_addr_list());
 
 	// check connection response
 	if(!__check_response(*this, ResponseStatus::CMD_OK))
@@ -196,18 +200,24 @@ void stream::open(const ServerProfile& server)
 		return;
 	}
 
-	// set a read timeout and handle any needed authentication
-	timeval to_time = { (60 * 2), 0, };
-	if(0 != setsockopt(m_buf.get_sock_fd(), SOL_SOCKET, SO_RCVTIMEO, &to_time, sizeof(to_time))
-		|| !__authenticate(*this, server))
-	{
+	// set a read timeout, which adapts below it to the response times, and
+	// handle any needed authentication
+	m_buf.set_timeout(STREAM_TIMEOUT);
+	if(!__authenticate(*this, server))
 		setstate(std::ios::failbit);
-	}
+}
+
+bool stream::compress()
+{
+	if(!__compress(*this))
+		return false;
+	m_buf.start_compression();
+	return true;
 }
 
 #ifdef USE_SSL
 sslstream::sslstream(const ServerProfile& server, int bufsz/* = 2 * 8192*/)
-:	NetStream::basic_sslsockstream<char>(server.get_addr(), server.get_addrlen(), bufsz)
+:	NetStream::basic_sslsockstream<char>(server.get_addr_list(), bufsz)
 {
 	// check connection response
 	if(!__check_response(*this, ResponseStatus::CMD_OK))
@@ -216,20 +226,18 @@ sslstream::sslstream(const ServerProfile& server, int bufsz/* = 2 * 8192*/)
 		return;
 	}
 
-	// set a read timeout and handle any needed authentication
-	timeval to_time = { (60 * 2), 0, };
-	if(0 != setsockopt(m_buf.get_sock_fd(), SOL_SOCKET, SO_RCVTIMEO, &to_time, sizeof(to_time))
-		|| !__authenticate(*this, server))
-	{
+	// set a read timeout, which adapts below it to the response times, and
+	// handle any needed authentication
+	m_buf.set_timeout(STREAM_TIMEOUT);
+	if(!__authenticate(*this, server))
 		setstate(std::ios::failbit);
-	}
 }
 
 void sslstream::open(const ServerProfile& server)
 {
 	// close existing connection (if any)
 	close();
-	NetStream::basic_sslsockstream<char>(server.get_addr(), server.get_addrlen());
+	NetStream::basic_sslsockstream<char>::open(server.get_addr_list());
 
 	// check connection response
 	if(!__check_response(*this, ResponseStatus::CMD_OK))
@@ -238,13 +246,19 @@ void sslstream::open(const ServerProfile& server)
 		return;
 	}
 
-	// set a read timeout and handle any needed authentication
-	timeval to_time = { (60 * 2), 0, };
-	if(0 != setsockopt(m_buf.get_sock_fd(), SOL_SOCKET, SO_RCVTIMEO, &to_time, sizeof(to_time))
-		|| !__authenticate(*this, server))
-	{
+	// set a read timeout, which adapts below it to the response times, and
+	// handle any needed authentication
+	m_buf.set_timeout(STREAM_TIMEOUT);
+	if(!__authenticate(*this, server))
 		setstate(std::ios::failbit);
-	}
+}
+
+bool sslstream::compress()
+{
+	if(!__compress(*this))
+		return false;
+	m_buf.start_compression();
+	return true;
 }
 #endif /* USE_SSL */
 
@@ -256,6 +270,7 @@ const std::string article("ARTICLE ");
 const std::string group("GROUP ");
 const std::string post("POST");
 const std::string quit("QUIT");
+const std::string compress("COMPRESS DEFLATE");
 
 const std::string hdr_msgid("Message-ID: ");
 const std::string hdr_subject("Subject: ");
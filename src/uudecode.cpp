@@ -0,0 +1,179 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include <libusenet/uudecode.h>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+using yEnc::DecodeResult;
+
+#define UU_MAX_LINE_BYTES		45
+
+UUDecoder::UUDecoder()
+:	m_line(0), m_mode(0), m_name(""), m_size(0), m_decoded_size(0),
+	m_header(false), m_trailer(false), m_truncated(false), m_calc_crc32()
+{
+}
+
+UUDecoder::~UUDecoder()
+{
+}
+
+void UUDecoder::reset()
+{
+	*this = UUDecoder();
+}
+
+bool UUDecoder::decode_begin_line(const char *encoded_line, int len)
+{
+	// begin <mode> <name>, the mode is octal and the name is the rest of the line
+	if((len < 9) || (0 != strncmp(encoded_line, "begin ", 6)))
+		return false;
+
+	int i = 6;
+	unsigned int mode = 0;
+	for(; (i < len) && (encoded_line[i] >= '0') && (encoded_line[i] <= '7'); ++i)
+		mode = (mode << 3) + (encoded_line[i] - '0');
+
+	if((6 == i) || (i > 10) || ((i + 1) >= len) || (' ' != encoded_line[i]))
+		return false;
+
+	m_mode = mode;
+	m_name.assign(encoded_line + i + 1, len - i - 1);
+	return true;
+}
+
+long UUDecoder::decode_line(unsigned char *pBuf, const char *encoded_line, int len)
+{
+	// the first char is the count of bytes on the line, then four chars
+	// for every three bytes; ' ' and '`' are both zero
+	register unsigned int count = (unsigned char)(encoded_line[0] - ' ');
+	if(count > 64)
+		return -1;
+	count &= 0x3f;
+	if(count > UU_MAX_LINE_BYTES)
+		return -1;
+
+	const unsigned char *p_in = (const unsigned char*)encoded_line + 1;
+	const int avail = len - 1;
+
+	// gateways can strip the trailing spaces of a line, which are zero
+	// values, so a short line is padded with them
+	unsigned char padded[UU_MAX_LINE_BYTES / 3 * 4];
+	const int needed = (int)((count + 2) / 3) * 4;
+	if(avail < needed)
+	{
+		memcpy(padded, p_in, avail);
+		memset(padded + avail, ' ', needed - avail);
+		p_in = padded;
+	}
+
+	unsigned char *p_out = pBuf;
+	for(register unsigned int remaining = count; remaining > 0; p_in += 4)
+	{
+		register unsigned int c0 = p_in[0] - ' ', c1 = p_in[1] - ' ', c2 = p_in[2] - ' ', c3 = p_in[3] - ' ';
+		if((c0 > 64) || (c1 > 64) || (c2 > 64) || (c3 > 64))
+			return -1;
+
+		register uint32_t bits = ((c0 & 0x3f) << 18) | ((c1 & 0x3f) << 12) | ((c2 & 0x3f) << 6) | (c3 & 0x3f);
+		if(remaining >= 3)
+		{
+			p_out[0] = (unsigned char)(bits >> 16);
+			p_out[1] = (unsigned char)(bits >> 8);
+			p_out[2] = (unsigned char)bits;
+			p_out += 3;
+			remaining -= 3;
+		}
+		else
+		{
+			p_out[0] = (unsigned char)(bits >> 16);
+			if(2 == remaining)
+				p_out[1] = (unsigned char)(bits >> 8);
+			p_out += remaining;
+			remaining = 0;
+		}
+	}
+
+	return p_out - pBuf;
+}
+
+DecodeResult UUDecoder::decode(unsigned char **ppMem, const char *encoded_line, int len)
+{
+	if((0 == ppMem) || (0 == encoded_line) || (0 == len))
+		return DecodeResult::YENC_NONE;
+
+	int declen = 0;
+	DecodeResult result = decode(*ppMem, &declen, encoded_line, len);
+	*ppMem += declen;
+	return result;
+}
+
+DecodeResult UUDecoder::decode(unsigned char *pBuf, int *pLen, const char *encoded_line, int len)
+{
+	if((0 == pBuf) || (0 == encoded_line))
+		return DecodeResult::YENC_NONE;
+
+	// ignore a trailing CR or spaces, the spaces are zero values which
+	// decode_line pads a short line with anyway
+	while((len > 0) && isspace((unsigned char)encoded_line[len - 1]))
+		--len;
+	if(0 == len)
+		return DecodeResult::YENC_NONE;
+
+	// text before the begin line is not part of the file
+	if(!m_header)
+	{
+		m_header = decode_begin_line(encoded_line, len);
+		return DecodeResult::YENC_NONE;
+	}
+
+	if(m_trailer)
+	{
+		if((len > 5) && (0 == strncmp(encoded_line, "size ", 5)))
+			m_size = strtoul(encoded_line + 5, nullptr, 10);
+		return DecodeResult::YENC_NONE;
+	}
+
+	if((3 == len) && (0 == strncmp(encoded_line, "end", 3)))
+	{
+		m_trailer = true;
+		return DecodeResult::YENC_COMPLETE;
+	}
+
+	register long declen = decode_line(pBuf, encoded_line, len);
+	if(declen < 0)
+	{
+		m_truncated = true;
+		return DecodeResult::YENC_TRUNCATED;
+	}
+
+	// the zero length line before "end"
+	if(0 == declen)
+		return DecodeResult::YENC_NONE;
+
+	*pLen += declen;
+	++m_line;
+	m_decoded_size += declen;
+
+	// update the working CRC
+	m_calc_crc32.update_crc(pBuf, declen);
+
+	return DecodeResult::YENC_DATA;
+}
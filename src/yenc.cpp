@@ -18,10 +18,18 @@
 	Boston, MA 02110-1301 USA.
 */
 #include <libusenet/yenc.h>
+#include "yencKernels.h"
+#include "inputFile.h"
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <iostream>
-#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 namespace yEnc {
 
@@ -81,65 +89,49 @@ static std::string get_filename(const std::string& path)
 	return path;
 }
 
+static std::ostream& crlf_endl(std::ostream& out)
+{
+	out << "\r\n";
+	return out;
+}
+
 #define IOBUF_LEN		(1024 * 8)
 
-void encode_file(const std::string& path, std::ostream& out, int line_size/* = 128*/)
+// input is encoded in chunks of this size, read in place from a mapped file
+#define INPUT_CHUNK_LEN		(1024 * 256)
+
+void encode_file(const std::string& path, std::ostream& out, int line_size/* = 128*/, bool map_input/* = true*/)
 throw(std::runtime_error)
 {
-	std::ifstream in(path, std::ifstream::binary);
-	if(!in)
-		throw std::runtime_error("Cannot open file: " + path);
-
-	// determine the size of the file
-	unsigned long file_size = 0;
-	in.seekg(0, in.end);
-	file_size = in.tellg();
-	in.seekg(0, in.beg);
+	InputFile in(path, map_input);
 
 	Encoder yEncoder(get_filename(path).c_str(), line_size);
-	yEncoder.encode_init(out, file_size);
+	yEncoder.encode_init(out, in.get_size());
 
-	register int rdsz;
-	char iobuf[IOBUF_LEN];
-	in.read(iobuf, IOBUF_LEN);
-	while(0 < (rdsz = in.gcount()))
-	{
-		yEncoder.encode_chunk(out, iobuf, rdsz);
-
-		// read next data chunk
-		in.read(iobuf, IOBUF_LEN);
-	}
+	const char *p_data;
+	register unsigned long rdsz;
+	while(0 < (rdsz = in.read(&p_data, INPUT_CHUNK_LEN)))
+		yEncoder.encode_chunk(out, p_data, rdsz);
 
 	yEncoder.encode_close(out);
 }
 
 
-void encode_file_for_usenet(const std::string& path, std::ostream& out, int line_size/* = 128*/)
+void encode_file_for_usenet(const std::string& path, std::ostream& out, int line_size/* = 128*/, bool map_input/* = true*/)
 throw(std::runtime_error)
 {
-	std::ifstream in(path, std::ifstream::binary);
-	if(!in)
-		throw std::runtime_error("Cannot open file: " + path);
+	InputFile in(path, map_input);
 
-	// determine the size of the file
-	unsigned long file_size = 0;
-	in.seekg(0, in.end);
-	file_size = in.tellg();
-	in.seekg(0, in.beg);
+	Encoder yEncoder(get_filename(path).c_str(), crlf_endl, line_size);
+	yEncoder.encode_init(out, in.get_size());
 
-	Encoder yEncoder(get_filename(path).c_str(), [](std::ostream& o) -> std::ostream& { o << "\r\n"; return o; }, line_size);
-	yEncoder.encode_init(out, file_size);
-
-	register int rdsz;
-	char iobuf[IOBUF_LEN];
-	in.read(iobuf, IOBUF_LEN);
-	while(0 < (rdsz = in.gcount()))
-	{
-		yEncoder.encode_usenet_chunk(out, iobuf, rdsz);
+	// the line ending is known to be "\r\n" so encode directly to a buffer
+	std::vector<char> encbuf(Encoder::get_max_encoded_size(INPUT_CHUNK_LEN, line_size, LineEndCRLF::size));
 
-		// read next data chunk
-		in.read(iobuf, IOBUF_LEN);
-	}
+	const char *p_data;
+	register unsigned long rdsz;
+	while(0 < (rdsz = in.read(&p_data, INPUT_CHUNK_LEN)))
+		out.write(&encbuf[0], yEncoder.encode_buffer<LineEndCRLF, DotStuffing>(&encbuf[0], encbuf.size(), p_data, rdsz));
 
 	yEncoder.encode_close(out);
 }
@@ -148,32 +140,19 @@ void encode_file(
 	const std::string& path,
 	std::ostream& out,
 	std::ostream& (*end_line)(std::ostream&),
-	int line_size/* = 128*/)
+	int line_size/* = 128*/,
+	bool map_input/* = true*/)
 throw(std::runtime_error)
 {
-	std::ifstream in(path, std::ifstream::binary);
-	if(!in)
-		throw std::runtime_error("Cannot open file: " + path);
-
-	// determine the size of the file
-	unsigned long file_size = 0;
-	in.seekg(0, in.end);
-	file_size = in.tellg();
-	in.seekg(0, in.beg);
+	InputFile in(path, map_input);
 
 	Encoder yEncoder(get_filename(path).c_str(), end_line, line_size);
-	yEncoder.encode_init(out, file_size);
+	yEncoder.encode_init(out, in.get_size());
 
-	register int rdsz;
-	char iobuf[IOBUF_LEN];
-	in.read(iobuf, IOBUF_LEN);
-	while(0 < (rdsz = in.gcount()))
-	{
-		yEncoder.encode_chunk(out, iobuf, rdsz);
-
-		// read next data chunk
-		in.read(iobuf, IOBUF_LEN);
-	}
+	const char *p_data;
+	register unsigned long rdsz;
+	while(0 < (rdsz = in.read(&p_data, INPUT_CHUNK_LEN)))
+		yEncoder.encode_chunk(out, p_data, rdsz);
 
 	yEncoder.encode_close(out);
 }
@@ -182,34 +161,136 @@ void encode_file_for_usenet(
 	const std::string& path,
 	std::ostream& out,
 	std::ostream& (*end_line)(std::ostream&),
-	int line_size/* = 128*/)
+	int line_size/* = 128*/,
+	bool map_input/* = true*/)
 throw(std::runtime_error)
 {
-	std::ifstream in(path, std::ifstream::binary);
-	if(!in)
-		throw std::runtime_error("Cannot open file: " + path);
-
-	// determine the size of the file
-	unsigned long file_size = 0;
-	in.seekg(0, in.end);
-	file_size = in.tellg();
-	in.seekg(0, in.beg);
+	InputFile in(path, map_input);
 
 	Encoder yEncoder(get_filename(path).c_str(), end_line, line_size);
-	yEncoder.encode_init(out, file_size);
+	yEncoder.encode_init(out, in.get_size());
+
+	const char *p_data;
+	register unsigned long rdsz;
+	while(0 < (rdsz = in.read(&p_data, INPUT_CHUNK_LEN)))
+		yEncoder.encode_usenet_chunk(out, p_data, rdsz);
+
+	yEncoder.encode_close(out);
+}
 
-	register int rdsz;
-	char iobuf[IOBUF_LEN];
-	in.read(iobuf, IOBUF_LEN);
-	while(0 < (rdsz = in.gcount()))
+// run 'job' for items 0 to count - 1 on 'num_threads' threads, the first
+// exception thrown by a job stops the remaining items and is rethrown
+static void run_parallel(unsigned int count, unsigned int num_threads, const std::function<void(unsigned int)>& job)
+{
+	std::atomic<unsigned int> next(0);
+	std::exception_ptr error;
+	std::mutex error_lock;
+
+	auto worker = [&]()
 	{
-		yEncoder.encode_usenet_chunk(out, iobuf, rdsz);
+		for(unsigned int i = next++; i < count; i = next++)
+		{
+			try
+			{
+				job(i);
+			}
+			catch(...)
+			{
+				std::lock_guard<std::mutex> lock(error_lock);
+				if(!error)
+					error = std::current_exception();
+				next = count;
+			}
+		}
+	};
 
-		// read next data chunk
-		in.read(iobuf, IOBUF_LEN);
-	}
+	std::vector<std::thread> threads;
+	for(unsigned int i = 1; i < num_threads; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for(auto& thread : threads)
+		thread.join();
 
-	yEncoder.encode_close(out);
+	if(error)
+		std::rethrow_exception(error);
+}
+
+uint32_t encode_file_parts(
+	const std::string& path,
+	unsigned long part_size,
+	const PartHandler& handler,
+	int line_size/* = 128*/,
+	unsigned int num_threads/* = 0*/,
+	bool map_input/* = true*/)
+throw(std::runtime_error)
+{
+	if(0 == part_size)
+		throw std::runtime_error("yEnc::encode_file_parts: part size is zero");
+
+	InputFile in(path, map_input);
+
+	const unsigned long file_size = in.get_size();
+	const unsigned int parts_total = std::max(1UL, (file_size + part_size - 1) / part_size);
+
+	if(0 == num_threads)
+		num_threads = std::max(1U, std::thread::hardware_concurrency());
+	num_threads = std::min(num_threads, parts_total);
+
+	auto get_part_len = [file_size, part_size](unsigned int i) -> unsigned long
+	{
+		return std::min(part_size, file_size - (i * part_size));
+	};
+
+	// every =yend carries the whole file crc32, so the part CRCs are needed
+	// before any part can be finished; CRC them first and combine in order
+	std::vector<uint32_t> part_crcs(parts_total);
+	run_parallel(parts_total, num_threads, [&](unsigned int i)
+	{
+		const unsigned long len = get_part_len(i);
+		std::unique_ptr<char[]> buf(in.is_in_memory() ? nullptr : new char[len]);
+		part_crcs[i] = Crc32::compute(in.read_at(buf.get(), len, i * part_size), len, 1);
+	});
+
+	uint32_t file_crc = part_crcs[0];
+	for(unsigned int i = 1; i < parts_total; ++i)
+		file_crc = Crc32::combine(file_crc, part_crcs[i], get_part_len(i));
+
+	const std::string name = get_filename(path);
+	run_parallel(parts_total, num_threads, [&](unsigned int i)
+	{
+		const unsigned long offset = i * part_size;
+		const unsigned long len = get_part_len(i);
+		std::unique_ptr<char[]> buf(in.is_in_memory() ? nullptr : new char[len]);
+		const char *p_data = in.read_at(buf.get(), len, offset);
+
+		Encoder yEncoder(name.c_str(), crlf_endl, line_size);
+
+		// an empty file has no bytes for =ypart begin and end to give, so it is
+		// a single part article
+		std::ostringstream head;
+		if(0 == file_size)
+			yEncoder.encode_init(head, file_size);
+		else
+			yEncoder.encode_init(head, file_size, i + 1, offset + 1, offset + len, parts_total);
+
+		std::string article = head.str();
+		const std::string::size_type head_len = article.size();
+		article.resize(head_len + Encoder::get_max_encoded_size(len, line_size, LineEndCRLF::size));
+		article.resize(head_len + yEncoder.encode_buffer<LineEndCRLF, DotStuffing>(
+			&article[head_len], article.size() - head_len, p_data, len));
+
+		// the file must not change between the two passes
+		if(yEncoder.get_crc32() != part_crcs[i])
+			throw std::runtime_error("File changed while encoding: " + path);
+
+		std::ostringstream tail;
+		yEncoder.encode_close(tail, file_crc);
+		article += tail.str();
+
+		handler(i + 1, article.data(), article.size());
+	});
+
+	return file_crc;
 }
 
 void Encoder::set_endl(std::ostream& (*end_line)(std::ostream&))
@@ -244,77 +325,79 @@ void Encoder::encode_init(
 	m_crc32.reset();
 }
 
-void Encoder::encode_chunk(std::ostream& out, void *p_bytes, unsigned int len)
+unsigned long Encoder::get_max_encoded_size(unsigned long len, int line_size, int eol_size/* = LineEndCRLF::size*/)
 {
-	for(register unsigned int i = 0; i < len; ++i)
-	{
-		// encode the byte to yEnc and check for a critical character
-		register char c = ((unsigned char*)p_bytes)[i] + 42;
-		if(c == 0x00 || c == 0x0a || c == 0x0d || c == 0x3d)
-		{
-			// write the yEnc escape for the critical character
-			out << '=';
-			c = char(c + 64);
-			++m_line_col;
-		}
+	// every byte can be escaped and every line can start with a doubled '.', a
+	// line can hold one less than line_size chars when it ends with an escape
+	register unsigned long max_chars = 2 * len;
+	register unsigned long max_lines = (max_chars / ((line_size > 1) ? (line_size - 1) : 1)) + 2;
+	return max_chars + (max_lines * (1 + eol_size));
+}
 
-		// write the yEnc encoded char
-		out << c;
-		++m_line_col;
+template<typename LineEnd, typename Dots>
+unsigned long Encoder::encode_buffer(char *p_dst, unsigned long dst_len, const void *p_bytes, unsigned long len)
+throw(std::length_error)
+{
+	if(dst_len < get_max_encoded_size(len, m_line_size, LineEnd::size))
+		throw std::length_error("yEnc::Encoder::encode_buffer: output buffer is too small");
 
-		// check the line size
-		if(m_line_col >= m_line_size)
-		{
-			out << m_endl;
-			m_line_col = 0;
-		}
-	}
+	register unsigned long result = Kernel::encode<LineEnd::size, Dots::enabled>(
+		p_dst, (const uint8_t*)p_bytes, len, &m_line_col, m_line_size);
 
 	// calculate the CRC
-	m_crc32.update_crc((uint8_t*)p_bytes, len);
+	m_crc32.update_crc((const uint8_t*)p_bytes, len);
 
 	// update the size
 	m_trailer_size += len;
+
+	return result;
 }
 
-void Encoder::encode_usenet_chunk(std::ostream& out, void *p_bytes, unsigned int len)
+template unsigned long Encoder::encode_buffer<LineEndLF, NoDotStuffing>(char*, unsigned long, const void*, unsigned long);
+template unsigned long Encoder::encode_buffer<LineEndLF, DotStuffing>(char*, unsigned long, const void*, unsigned long);
+template unsigned long Encoder::encode_buffer<LineEndCRLF, NoDotStuffing>(char*, unsigned long, const void*, unsigned long);
+template unsigned long Encoder::encode_buffer<LineEndCRLF, DotStuffing>(char*, unsigned long, const void*, unsigned long);
+
+template<typename Dots>
+void Encoder::write_chunk(std::ostream& out, const void *p_bytes, unsigned int len)
 {
-	for(register unsigned int i = 0; i < len; ++i)
-	{
-		// encode the byte to yEnc and check for a critical character
-		register char c = ((unsigned char*)p_bytes)[i] + 42;
-		if(c == 0x00 || c == 0x0a || c == 0x0d || c == 0x3d)
-		{
-			// write the yEnc escape for the critical character
-			out << '=';
-			c = char(c + 64);
-			++m_line_col;
-		}
+	// the data is encoded with '\n' line endings, which can't be in the encoded
+	// data, so the lines can be written with the end_line manipulator
+	m_obuf.resize(get_max_encoded_size(std::min(len, (unsigned int)IOBUF_LEN), m_line_size, LineEndLF::size));
 
-		// write the yEnc encoded char
-		out << c;
-		++m_line_col;
+	const uint8_t *p_in = (const uint8_t*)p_bytes;
+	while(len > 0)
+	{
+		register unsigned int inlen = std::min(len, (unsigned int)IOBUF_LEN);
+		register unsigned long outlen = encode_buffer<LineEndLF, Dots>(&m_obuf[0], m_obuf.size(), p_in, inlen);
+		p_in += inlen;
+		len -= inlen;
 
-		// double '.' chars if they are at the first position of a line (usenet)
-		if((1 == m_line_col) && ('.' == c))
+		const char *p_line = &m_obuf[0], *p_end = p_line + outlen;
+		while(p_line < p_end)
 		{
-			out << c;
-			++m_line_col;
-		}
+			const char *p_eol = (const char*)memchr(p_line, '\n', p_end - p_line);
+			if(nullptr == p_eol)
+			{
+				out.write(p_line, p_end - p_line);
+				break;
+			}
 
-		// check the line size
-		if(m_line_col >= m_line_size)
-		{
+			out.write(p_line, p_eol - p_line);
 			out << m_endl;
-			m_line_col = 0;
+			p_line = p_eol + 1;
 		}
 	}
+}
 
-	// calculate the CRC
-	m_crc32.update_crc((uint8_t*)p_bytes, len);
+void Encoder::encode_chunk(std::ostream& out, const void *p_bytes, unsigned int len)
+{
+	write_chunk<NoDotStuffing>(out, p_bytes, len);
+}
 
-	// update the size
-	m_trailer_size += len;
+void Encoder::encode_usenet_chunk(std::ostream& out, const void *p_bytes, unsigned int len)
+{
+	write_chunk<DotStuffing>(out, p_bytes, len);
 }
 
 void Encoder::encode_close(std::ostream& out)
@@ -343,7 +426,10 @@ void Encoder::encode_close(std::ostream& out, unsigned int total_crc32)
 
 Decoder::Decoder()
 :	m_line(0), m_head_size(0), m_trail_size(0), m_head_part(0), m_trail_part(0), m_crc32(0), m_name(""),
-	m_part_begin(0), m_part_end(0), m_part_crc32(0), m_calc_crc32(), m_part_flags(0)
+	m_part_begin(0), m_part_end(0), m_part_crc32(0), m_calc_crc32(), m_data_size(0), m_data_lines(0),
+	m_damage(), m_last_line(), m_feed_state(FEED_LINE_START), m_escape(0), m_kw_line(),
+	m_feed_line_offset(0), m_feed_line_chars(0), m_feed_line_stuffed(false),
+	m_out_buf(nullptr), m_out_size(0), m_out_len(0), m_part_flags(0)
 {
 }
 
@@ -395,7 +481,10 @@ int Decoder::decode_kw_line(const char *encoded_line, int enclen)
 		else if(0 == strncmp("end", token, toklen))
 			i = yencReadULongValue(&m_part_end, &encoded_line[i]) - encoded_line;
 		else if(0 == strncmp("pcrc32", token, toklen))
+		{
 			i = yencReadUInt16Value(&m_part_crc32, &encoded_line[i]) - encoded_line;
+			m_part_flags[YENC_PART_CRC32] = true;
+		}
 		else if(0 == strncmp("crc32", token, toklen))
 		{
 			i = yencReadUInt16Value(&m_crc32, &encoded_line[i]) - encoded_line;
@@ -458,17 +547,12 @@ DecodeResult Decoder::decode(unsigned char **ppMem, const char *encoded_line, in
 	uint8_t *p_buf = *ppMem;
 
 	// decode a line of yenc encoded data
-	for(register int i = 0; i < len; ++i)
-	{
-		if('=' != encoded_line[i])
-			*((*ppMem)++) = (unsigned char)encoded_line[i] - (unsigned char)42;
-		else
-		{
-			if(++i == len)
-				return DecodeResult::YENC_TRUNCATED;
-			*((*ppMem)++) = (unsigned char)encoded_line[i] - (unsigned char)106;
-		}
-	}
+	int escape = 0;
+	*ppMem += Kernel::decode(p_buf, encoded_line, len, &escape);
+	check_line(m_data_size, *ppMem - p_buf, len, 0 != escape, '.' == *encoded_line);
+	m_data_size += *ppMem - p_buf;
+	if(escape)
+		return DecodeResult::YENC_TRUNCATED;
 
 	// update the working CRC
 	m_calc_crc32.update_crc(p_buf, *ppMem - p_buf);
@@ -491,26 +575,383 @@ DecodeResult Decoder::decode(unsigned char *pBuf, int *pLen, const char *encoded
 	// decoded the header keyword line yet?
 	if(m_line <= 0) return DecodeResult::YENC_NONE;
 
-	uint8_t *p_buf = pBuf;
-
 	// decode a line of yenc encoded data
-	for(register int i = 0; i < len; ++i)
+	int escape = 0;
+	register long declen = Kernel::decode(pBuf, encoded_line, len, &escape);
+	*pLen += declen;
+	check_line(m_data_size, declen, len, 0 != escape, '.' == *encoded_line);
+	m_data_size += declen;
+	if(escape)
+		return DecodeResult::YENC_TRUNCATED;
+
+	// update the working CRC
+	m_calc_crc32.update_crc(pBuf, declen);
+
+	return DecodeResult::YENC_DATA;
+}
+
+bool Decoder::add_part_crc(Crc32Combiner& file_crc) const
+{
+	// =ypart begin is 1 based, a single part file is the whole file
+	if(is_part())
+		return file_crc.add(m_part_begin - 1, (m_part_end - m_part_begin) + 1, get_actual_crc32());
+	return file_crc.add(0, m_head_size, get_actual_crc32());
+}
+
+void Decoder::check_line(unsigned long offset, unsigned long declen, long enclen, bool truncated, bool stuffed)
+{
+	// a line is only short if another one follows, so the previous line is
+	// checked now and this one is held back
+	DamageRange range;
+	if((m_data_lines > 0) && get_line_damage(m_last_line, false, &range))
+		m_damage.push_back(range);
+
+	++m_data_lines;
+	m_last_line = LineInfo{ m_data_lines, offset, declen, enclen, truncated, stuffed };
+}
+
+bool Decoder::get_line_damage(const LineInfo& line, bool is_last, DamageRange *p_range) const
+{
+	// an encoder ends a line at line= chars, or one more when the last char
+	// is escaped, and only the last line of the data can be shorter.  A '.'
+	// doubled at the start of a line may have been counted toward line=.
+	if(line.truncated)
+		p_range->reason = Damage::TRUNCATED_LINE;
+	else if(line.enclen > ((long)m_line + 1))
+		p_range->reason = Damage::LONG_LINE;
+	else if(!is_last && (line.enclen < ((long)m_line - (line.stuffed ? 1 : 0))))
+		p_range->reason = Damage::SHORT_LINE;
+	else
+		return false;
+
+	p_range->begin = line.offset;
+	p_range->end = line.offset + line.length;
+	p_range->line = line.number;
+	return true;
+}
+
+bool Decoder::is_consistent() const
+{
+	if(is_part())
+	{
+		// =ypart begin and end are 1 based and inclusive
+		if((0 == m_part_begin) || (m_part_end < m_part_begin))
+			return false;
+		if(is_header() && (m_part_end > m_head_size))
+			return false;
+		if(is_trailer() && (m_trail_size != ((m_part_end - m_part_begin) + 1)))
+			return false;
+	}
+	else if(is_header() && is_trailer() && (m_trail_size != m_head_size))
+		return false;
+
+	return !is_trailer() || (0 == m_trail_part) || (m_trail_part == m_head_part);
+}
+
+std::vector<DamageRange> Decoder::get_damage() const
+{
+	std::vector<DamageRange> result;
+
+	// the size the part should have, by the most specific keyword
+	unsigned long expected = m_data_size;
+	if(is_trailer())
+		expected = m_trail_size;
+	else if(is_part())
+		expected = (m_part_end - m_part_begin) + 1;
+	else if(is_header())
+		expected = m_head_size;
+
+	const unsigned long part_end = std::max(expected, m_data_size);
+
+	if(!is_consistent())
+	{
+		result.push_back(DamageRange{ 0, part_end, 0, Damage::BAD_KEYWORDS });
+		return result;
+	}
+
+	// a part is good if its CRC is good, whatever its lines look like
+	const bool has_crc = m_part_flags[is_part() ? YENC_PART_CRC32 : YENC_CRC32];
+	const unsigned int crc = is_part() ? m_part_crc32 : m_crc32;
+	const bool crc_ok = has_crc && (crc == get_actual_crc32());
+	if(crc_ok && (m_data_size == expected))
+		return result;
+
+	result = m_damage;
+	DamageRange range;
+	if((m_data_lines > 0) && get_line_damage(m_last_line, true, &range))
+		result.push_back(range);
+
+	if(m_data_size != expected)
 	{
-		if('=' != encoded_line[i])
-			*(pBuf++) = (unsigned char)encoded_line[i] - (unsigned char)42;
+		if(!result.empty())
+		{
+			// the data after the first bad line is off by the size difference
+			if(result.front().end < part_end)
+				result.push_back(DamageRange{ result.front().end, part_end, 0, Damage::MISPLACED_DATA });
+		}
+		else if(!is_trailer() && (m_data_size < expected))
+			result.push_back(DamageRange{ m_data_size, expected, 0, Damage::MISSING_DATA });
 		else
+			result.push_back(DamageRange{ 0, part_end, 0, Damage::SIZE_MISMATCH });
+	}
+	else if(result.empty() && has_crc)
+		result.push_back(DamageRange{ 0, part_end, 0, Damage::CRC_MISMATCH });
+
+	return result;
+}
+
+DecodeResult Decoder::decode_body(
+	unsigned char *pBuf, unsigned long *pLen, const char *raw, unsigned long len, unsigned long *pUsed)
+{
+	const char *p_raw = raw, *p_end = raw + len;
+	uint8_t *p_out = pBuf;
+	bool is_truncated = false;
+
+	while((p_raw < p_end) && !m_part_flags[YENC_BODY_END])
+	{
+		// a partial line is left for the next call
+		const char *p_eol = (const char*)memchr(p_raw, '\n', p_end - p_raw);
+		if(nullptr == p_eol)
+			break;
+
+		const char *p_line = p_raw;
+		p_raw = p_eol + 1;
+		if((p_eol > p_line) && ('\r' == p_eol[-1]))
+			--p_eol;
+
+		// NNTP: a '.' at the start of a line is doubled, unless it is the end of the body
+		const bool is_stuffed = ('.' == *p_line);
+		if(is_stuffed)
+		{
+			if(1 == (p_eol - p_line))
+			{
+				m_part_flags[YENC_BODY_END] = true;
+				break;
+			}
+			++p_line;
+		}
+
+		const int linelen = p_eol - p_line;
+		if((linelen >= 2) && ('=' == p_line[0]) && ('y' == p_line[1]))
+			decode_kw_line(p_line, linelen);
+		else if((m_line > 0) && !m_part_flags[YENC_TRAILER])
 		{
-			if(++i == len)
-				return DecodeResult::YENC_TRUNCATED;
-			*(pBuf++) = (unsigned char)encoded_line[i] - (unsigned char)106;
+			// decode a line of yenc encoded data
+			int escape = 0;
+			const long declen = Kernel::decode(p_out, p_line, linelen, &escape);
+			check_line(m_data_size + (p_out - pBuf), declen, linelen, 0 != escape, is_stuffed);
+			p_out += declen;
+			is_truncated |= (0 != escape);
 		}
-		++*pLen;
 	}
 
-	// update the working CRC
-	m_calc_crc32.update_crc(p_buf, pBuf - p_buf);
+	// update the working CRC for all data lines at once
+	m_calc_crc32.update_crc(pBuf, p_out - pBuf);
+	m_data_size += p_out - pBuf;
 
-	return DecodeResult::YENC_DATA;
+	*pLen += p_out - pBuf;
+	*pUsed = p_raw - raw;
+
+	if(is_truncated)
+		return DecodeResult::YENC_TRUNCATED;
+	if(m_part_flags[YENC_TRAILER])
+		return DecodeResult::YENC_COMPLETE;
+	return (p_out > pBuf) ? DecodeResult::YENC_DATA : DecodeResult::YENC_NONE;
+}
+
+// longest keyword line kept by feed, the rest of a longer line is dropped
+#define YENC_MAX_KW_LINE	size_t(4096)
+
+DecodeResult Decoder::feed(const char *data, size_t len, size_t *pUsed/* = nullptr*/)
+{
+	const char *p_in = data, *p_end = data + len;
+	uint8_t *p_start = m_out_buf + m_out_len;
+	uint8_t *p_out = p_start;
+
+	while((p_in < p_end) && (FEED_END != m_feed_state))
+	{
+		switch(m_feed_state)
+		{
+			case FEED_LINE_START:
+				m_feed_line_offset = m_data_size + (p_out - p_start);
+				m_feed_line_chars = 0;
+				m_feed_line_stuffed = false;
+
+				// NNTP: a '.' at the start of a line is doubled, unless it is the end of the body
+				if('.' == *p_in)
+				{
+					m_feed_state = FEED_DOT;
+					++p_in;
+				}
+				else if('=' == *p_in)
+				{
+					m_feed_state = FEED_EQ;
+					++p_in;
+				}
+				else
+					m_feed_state = FEED_DATA;
+				break;
+
+			case FEED_DOT:
+				// the line start '.' is dropped, ".\r\n" is the end of the body
+				m_feed_line_stuffed = true;
+				if('\r' == *p_in)
+				{
+					m_feed_state = FEED_DOT_CR;
+					++p_in;
+				}
+				else if('\n' == *p_in)
+				{
+					m_feed_state = FEED_END;
+					++p_in;
+				}
+				else if('=' == *p_in)
+				{
+					m_feed_state = FEED_EQ;
+					++p_in;
+				}
+				else
+					m_feed_state = FEED_DATA;
+				break;
+
+			case FEED_DOT_CR:
+				if('\n' == *p_in)
+				{
+					m_feed_state = FEED_END;
+					++p_in;
+				}
+				else
+					m_feed_state = FEED_DATA_CR;
+				break;
+
+			case FEED_EQ:
+				// "=y" starts a keyword line, else the '=' is an escape
+				if('y' == *p_in)
+				{
+					m_kw_line.assign("=y");
+					m_feed_state = FEED_KEYWORD;
+					++p_in;
+				}
+				else
+				{
+					// outside of the body the line isn't yenc data and is ignored
+					if((m_line > 0) && !m_part_flags[YENC_TRAILER])
+					{
+						m_escape = 1;
+						m_feed_line_chars = 1;
+					}
+					m_feed_state = FEED_DATA;
+				}
+				break;
+
+			case FEED_KEYWORD:
+			{
+				const char *p_eol = (const char*)memchr(p_in, '\n', p_end - p_in);
+				const char *p_seg = (nullptr == p_eol) ? p_end : p_eol;
+				if(m_kw_line.size() < YENC_MAX_KW_LINE)
+					m_kw_line.append(p_in, std::min((size_t)(p_seg - p_in), YENC_MAX_KW_LINE - m_kw_line.size()));
+				p_in = p_seg;
+				if(nullptr != p_eol)
+				{
+					if(!m_kw_line.empty() && ('\r' == m_kw_line.back()))
+						m_kw_line.pop_back();
+					decode_kw_line(m_kw_line.c_str(), m_kw_line.size());
+					m_kw_line.clear();
+					m_feed_state = FEED_LINE_START;
+					++p_in;
+				}
+				break;
+			}
+
+			case FEED_DATA_CR:
+				// a held back '\r' either ends the line or was data
+				if('\n' == *p_in)
+				{
+					if(m_escape)
+						m_part_flags[YENC_TRUNCATED_LINE] = true;
+					if((m_line > 0) && !m_part_flags[YENC_TRAILER])
+						check_line(m_feed_line_offset, (m_data_size + (p_out - p_start)) - m_feed_line_offset, m_feed_line_chars, 0 != m_escape, m_feed_line_stuffed);
+					m_escape = 0;
+					m_feed_state = FEED_LINE_START;
+					++p_in;
+					break;
+				}
+				if((m_line > 0) && !m_part_flags[YENC_TRAILER])
+				{
+					if(p_out == (m_out_buf + m_out_size))
+						goto feed_done;
+					p_out += Kernel::decode(p_out, "\r", 1, &m_escape);
+				}
+				++m_feed_line_chars;
+				m_feed_state = FEED_DATA;
+				break;
+
+			case FEED_DATA:
+			{
+				const char *p_eol = (const char*)memchr(p_in, '\n', p_end - p_in);
+				const char *p_seg = (nullptr == p_eol) ? p_end : p_eol;
+
+				// hold back a '\r' at the end of the data, it is part of the line end
+				bool is_cr = (p_seg > p_in) && ('\r' == p_seg[-1]);
+				long seglen = (p_seg - p_in) - (is_cr ? 1 : 0);
+
+				if((m_line > 0) && !m_part_flags[YENC_TRAILER])
+				{
+					// decoded data is no longer than the encoded data, so only
+					// decode as much as there is output room for, and go on with
+					// the rest of the line while escapes leave some room
+					const unsigned long room = m_out_buf + m_out_size - p_out;
+					if((unsigned long)seglen > room)
+					{
+						if(0 == room)
+							goto feed_done;
+						p_out += Kernel::decode(p_out, p_in, room, &m_escape);
+						p_in += room;
+						m_feed_line_chars += room;
+						break;
+					}
+					p_out += Kernel::decode(p_out, p_in, seglen, &m_escape);
+				}
+				m_feed_line_chars += seglen;
+
+				p_in = p_seg;
+				if(nullptr != p_eol)
+				{
+					if(m_escape)
+						m_part_flags[YENC_TRUNCATED_LINE] = true;
+					if((m_line > 0) && !m_part_flags[YENC_TRAILER])
+						check_line(m_feed_line_offset, (m_data_size + (p_out - p_start)) - m_feed_line_offset, m_feed_line_chars, 0 != m_escape, m_feed_line_stuffed);
+					m_escape = 0;
+					m_feed_state = FEED_LINE_START;
+					++p_in;
+				}
+				else if(is_cr)
+					m_feed_state = FEED_DATA_CR;
+				break;
+			}
+
+			case FEED_END:
+				break;
+		}
+	}
+
+feed_done:
+	if(FEED_END == m_feed_state)
+		m_part_flags[YENC_BODY_END] = true;
+
+	// update the working CRC for all data decoded by this call
+	m_calc_crc32.update_crc(p_start, p_out - p_start);
+	m_out_len += p_out - p_start;
+	m_data_size += p_out - p_start;
+
+	if(nullptr != pUsed)
+		*pUsed = p_in - data;
+
+	if(m_part_flags[YENC_TRUNCATED_LINE])
+		return DecodeResult::YENC_TRUNCATED;
+	if(m_part_flags[YENC_TRAILER])
+		return DecodeResult::YENC_COMPLETE;
+	return (p_out > p_start) ? DecodeResult::YENC_DATA : DecodeResult::YENC_NONE;
 }
 
 }	/* namespace yEnc */
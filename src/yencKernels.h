@@ -0,0 +1,82 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#ifndef __YENC_KERNELS_HEADER__
+#define __YENC_KERNELS_HEADER__
+
+#include <cstdint>
+
+namespace yEnc { namespace Kernel {
+
+/*
+ * Decodes 'len' bytes of yEnc data from 'src' into 'dst' and returns the
+ * number of bytes written.  '*p_escape' carries a pending '=' escape in to
+ * and out of the call: on entry a non-zero value means the first byte of
+ * 'src' is escaped, on return it is non-zero if 'src' ended with an escape.
+ *
+ * 'dst' needs room for 'len' bytes less the number of escapes in 'src'.
+ */
+typedef long (*decode_fn)(uint8_t *dst, const char *src, long len, int *p_escape);
+
+struct DecodeKernel
+{
+	const char *name;
+	decode_fn decode;
+	bool is_supported;
+};
+
+// decode using the fastest kernel supported by this CPU, the kernel is
+// selected once, on first use, by checking the CPU features (cpuid)
+long decode(uint8_t *dst, const char *src, long len, int *p_escape);
+
+// get the name of the kernel selected for 'decode'
+const char *get_decode_kernel_name();
+
+// get the list of all decode kernels built into the library, the scalar
+// reference kernel is always first and the list ends with a null name
+const DecodeKernel *get_decode_kernels();
+
+/*
+ * Encodes 'len' bytes from 'src' into 'dst' as yEnc lines of 'line_size' chars
+ * and returns the number of chars written.  '*p_col' is the output column that
+ * is carried between calls.  'EolSize' selects the line ending, 1 for "\n" and
+ * 2 for "\r\n", and 'DotStuffing' doubles a '.' at the start of a line.
+ *
+ * 'dst' needs room for Encoder::get_max_encoded_size(len, line_size, EolSize).
+ */
+typedef long (*encode_fn)(char *dst, const uint8_t *src, long len, int *p_col, int line_size);
+
+template<int EolSize, bool DotStuffing>
+long encode(char *dst, const uint8_t *src, long len, int *p_col, int line_size);
+
+struct EncodeKernel
+{
+	const char *name;
+	encode_fn encode;
+	bool is_supported;
+};
+
+// get the list of encode kernels for the given line ending and dot-stuffing
+// policy, in the same order and format as get_decode_kernels
+template<int EolSize, bool DotStuffing>
+const EncodeKernel *get_encode_kernels();
+
+} }	/* namespace yEnc::Kernel */
+
+#endif	/* __YENC_KERNELS_HEADER__ */
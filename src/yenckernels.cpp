@@ -0,0 +1,642 @@
+/*
+	libusenet NNTP/NZB tools
+
+    Copyright (C) 2016  Richard J. Fellinger, Jr
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; version 2 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, see <http://www.gnu.org/licenses/> or write
+	to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+	Boston, MA 02110-1301 USA.
+*/
+#include "yencKernels.h"
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#	define YENC_KERNELS_X86
+#	include <immintrin.h>
+#endif
+
+namespace yEnc { namespace Kernel {
+
+/*
+ * The reference decoder, every other kernel must give the same result.
+ */
+static long decode_scalar(uint8_t *dst, const char *src, long len, int *p_escape)
+{
+	uint8_t *p_out = dst;
+	int escape = *p_escape;
+
+	for(register long i = 0; i < len; ++i)
+	{
+		if(escape)
+		{
+			*(p_out++) = (unsigned char)src[i] - (unsigned char)106;
+			escape = 0;
+		}
+		else if('=' == src[i])
+			escape = 1;
+		else
+			*(p_out++) = (unsigned char)src[i] - (unsigned char)42;
+	}
+
+	*p_escape = escape;
+	return p_out - dst;
+}
+
+/*
+ * Writes the line ending selected by 'EolSize'.
+ */
+template<int EolSize>
+static inline char *put_eol(char *p_out)
+{
+	if(2 == EolSize)
+		*(p_out++) = '\r';
+	*(p_out++) = '\n';
+	return p_out;
+}
+
+/*
+ * Encodes a single byte, which is the reference for every encode kernel.
+ */
+template<int EolSize, bool DotStuffing>
+static inline char *encode_byte(char *p_out, uint8_t byte, int& col, int line_size)
+{
+	// encode the byte to yEnc and check for a critical character
+	char c = byte + 42;
+	if(c == 0x00 || c == 0x0a || c == 0x0d || c == 0x3d)
+	{
+		// write the yEnc escape for the critical character
+		*(p_out++) = '=';
+		c = char(c + 64);
+		++col;
+	}
+
+	// write the yEnc encoded char
+	*(p_out++) = c;
+	++col;
+
+	// double '.' chars if they are at the first position of a line (usenet)
+	if(DotStuffing && (1 == col) && ('.' == c))
+	{
+		*(p_out++) = c;
+		++col;
+	}
+
+	// check the line size
+	if(col >= line_size)
+	{
+		p_out = put_eol<EolSize>(p_out);
+		col = 0;
+	}
+
+	return p_out;
+}
+
+template<int EolSize, bool DotStuffing>
+static long encode_scalar(char *dst, const uint8_t *src, long len, int *p_col, int line_size)
+{
+	char *p_out = dst;
+	int col = *p_col;
+
+	for(register long i = 0; i < len; ++i)
+		p_out = encode_byte<EolSize, DotStuffing>(p_out, src[i], col, line_size);
+
+	*p_col = col;
+	return p_out - dst;
+}
+
+#ifdef YENC_KERNELS_X86
+
+// the SIMD kernels can store a full vector at the output position when only some
+// of those bytes are decoded data.  It is safe when at least this many bytes of
+// input follow the current block, since those will decode into the overwritten
+// space, else the block is staged on the stack and only the decoded bytes copied.
+#define YENC_SAFE_TAIL		34
+
+// pshufb indices for packing the bytes of an 8 byte lane that are selected by
+// the bits of the table index; the second table is for the high lane of a vector
+static uint64_t scPackLo[256];
+static uint64_t scPackHi[256];
+
+static void init_pack_tables()
+{
+	for(int mask = 0; mask < 256; ++mask)
+	{
+		uint64_t lo = 0x8080808080808080ULL, hi = 0x8080808080808080ULL;
+		for(int bit = 0, n = 0; bit < 8; ++bit)
+		{
+			if(mask & (1 << bit))
+			{
+				lo = (lo & ~(0xffULL << (8 * n))) | (uint64_t(bit) << (8 * n));
+				hi = (hi & ~(0xffULL << (8 * n))) | (uint64_t(bit + 8) << (8 * n));
+				++n;
+			}
+		}
+		scPackLo[mask] = lo;
+		scPackHi[mask] = hi;
+	}
+}
+
+static long decode_sse2(uint8_t *dst, const char *src, long len, int *p_escape)
+__attribute__((target("sse2")));
+
+static long decode_sse2(uint8_t *dst, const char *src, long len, int *p_escape)
+{
+	const __m128i eq = _mm_set1_epi8('=');
+	const __m128i off = _mm_set1_epi8(42);
+
+	uint8_t *p_out = dst;
+	long i = 0;
+
+	// only blocks without an escape are vectorized, the rest use the scalar loop
+	for(; (len - i) >= 16; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)&src[i]);
+		if(*p_escape || _mm_movemask_epi8(_mm_cmpeq_epi8(v, eq)))
+			p_out += decode_scalar(p_out, &src[i], 16, p_escape);
+		else
+		{
+			_mm_storeu_si128((__m128i*)p_out, _mm_sub_epi8(v, off));
+			p_out += 16;
+		}
+	}
+
+	return (p_out - dst) + decode_scalar(p_out, &src[i], len - i, p_escape);
+}
+
+/*
+ * Decodes a 16 byte block which has at least one '=' char or a pending escape.
+ * The escape positions are found from the movemask of the '=' compare, the data
+ * following an escape is adjusted by the extra 64 and the escape chars are
+ * removed with a pshufb per 8 byte lane.
+ */
+static inline long decode_block_ssse3(uint8_t *dst, const char *src, int *p_escape, bool is_safe)
+__attribute__((target("ssse3"), always_inline));
+
+static inline long decode_block_ssse3(uint8_t *dst, const char *src, int *p_escape, bool is_safe)
+{
+	__m128i v = _mm_loadu_si128((const __m128i*)src);
+	unsigned int esc = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('=')));
+
+	// a pending escape makes the first byte data, even if it is an '='
+	if(*p_escape)
+		esc &= ~1U;
+
+	// "==" only appears in data from non-conforming encoders, let the scalar loop
+	// work out which of those are escapes
+	if(esc & (esc << 1))
+		return decode_scalar(dst, src, 16, p_escape);
+
+	// expand the bits of the escaped data positions into a byte mask
+	const unsigned int escaped = ((esc << 1) | (*p_escape ? 1U : 0U)) & 0xffff;
+	const __m128i bits = _mm_set_epi8(
+		-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+	__m128i sel = _mm_shuffle_epi8(_mm_cvtsi32_si128(escaped), _mm_set_epi8(1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0));
+	sel = _mm_cmpeq_epi8(_mm_and_si128(sel, bits), bits);
+
+	// subtract 42 from all bytes and another 64 from escaped data
+	v = _mm_sub_epi8(v, _mm_set1_epi8(42));
+	v = _mm_sub_epi8(v, _mm_and_si128(sel, _mm_set1_epi8(64)));
+
+	// pack the bytes that are not escape chars
+	const unsigned int keep = ~esc & 0xffff;
+	v = _mm_shuffle_epi8(v, _mm_set_epi64x(scPackHi[keep >> 8], scPackLo[keep & 0xff]));
+
+	const int lo_count = __builtin_popcount(keep & 0xff);
+	const int count = lo_count + __builtin_popcount(keep >> 8);
+
+	if(is_safe)
+	{
+		_mm_storel_epi64((__m128i*)dst, v);
+		_mm_storel_epi64((__m128i*)(dst + lo_count), _mm_unpackhi_epi64(v, v));
+	}
+	else
+	{
+		uint8_t stage[16];
+		_mm_storel_epi64((__m128i*)stage, v);
+		_mm_storel_epi64((__m128i*)(stage + lo_count), _mm_unpackhi_epi64(v, v));
+		memcpy(dst, stage, count);
+	}
+
+	*p_escape = (esc >> 15) & 1;
+	return count;
+}
+
+static long decode_ssse3(uint8_t *dst, const char *src, long len, int *p_escape)
+__attribute__((target("ssse3")));
+
+static long decode_ssse3(uint8_t *dst, const char *src, long len, int *p_escape)
+{
+	const __m128i eq = _mm_set1_epi8('=');
+	const __m128i off = _mm_set1_epi8(42);
+
+	uint8_t *p_out = dst;
+	long i = 0;
+
+	for(; (len - i) >= 16; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)&src[i]);
+		if(*p_escape || _mm_movemask_epi8(_mm_cmpeq_epi8(v, eq)))
+			p_out += decode_block_ssse3(p_out, &src[i], p_escape, (len - i - 16) >= YENC_SAFE_TAIL);
+		else
+		{
+			_mm_storeu_si128((__m128i*)p_out, _mm_sub_epi8(v, off));
+			p_out += 16;
+		}
+	}
+
+	return (p_out - dst) + decode_scalar(p_out, &src[i], len - i, p_escape);
+}
+
+static long decode_avx2(uint8_t *dst, const char *src, long len, int *p_escape)
+__attribute__((target("avx2")));
+
+static long decode_avx2(uint8_t *dst, const char *src, long len, int *p_escape)
+{
+	const __m256i eq = _mm256_set1_epi8('=');
+	const __m256i off = _mm256_set1_epi8(42);
+
+	uint8_t *p_out = dst;
+	long i = 0;
+
+	for(; (len - i) >= 32; i += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)&src[i]);
+		if(*p_escape || _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, eq)))
+		{
+			// escapes are handled 16 bytes at a time
+			p_out += decode_block_ssse3(p_out, &src[i], p_escape, (len - i - 16) >= YENC_SAFE_TAIL);
+			p_out += decode_block_ssse3(p_out, &src[i + 16], p_escape, (len - i - 32) >= YENC_SAFE_TAIL);
+		}
+		else
+		{
+			_mm256_storeu_si256((__m256i*)p_out, _mm256_sub_epi8(v, off));
+			p_out += 32;
+		}
+	}
+
+	return (p_out - dst) + decode_ssse3(p_out, &src[i], len - i, p_escape);
+}
+
+static long decode_avx512vbmi2(uint8_t *dst, const char *src, long len, int *p_escape)
+__attribute__((target("avx512f,avx512bw,avx512vbmi2")));
+
+static long decode_avx512vbmi2(uint8_t *dst, const char *src, long len, int *p_escape)
+{
+	const __m512i eq = _mm512_set1_epi8('=');
+	const __m512i off = _mm512_set1_epi8(42);
+	const __m512i esc_off = _mm512_set1_epi8(64);
+
+	uint8_t *p_out = dst;
+	long i = 0;
+
+	for(; (len - i) >= 64; i += 64)
+	{
+		__m512i v = _mm512_loadu_si512((const void*)&src[i]);
+		uint64_t esc = _mm512_cmpeq_epi8_mask(v, eq);
+		if(*p_escape)
+			esc &= ~1ULL;
+
+		if(!esc && !*p_escape)
+		{
+			_mm512_storeu_si512((void*)p_out, _mm512_sub_epi8(v, off));
+			p_out += 64;
+		}
+		else if(esc & (esc << 1))
+			p_out += decode_scalar(p_out, &src[i], 64, p_escape);
+		else
+		{
+			// adjust the escaped data and compress out the escape chars, the
+			// masked store writes only the decoded bytes
+			const uint64_t escaped = (esc << 1) | (*p_escape ? 1ULL : 0ULL);
+			v = _mm512_sub_epi8(v, off);
+			v = _mm512_mask_sub_epi8(v, escaped, v, esc_off);
+			v = _mm512_maskz_compress_epi8(~esc, v);
+
+			const int count = 64 - __builtin_popcountll(esc);
+			_mm512_mask_storeu_epi8((void*)p_out, (count == 64) ? ~0ULL : ((1ULL << count) - 1), v);
+			p_out += count;
+			*p_escape = (esc >> 63) & 1;
+		}
+	}
+
+	return (p_out - dst) + decode_avx2(p_out, &src[i], len - i, p_escape);
+}
+
+/*
+ * Writes a vector of encoded input, 'enc' with its critical chars set in 'mask', a
+ * run of plain chars at a time up to the next critical char or the end of the
+ * line.  The critical chars get their escape here, only line starts go through
+ * encode_byte for the dot-stuffing check.  'enc' holds the vector twice so that a
+ * run can be copied as a whole vector, which stays within the encoded size while
+ * there is a full vector of input left from the run, of the 'room' from 'src'.
+ */
+template<int EolSize, bool DotStuffing, int Size>
+static inline char *encode_vector(char *p_out, const char *enc, const uint8_t *src, unsigned int mask, long room, int& col, int line_size)
+{
+	int j = 0;
+	while(j < Size)
+	{
+		if(DotStuffing && (0 == col))
+		{
+			p_out = encode_byte<EolSize, DotStuffing>(p_out, src[j++], col, line_size);
+			continue;
+		}
+
+		const unsigned int rest = mask >> j;
+		int n = rest ? __builtin_ctz(rest) : (Size - j);
+		if(n > (line_size - col))
+			n = line_size - col;
+
+		if(n > 0)
+		{
+			if((room - j) >= Size)
+				memcpy(p_out, &enc[j], Size);
+			else
+				memcpy(p_out, &enc[j], n);
+			p_out += n;
+			j += n;
+			col += n;
+		}
+		else
+		{
+			*(p_out++) = '=';
+			*(p_out++) = char(enc[j++] + 64);
+			col += 2;
+		}
+
+		if(col >= line_size)
+		{
+			p_out = put_eol<EolSize>(p_out);
+			col = 0;
+		}
+	}
+
+	return p_out;
+}
+
+/*
+ * The SIMD encoders add 42 to a full vector of input and find its critical chars.
+ * A vector without any which doesn't reach the end of the line is stored as it
+ * is, any other is written by encode_vector, and encode_byte handles the input
+ * tail.  Every input byte makes at least one char of output, so a vector store is
+ * always within the encoded size when there is a full vector of input left.
+ */
+template<int EolSize, bool DotStuffing>
+static long encode_sse2(char *dst, const uint8_t *src, long len, int *p_col, int line_size)
+__attribute__((target("sse2")));
+
+template<int EolSize, bool DotStuffing>
+static long encode_sse2(char *dst, const uint8_t *src, long len, int *p_col, int line_size)
+{
+	const __m128i off = _mm_set1_epi8(42);
+	const __m128i nul = _mm_setzero_si128();
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i eq = _mm_set1_epi8('=');
+
+	char *p_out = dst;
+	int col = *p_col;
+	long i = 0;
+
+	for(; (len - i) >= 16; i += 16)
+	{
+		__m128i v = _mm_add_epi8(_mm_loadu_si128((const __m128i*)&src[i]), off);
+		__m128i crit = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, nul), _mm_cmpeq_epi8(v, lf)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, eq)));
+
+		unsigned int mask = _mm_movemask_epi8(crit);
+		if(!mask && (col > 0) && ((col + 16) < line_size))
+		{
+			_mm_storeu_si128((__m128i*)p_out, v);
+			p_out += 16;
+			col += 16;
+			continue;
+		}
+
+		alignas(16) char enc[32];
+		_mm_store_si128((__m128i*)enc, v);
+		_mm_store_si128((__m128i*)&enc[16], v);
+		p_out = encode_vector<EolSize, DotStuffing, 16>(p_out, enc, &src[i], mask, len - i, col, line_size);
+	}
+
+	for(; i < len; ++i)
+		p_out = encode_byte<EolSize, DotStuffing>(p_out, src[i], col, line_size);
+
+	*p_col = col;
+	return p_out - dst;
+}
+
+template<int EolSize, bool DotStuffing>
+static long encode_avx2(char *dst, const uint8_t *src, long len, int *p_col, int line_size)
+__attribute__((target("avx2")));
+
+template<int EolSize, bool DotStuffing>
+static long encode_avx2(char *dst, const uint8_t *src, long len, int *p_col, int line_size)
+{
+	const __m256i off = _mm256_set1_epi8(42);
+	const __m256i nul = _mm256_setzero_si256();
+	const __m256i lf = _mm256_set1_epi8('\n');
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i eq = _mm256_set1_epi8('=');
+
+	char *p_out = dst;
+	int col = *p_col;
+	long i = 0;
+
+	for(; (len - i) >= 32; i += 32)
+	{
+		__m256i v = _mm256_add_epi8(_mm256_loadu_si256((const __m256i*)&src[i]), off);
+		__m256i crit = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, nul), _mm256_cmpeq_epi8(v, lf)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, eq)));
+
+		unsigned int mask = _mm256_movemask_epi8(crit);
+		if(!mask && (col > 0) && ((col + 32) < line_size))
+		{
+			_mm256_storeu_si256((__m256i*)p_out, v);
+			p_out += 32;
+			col += 32;
+			continue;
+		}
+
+		alignas(32) char enc[64];
+		_mm256_store_si256((__m256i*)enc, v);
+		_mm256_store_si256((__m256i*)&enc[32], v);
+		p_out = encode_vector<EolSize, DotStuffing, 32>(p_out, enc, &src[i], mask, len - i, col, line_size);
+	}
+
+	for(; i < len; ++i)
+		p_out = encode_byte<EolSize, DotStuffing>(p_out, src[i], col, line_size);
+
+	*p_col = col;
+	return p_out - dst;
+}
+
+#endif	/* YENC_KERNELS_X86 */
+
+#ifdef YENC_KERNELS_X86
+
+/*
+ * The CPU features that the kernels are built for, checked once.
+ */
+struct CpuFeatures
+{
+	bool sse2;
+	bool ssse3;
+	bool avx2;
+	bool avx512bw;
+	bool avx512vbmi2;
+};
+
+static const CpuFeatures& get_cpu_features()
+{
+	static const CpuFeatures sFeatures = []() -> CpuFeatures
+	{
+		__builtin_cpu_init();
+
+		CpuFeatures features;
+		features.sse2 = __builtin_cpu_supports("sse2");
+		features.ssse3 = __builtin_cpu_supports("ssse3");
+		features.avx2 = __builtin_cpu_supports("avx2");
+		features.avx512bw = __builtin_cpu_supports("avx512bw") && features.avx2;
+		features.avx512vbmi2 = __builtin_cpu_supports("avx512vbmi2") && features.avx512bw;
+		return features;
+	}();
+
+	return sFeatures;
+}
+
+#endif	/* YENC_KERNELS_X86 */
+
+const DecodeKernel *get_decode_kernels()
+{
+	static const DecodeKernel *sKernels = []() -> const DecodeKernel*
+	{
+		static DecodeKernel kernels[] = {
+			{ "scalar", decode_scalar, true },
+#ifdef YENC_KERNELS_X86
+			{ "sse2", decode_sse2, false },
+			{ "ssse3", decode_ssse3, false },
+			{ "avx2", decode_avx2, false },
+			{ "avx512vbmi2", decode_avx512vbmi2, false },
+#endif
+			{ nullptr, nullptr, false },
+		};
+
+#ifdef YENC_KERNELS_X86
+		init_pack_tables();
+
+		const CpuFeatures& features = get_cpu_features();
+		kernels[1].is_supported = features.sse2;
+		kernels[2].is_supported = features.ssse3;
+		kernels[3].is_supported = features.avx2;
+		kernels[4].is_supported = features.avx512vbmi2;
+#endif
+
+		return kernels;
+	}();
+
+	return sKernels;
+}
+
+static const DecodeKernel& get_selected_kernel()
+{
+	// the fastest supported kernel by "make bench": sse2 only vectorizes blocks
+	// without an escape, which is slower than scalar on escape-heavy data, so
+	// it's never picked
+	static const char *const scPreferred[] = { "avx512vbmi2", "avx2", "ssse3", };
+
+	static const DecodeKernel& sKernel = []() -> const DecodeKernel&
+	{
+		const DecodeKernel *p_kernels = get_decode_kernels();
+		for(const char *name : scPreferred)
+		{
+			for(const DecodeKernel *p = p_kernels; nullptr != p->name; ++p)
+			{
+				if(p->is_supported && (0 == strcmp(name, p->name)))
+					return *p;
+			}
+		}
+		return *p_kernels;
+	}();
+
+	return sKernel;
+}
+
+long decode(uint8_t *dst, const char *src, long len, int *p_escape)
+{
+	return get_selected_kernel().decode(dst, src, len, p_escape);
+}
+
+const char *get_decode_kernel_name()
+{
+	return get_selected_kernel().name;
+}
+
+template<int EolSize, bool DotStuffing>
+const EncodeKernel *get_encode_kernels()
+{
+	static const EncodeKernel *sKernels = []() -> const EncodeKernel*
+	{
+		static EncodeKernel kernels[] = {
+			{ "scalar", encode_scalar<EolSize, DotStuffing>, true },
+#ifdef YENC_KERNELS_X86
+			{ "sse2", encode_sse2<EolSize, DotStuffing>, false },
+			{ "avx2", encode_avx2<EolSize, DotStuffing>, false },
+#endif
+			{ nullptr, nullptr, false },
+		};
+
+#ifdef YENC_KERNELS_X86
+		const CpuFeatures& features = get_cpu_features();
+		kernels[1].is_supported = features.sse2;
+		kernels[2].is_supported = features.avx2;
+#endif
+
+		return kernels;
+	}();
+
+	return sKernels;
+}
+
+template<int EolSize, bool DotStuffing>
+long encode(char *dst, const uint8_t *src, long len, int *p_col, int line_size)
+{
+	// the last supported kernel in the list is the fastest
+	static const encode_fn sEncode = []() -> encode_fn
+	{
+		const EncodeKernel *p_best = get_encode_kernels<EolSize, DotStuffing>();
+		for(const EncodeKernel *p = p_best; nullptr != p->name; ++p)
+		{
+			if(p->is_supported)
+				p_best = p;
+		}
+		return p_best->encode;
+	}();
+
+	return sEncode(dst, src, len, p_col, line_size);
+}
+
+// the line ending and dot-stuffing combinations used by yEnc::Encoder
+template long encode<1, false>(char*, const uint8_t*, long, int*, int);
+template long encode<1, true>(char*, const uint8_t*, long, int*, int);
+template long encode<2, false>(char*, const uint8_t*, long, int*, int);
+template long encode<2, true>(char*, const uint8_t*, long, int*, int);
+
+template const EncodeKernel *get_encode_kernels<1, false>();
+template const EncodeKernel *get_encode_kernels<1, true>();
+template const EncodeKernel *get_encode_kernels<2, false>();
+template const EncodeKernel *get_encode_kernels<2, true>();
+
+} }	/* namespace yEnc::Kernel */